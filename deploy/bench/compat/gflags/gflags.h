@@ -0,0 +1,12 @@
+#pragma once
+
+// The part of gflags used by the operator profiler: there are no Paddle flags
+// to set without Paddle, an empty string tells so as gflags does.
+
+#include <string>
+
+namespace google {
+    inline std::string SetCommandLineOption(const char* name, const char* value) {
+        return std::string();
+    }
+}
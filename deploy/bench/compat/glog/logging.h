@@ -0,0 +1,33 @@
+#pragma once
+
+// The part of glog used by the preprocessors, writing to stderr, so that
+// preprocess_bench builds without the Paddle third party libraries.
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+namespace google {
+    class BenchLogMessage {
+    public:
+        BenchLogMessage(const char* severity, bool fatal) : _fatal(fatal) {
+            std::cerr << severity << " ";
+        }
+
+        ~BenchLogMessage() {
+            std::cerr << std::endl;
+            if (_fatal) {
+                std::abort();
+            }
+        }
+
+        std::ostream& stream() {
+            return std::cerr;
+        }
+
+    private:
+        bool _fatal;
+    };
+}
+
+#define LOG(severity) google::BenchLogMessage(#severity, std::string(#severity) == "FATAL").stream()
@@ -0,0 +1,288 @@
+#pragma once
+
+// The part of the Paddle inference API used by the predictors, standing in for
+// Paddle so that steady_state_check runs the predict loops without it. The
+// model is fake: its only output holds `kClasses` scores per image of the
+// batch, whatever the input. The allocations of the fake predictor are not
+// counted (see utils/alloc_counter.h), Paddle has its own and they are not the
+// loop's; PaddleBuf allocates as the real one does, on behalf of its caller.
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "utils/alloc_counter.h"
+
+namespace paddle {
+    enum PaddleDType {
+        FLOAT32,
+        INT64,
+        INT32,
+        UINT8,
+    };
+
+    // owns its memory when built with a length or resized, borrows it after Reset()
+    class PaddleBuf {
+    public:
+        PaddleBuf() : _data(nullptr), _length(0), _owned(false) {
+        }
+        explicit PaddleBuf(size_t length) : PaddleBuf() {
+            Resize(length);
+        }
+        PaddleBuf(void* data, size_t length) : _data(data), _length(length), _owned(false) {
+        }
+        PaddleBuf(const PaddleBuf& other) : PaddleBuf() {
+            *this = other;
+        }
+        PaddleBuf(PaddleBuf&& other) : _data(other._data), _length(other._length), _owned(other._owned) {
+            other._data = nullptr;
+            other._length = 0;
+            other._owned = false;
+        }
+        ~PaddleBuf() {
+            Free();
+        }
+
+        PaddleBuf& operator=(const PaddleBuf& other) {
+            if (this == &other) {
+                return *this;
+            }
+            if (!other._owned) {
+                Reset(other._data, other._length);
+                return *this;
+            }
+            Free();
+            Resize(other._length);
+            memcpy(_data, other._data, _length);
+            return *this;
+        }
+        PaddleBuf& operator=(PaddleBuf&& other) {
+            std::swap(_data, other._data);
+            std::swap(_length, other._length);
+            std::swap(_owned, other._owned);
+            return *this;
+        }
+
+        void Reset(void* data, size_t length) {
+            Free();
+            _data = data;
+            _length = length;
+        }
+        // keeps the memory it owns when it is large enough
+        void Resize(size_t length) {
+            if (_owned && _length >= length) {
+                return;
+            }
+            Free();
+            _data = new char[length];
+            _length = length;
+            _owned = true;
+        }
+        void* data() const {
+            return _data;
+        }
+        size_t length() const {
+            return _length;
+        }
+        bool empty() const {
+            return _length == 0;
+        }
+
+    private:
+        void Free() {
+            if (_owned) {
+                delete[] static_cast<char*>(_data);
+            }
+            _data = nullptr;
+            _length = 0;
+            _owned = false;
+        }
+
+        void* _data;
+        size_t _length;
+        bool _owned;
+    };
+
+    struct PaddleTensor {
+        PaddleTensor() : dtype(FLOAT32) {
+        }
+        std::string name;
+        std::vector<int> shape;
+        PaddleBuf data;
+        PaddleDType dtype;
+        std::vector<std::vector<size_t>> lod;
+    };
+
+    namespace bench {
+        // scores per image of the fake model
+        const int kClasses = 4;
+
+        inline int volume(const std::vector<int>& shape) {
+            int count = 1;
+            for (int dim : shape) {
+                count *= dim;
+            }
+            return count;
+        }
+
+        // a tensor of the fake model, input or output
+        struct TensorData {
+            std::vector<int> shape;
+            std::vector<char> data;
+        };
+    }
+
+    class ZeroCopyTensor {
+    public:
+        explicit ZeroCopyTensor(bench::TensorData* tensor) : _tensor(tensor) {
+        }
+        void Reshape(const std::vector<int>& shape) {
+            PaddleSolution::utils::UncountedScope uncounted;
+            _tensor->shape = shape;
+        }
+        template <typename T>
+        void copy_from_cpu(const T* data) {
+            PaddleSolution::utils::UncountedScope uncounted;
+            _tensor->data.resize(bench::volume(_tensor->shape) * sizeof(T));
+            memcpy(_tensor->data.data(), data, _tensor->data.size());
+        }
+        template <typename T>
+        void copy_to_cpu(T* data) {
+            memcpy(data, _tensor->data.data(), _tensor->data.size());
+        }
+        std::vector<int> shape() const {
+            PaddleSolution::utils::UncountedScope uncounted;
+            return _tensor->shape;
+        }
+        std::vector<std::vector<size_t>> lod() const {
+            return std::vector<std::vector<size_t>>();
+        }
+
+    private:
+        bench::TensorData* _tensor;
+    };
+
+    class PaddlePredictor {
+    public:
+        virtual ~PaddlePredictor() {
+        }
+
+        virtual bool Run(const std::vector<PaddleTensor>& inputs, std::vector<PaddleTensor>* outputs,
+                         int batch_size = -1) {
+            PaddleSolution::utils::UncountedScope uncounted;
+            if (inputs.empty() || inputs[0].shape.empty()) {
+                return false;
+            }
+            int batch = batch_size > 0 ? batch_size : inputs[0].shape[0];
+            outputs->resize(1);
+            PaddleTensor& output = outputs->front();
+            output.name = "save_infer_model/scale_0";
+            output.shape = { batch, bench::kClasses };
+            output.dtype = FLOAT32;
+            output.data.Resize(batch * bench::kClasses * sizeof(float));
+            scores(static_cast<float*>(output.data.data()), batch);
+            return true;
+        }
+
+        std::vector<std::string> GetInputNames() {
+            PaddleSolution::utils::UncountedScope uncounted;
+            return { "image" };
+        }
+        std::vector<std::string> GetOutputNames() {
+            PaddleSolution::utils::UncountedScope uncounted;
+            return { "save_infer_model/scale_0" };
+        }
+        std::unique_ptr<ZeroCopyTensor> GetInputTensor(const std::string& name) {
+            PaddleSolution::utils::UncountedScope uncounted;
+            return std::unique_ptr<ZeroCopyTensor>(new ZeroCopyTensor(&_input));
+        }
+        std::unique_ptr<ZeroCopyTensor> GetOutputTensor(const std::string& name) {
+            PaddleSolution::utils::UncountedScope uncounted;
+            return std::unique_ptr<ZeroCopyTensor>(new ZeroCopyTensor(&_output));
+        }
+
+        bool ZeroCopyRun() {
+            PaddleSolution::utils::UncountedScope uncounted;
+            if (_input.shape.empty()) {
+                return false;
+            }
+            int batch = _input.shape[0];
+            _output.shape = { batch, bench::kClasses };
+            _output.data.resize(batch * bench::kClasses * sizeof(float));
+            scores(reinterpret_cast<float*>(_output.data.data()), batch);
+            return true;
+        }
+
+        std::unique_ptr<PaddlePredictor> Clone() {
+            PaddleSolution::utils::UncountedScope uncounted;
+            return std::unique_ptr<PaddlePredictor>(new PaddlePredictor());
+        }
+
+    private:
+        // the same scores for every image, the last class on top
+        static void scores(float* out, int batch) {
+            for (int i = 0; i < batch * bench::kClasses; ++i) {
+                out[i] = static_cast<float>(i % bench::kClasses + 1) / bench::kClasses;
+            }
+        }
+
+        bench::TensorData _input;
+        bench::TensorData _output;
+    };
+
+    struct NativeConfig {
+        NativeConfig() : use_gpu(false), device(0), fraction_of_gpu_memory(-1) {
+        }
+        void SetCpuMathLibraryNumThreads(int num_threads) {
+        }
+        std::string model_dir;
+        std::string prog_file;
+        std::string param_file;
+        bool use_gpu;
+        int device;
+        float fraction_of_gpu_memory;
+    };
+
+    struct MkldnnQuantizerConfig {
+        void SetWarmupData(std::shared_ptr<std::vector<PaddleTensor>> data) {
+        }
+        void SetWarmupBatchSize(int batch_size) {
+        }
+        void SetEnabledOpTypes(std::unordered_set<std::string> op_types) {
+        }
+    };
+
+    class AnalysisConfig {
+    public:
+        void SetModel(const std::string& prog_file, const std::string& params_file) {
+        }
+        void EnableUseGpu(uint64_t memory_pool_init_size_mb, int device_id) {
+        }
+        void SwitchUseFeedFetchOps(bool on) {
+        }
+        void SetCpuMathLibraryNumThreads(int num_threads) {
+        }
+        void EnableProfile() {
+        }
+        void EnableMKLDNN() {
+        }
+        void EnableMkldnnQuantizer() {
+        }
+        MkldnnQuantizerConfig* mkldnn_quantizer_config() {
+            return &_quantizer_config;
+        }
+
+    private:
+        MkldnnQuantizerConfig _quantizer_config;
+    };
+
+    template <typename Config>
+    std::unique_ptr<PaddlePredictor> CreatePaddlePredictor(const Config& config) {
+        PaddleSolution::utils::UncountedScope uncounted;
+        return std::unique_ptr<PaddlePredictor>(new PaddlePredictor());
+    }
+}
@@ -0,0 +1,539 @@
+// Benchmark of the preprocessors and of alternative preprocessing kernels,
+// without Paddle: only OpenCV and yaml-cpp are linked.
+//
+//     ./preprocess_bench [--sizes=640x480,1280x720,1920x1080] [--threads=1,2,4]
+//                        [--batch=8] [--iters=10] [--image_dir=/path/to/images]
+//                        [--seg_conf=..] [--classify_conf=..] [--detection_conf=..]
+//                        [--output=preprocess_bench.jsonl]
+//
+// Every case prints one line to stdout and one JSON object to `output`:
+// ns_per_pixel is the time per input pixel, gb_per_s counts the decoded input
+// (w * h * 3 bytes) plus the output of each image.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "utils/seg_conf_parser.h"
+#include "utils/thread_pool.h"
+#include "utils/utils.h"
+#include "preprocessor/preprocessor_seg.h"
+#include "preprocessor/preprocessor_classify.h"
+#include "preprocessor/preprocessor_detection.h"
+#include "preprocessor/fused_resize.h"
+
+using PaddleSolution::ImageBlob;
+using PaddleSolution::PaddleSegModelConfigPaser;
+using PaddleSolution::utils::ThreadPool;
+
+namespace {
+    // --name=value arguments
+    class Args {
+    public:
+        Args(int argc, char** argv) {
+            for (int i = 1; i < argc; ++i) {
+                std::string arg(argv[i]);
+                if (arg.compare(0, 2, "--") != 0) {
+                    continue;
+                }
+                size_t eq = arg.find('=');
+                if (eq == std::string::npos) {
+                    _values[arg.substr(2)] = "1";
+                } else {
+                    _values[arg.substr(2, eq - 2)] = arg.substr(eq + 1);
+                }
+            }
+        }
+
+        std::string get(const std::string& name, const std::string& fallback) const {
+            auto it = _values.find(name);
+            return it != _values.end() ? it->second : fallback;
+        }
+
+        int get_int(const std::string& name, int fallback) const {
+            return atoi(get(name, std::to_string(fallback)).c_str());
+        }
+
+    private:
+        std::map<std::string, std::string> _values;
+    };
+
+    std::vector<std::string> split(const std::string& text, char separator) {
+        std::vector<std::string> items;
+        std::stringstream stream(text);
+        std::string item;
+        while (std::getline(stream, item, separator)) {
+            if (!item.empty()) {
+                items.push_back(item);
+            }
+        }
+        return items;
+    }
+
+    struct Result {
+        std::string suite;
+        std::string name;
+        std::string input;
+        int width;
+        int height;
+        int threads;
+        int64_t images;
+        double seconds;
+        // decoded input plus output bytes of all the images
+        double bytes;
+        // largest difference to the reference kernel, -1 when not compared
+        double max_err;
+    };
+
+    class Report {
+    public:
+        explicit Report(const std::string& output) : _file(nullptr) {
+            if (!output.empty()) {
+                _file = fopen(output.c_str(), "w");
+                if (_file == nullptr) {
+                    std::cerr << "Fail to create " << output << std::endl;
+                }
+            }
+            printf("%-12s %-24s %-10s %11s %8s %12s %10s %10s %10s\n", "suite", "name", "input", "size",
+                   "threads", "ns/pixel", "GB/s", "images/s", "max_err");
+        }
+
+        ~Report() {
+            if (_file != nullptr) {
+                fclose(_file);
+            }
+        }
+
+        void add(const Result& r) {
+            double pixels = static_cast<double>(r.images) * r.width * r.height;
+            double ns_per_pixel = pixels > 0 ? r.seconds * 1e9 / pixels : 0;
+            double gb_per_s = r.seconds > 0 ? r.bytes / r.seconds / 1e9 : 0;
+            double images_per_s = r.seconds > 0 ? r.images / r.seconds : 0;
+            char size[32];
+            snprintf(size, sizeof(size), "%dx%d", r.width, r.height);
+            printf("%-12s %-24s %-10s %11s %8d %12.3f %10.3f %10.1f %10.4g\n", r.suite.c_str(), r.name.c_str(),
+                   r.input.c_str(), size, r.threads, ns_per_pixel, gb_per_s, images_per_s, r.max_err);
+            fflush(stdout);
+            if (_file != nullptr) {
+                fprintf(_file, "{\"suite\": \"%s\", \"name\": \"%s\", \"input\": \"%s\", \"width\": %d, \"height\": %d, "
+                        "\"threads\": %d, \"images\": %lld, \"seconds\": %.6f, \"ns_per_pixel\": %.4f, "
+                        "\"gb_per_s\": %.4f, \"images_per_s\": %.2f, \"max_err\": %g}\n",
+                        r.suite.c_str(), r.name.c_str(), r.input.c_str(), r.width, r.height, r.threads,
+                        static_cast<long long>(r.images), r.seconds, ns_per_pixel, gb_per_s, images_per_s, r.max_err);
+                fflush(_file);
+            }
+        }
+
+    private:
+        std::FILE* _file;
+    };
+
+    // seconds per call of `fn`, after a warm up call
+    double time_it(int iters, const std::function<void()>& fn) {
+        fn();
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iters; ++i) {
+            fn();
+        }
+        return std::chrono::duration_cast<std::chrono::duration<double>>(
+            std::chrono::steady_clock::now() - start).count();
+    }
+
+    // a photo-like image: smooth noise, so JPEG sizes and decode times are realistic
+    cv::Mat synthetic_image(int width, int height, int seed) {
+        cv::Mat im(height, width, CV_8UC3);
+        cv::RNG rng(seed);
+        rng.fill(im, cv::RNG::UNIFORM, cv::Scalar::all(0), cv::Scalar::all(256));
+        cv::GaussianBlur(im, im, cv::Size(7, 7), 0);
+        return im;
+    }
+
+    ImageBlob encoded_blob(const cv::Mat& im, const std::string& name) {
+        ImageBlob blob;
+        blob.name = name;
+        std::vector<int> params = { cv::IMWRITE_JPEG_QUALITY, 90 };
+        cv::imencode(".jpg", im, blob.data, params);
+        return blob;
+    }
+
+    // one set of inputs: `batch` images of the same size (or the real images)
+    struct Inputs {
+        std::string kind;
+        int width;
+        int height;
+        std::vector<ImageBlob> blobs;
+        // decoded images, for the kernels
+        std::vector<cv::Mat> mats;
+    };
+
+    std::vector<Inputs> make_inputs(const Args& args, int batch) {
+        std::vector<Inputs> sets;
+        for (const auto& size : split(args.get("sizes", "640x480,1280x720,1920x1080"), ',')) {
+            int width = 0;
+            int height = 0;
+            if (sscanf(size.c_str(), "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+                std::cerr << "Bad size: " << size << std::endl;
+                continue;
+            }
+            Inputs encoded;
+            encoded.kind = "encoded";
+            encoded.width = width;
+            encoded.height = height;
+            Inputs decoded = encoded;
+            decoded.kind = "decoded";
+            for (int i = 0; i < batch; ++i) {
+                cv::Mat im = synthetic_image(width, height, i);
+                std::string name = "synthetic_" + std::to_string(i) + ".jpg";
+                encoded.blobs.push_back(encoded_blob(im, name));
+                encoded.mats.push_back(im);
+                decoded.blobs.push_back(ImageBlob::from_mat(name, im));
+                decoded.mats.push_back(im);
+            }
+            sets.push_back(encoded);
+            sets.push_back(decoded);
+        }
+        // real images: the size is their average
+        std::string image_dir = args.get("image_dir", "");
+        if (!image_dir.empty()) {
+            Inputs real;
+            real.kind = "real";
+            int64_t pixels = 0;
+            auto paths = PaddleSolution::utils::get_directory_images(image_dir, ".jpeg|.jpg|.JPEG|.JPG|.png|.PNG");
+            for (size_t i = 0; i < paths.size() && real.blobs.size() < static_cast<size_t>(batch); ++i) {
+                cv::Mat im = cv::imread(paths[i], cv::IMREAD_COLOR);
+                if (im.empty()) {
+                    continue;
+                }
+                FILE* fp = fopen(paths[i].c_str(), "rb");
+                if (fp == nullptr) {
+                    continue;
+                }
+                ImageBlob blob;
+                blob.name = paths[i];
+                fseek(fp, 0, SEEK_END);
+                blob.data.resize(ftell(fp));
+                fseek(fp, 0, SEEK_SET);
+                size_t n = fread(blob.data.data(), 1, blob.data.size(), fp);
+                fclose(fp);
+                if (n != blob.data.size()) {
+                    continue;
+                }
+                real.blobs.push_back(blob);
+                real.mats.push_back(im);
+                pixels += static_cast<int64_t>(im.cols) * im.rows;
+            }
+            if (!real.blobs.empty()) {
+                real.width = static_cast<int>(std::sqrt(static_cast<double>(pixels) / real.blobs.size()));
+                real.height = real.width;
+                sets.push_back(real);
+            } else {
+                std::cerr << "No image read from " << image_dir << std::endl;
+            }
+        }
+        return sets;
+    }
+
+    std::shared_ptr<PaddleSegModelConfigPaser> load_config(const std::string& conf) {
+        std::shared_ptr<PaddleSegModelConfigPaser> config(new PaddleSegModelConfigPaser());
+        if (!config->load_config(conf)) {
+            std::cerr << "Fail to load " << conf << std::endl;
+            return nullptr;
+        }
+        return config;
+    }
+
+    // the preprocessors, through batch_process as the predictors call them
+    void bench_preprocessors(const Args& args, const std::vector<Inputs>& sets, int threads, int iters, Report* report) {
+        auto seg_config = load_config(args.get("seg_conf", "conf/humanseg.yaml"));
+        auto classify_config = load_config(args.get("classify_conf", "conf/classify.yaml"));
+        auto detection_config = load_config(args.get("detection_conf", "conf/detection_rcnn.yaml"));
+
+        for (const auto& inputs : sets) {
+            const auto& blobs = inputs.blobs;
+            int n = blobs.size();
+            double input_bytes = 0;
+            for (const auto& im : inputs.mats) {
+                input_bytes += static_cast<double>(im.total()) * im.elemSize();
+            }
+            Result result;
+            result.suite = "preprocessor";
+            result.input = inputs.kind;
+            result.width = inputs.width;
+            result.height = inputs.height;
+            result.threads = threads;
+            result.images = static_cast<int64_t>(n) * iters;
+            result.max_err = -1;
+            std::vector<int> ori_w(n);
+            std::vector<int> ori_h(n);
+
+            if (seg_config != nullptr) {
+                PaddleSolution::SegPreProcessor seg;
+                seg.init(seg_config);
+                size_t size = seg_config->_channels * seg_config->_resize[0] * seg_config->_resize[1];
+                std::vector<float> data(size * n);
+                result.name = "SegPreProcessor";
+                result.seconds = time_it(iters, [&]() {
+                    seg.batch_process(blobs, data.data(), ori_w.data(), ori_h.data());
+                });
+                result.bytes = (input_bytes + data.size() * sizeof(float)) * iters;
+                report->add(result);
+            }
+            if (classify_config != nullptr) {
+                PaddleSolution::ClassifyPreProcessor classify;
+                classify.init(classify_config);
+                size_t size = classify_config->_channels * classify_config->_resize[0] * classify_config->_resize[1];
+                std::vector<float> data(size * n);
+                result.name = "ClassifyPreProcessor";
+                result.seconds = time_it(iters, [&]() {
+                    classify.batch_process(blobs, data.data());
+                });
+                result.bytes = (input_bytes + data.size() * sizeof(float)) * iters;
+                report->add(result);
+            }
+            if (detection_config != nullptr) {
+                PaddleSolution::DetectionPreProcessor detection;
+                detection.init(detection_config);
+                std::vector<std::vector<float>> data(n);
+                std::vector<int> resize_w(n);
+                std::vector<int> resize_h(n);
+                std::vector<float> scale_ratio(n);
+                result.name = "DetectionPreProcessor";
+                result.seconds = time_it(iters, [&]() {
+                    detection.batch_process(blobs, data, ori_w.data(), ori_h.data(),
+                                            resize_w.data(), resize_h.data(), scale_ratio.data());
+                });
+                double output_bytes = 0;
+                for (const auto& d : data) {
+                    output_bytes += d.size() * sizeof(float);
+                }
+                result.bytes = (input_bytes + output_bytes) * iters;
+                report->add(result);
+            }
+        }
+    }
+
+    // uint8 HWC -> normalized float CHW as in SegPreProcessor
+    void normalize_loop(const cv::Mat& im, const float* mean, const float* scale, float* data) {
+        int rh = im.rows;
+        int rw = im.cols;
+        int channels = im.channels();
+        for (int h = 0; h < rh; ++h) {
+            const uchar* ptr = im.ptr<uchar>(h);
+            int im_index = 0;
+            for (int w = 0; w < rw; ++w) {
+                for (int c = 0; c < channels; ++c) {
+                    int top_index = (c * rh + h) * rw + w;
+                    float pixel = static_cast<float>(ptr[im_index++]);
+                    data[top_index] = (pixel / 255 - mean[c]) / scale[c];
+                }
+            }
+        }
+    }
+
+    // same, through a table of the 256 values of each channel, one plane at a time
+    void normalize_lut(const cv::Mat& im, const float* mean, const float* scale, float* data) {
+        int rh = im.rows;
+        int rw = im.cols;
+        int channels = im.channels();
+        float table[4][256];
+        for (int c = 0; c < channels; ++c) {
+            for (int v = 0; v < 256; ++v) {
+                table[c][v] = (v / 255.0f - mean[c]) / scale[c];
+            }
+        }
+        for (int c = 0; c < channels; ++c) {
+            const float* lut = table[c];
+            for (int h = 0; h < rh; ++h) {
+                const uchar* ptr = im.ptr<uchar>(h) + c;
+                float* out = data + (c * rh + h) * rw;
+                for (int w = 0; w < rw; ++w) {
+                    out[w] = lut[ptr[w * channels]];
+                }
+            }
+        }
+    }
+
+    // same, with cv::split and cv::Mat::convertTo writing into the planes
+    void normalize_opencv(const cv::Mat& im, const float* mean, const float* scale, float* data) {
+        int rh = im.rows;
+        int rw = im.cols;
+        std::vector<cv::Mat> planes;
+        cv::split(im, planes);
+        for (int c = 0; c < im.channels(); ++c) {
+            cv::Mat out(rh, rw, CV_32FC1, data + c * rh * rw);
+            planes[c].convertTo(out, CV_32F, 1 / (255.0 * scale[c]), -mean[c] / scale[c]);
+        }
+    }
+
+    typedef std::function<void(const cv::Mat&, const float*, const float*, float*)> NormalizeKernel;
+
+    // alternative kernels for the resize and normalize steps, one image per task
+    void bench_kernels(const Args& args, const std::vector<Inputs>& sets, int threads, int iters, Report* report) {
+        auto config = load_config(args.get("seg_conf", "conf/humanseg.yaml"));
+        if (config == nullptr) {
+            return;
+        }
+        cv::Size target(config->_resize[0], config->_resize[1]);
+        const float* mean = config->_mean.data();
+        const float* scale = config->_std.data();
+        ThreadPool& pool = ThreadPool::current();
+
+        for (const auto& inputs : sets) {
+            if (inputs.kind == "encoded") {
+                // same pixels as "decoded"
+                continue;
+            }
+            const auto& mats = inputs.mats;
+            int n = mats.size();
+            Result result;
+            result.suite = "kernel";
+            result.input = inputs.kind;
+            result.width = inputs.width;
+            result.height = inputs.height;
+            result.threads = threads;
+            result.images = static_cast<int64_t>(n) * iters;
+            result.max_err = -1;
+            double input_bytes = 0;
+            for (const auto& im : mats) {
+                input_bytes += static_cast<double>(im.total()) * im.elemSize();
+            }
+            double resized_bytes = static_cast<double>(target.area()) * 3 * n;
+
+            // resize
+            std::vector<cv::Mat> resized(n);
+            std::vector<cv::Mat> floats(n);
+            for (int i = 0; i < n; ++i) {
+                mats[i].convertTo(floats[i], CV_32FC3, 1 / 255.0);
+            }
+            struct ResizeKernel {
+                const char* name;
+                bool on_float;
+                int interpolation;
+            };
+            const ResizeKernel resize_kernels[] = {
+                { "resize_linear_u8", false, cv::INTER_LINEAR },
+                { "resize_area_u8", false, cv::INTER_AREA },
+                { "resize_linear_f32", true, cv::INTER_LINEAR },
+            };
+            for (const auto& kernel : resize_kernels) {
+                result.name = kernel.name;
+                result.seconds = time_it(iters, [&]() {
+                    pool.parallel_for(n, [&](int i) {
+                        cv::resize(kernel.on_float ? floats[i] : mats[i], resized[i], target, 0, 0, kernel.interpolation);
+                    });
+                });
+                int element = kernel.on_float ? sizeof(float) : 1;
+                result.bytes = (input_bytes + resized_bytes) * element * iters;
+                report->add(result);
+            }
+
+            // normalize the resized uint8 images
+            for (int i = 0; i < n; ++i) {
+                cv::resize(mats[i], resized[i], target, 0, 0, cv::INTER_LINEAR);
+            }
+            size_t size = 3 * target.area();
+            std::vector<float> reference(size * n);
+            std::vector<float> data(size * n);
+            for (int i = 0; i < n; ++i) {
+                normalize_loop(resized[i], mean, scale, reference.data() + i * size);
+            }
+            const std::pair<const char*, NormalizeKernel> normalize_kernels[] = {
+                { "normalize_loop", normalize_loop },
+                { "normalize_lut", normalize_lut },
+                { "normalize_opencv", normalize_opencv },
+            };
+            result.width = target.width;
+            result.height = target.height;
+            for (const auto& kernel : normalize_kernels) {
+                result.name = kernel.first;
+                result.seconds = time_it(iters, [&]() {
+                    pool.parallel_for(n, [&](int i) {
+                        kernel.second(resized[i], mean, scale, data.data() + i * size);
+                    });
+                });
+                result.bytes = (resized_bytes + data.size() * sizeof(float)) * iters;
+                result.max_err = 0;
+                for (size_t k = 0; k < data.size(); ++k) {
+                    result.max_err = std::max(result.max_err, static_cast<double>(std::fabs(data[k] - reference[k])));
+                }
+                report->add(result);
+            }
+
+            // resize and normalize: cv::resize then the loop, against the fused pass
+            struct FusedKernel {
+                const char* name;
+                bool fused;
+                int interpolation;
+            };
+            const FusedKernel fused_kernels[] = {
+                { "resize_normalize_linear", false, cv::INTER_LINEAR },
+                { "fused_linear", true, cv::INTER_LINEAR },
+                { "resize_normalize_area", false, cv::INTER_AREA },
+                { "fused_area", true, cv::INTER_AREA },
+            };
+            result.width = inputs.width;
+            result.height = inputs.height;
+            cv::Rect roi(0, 0, target.width, target.height);
+            for (const auto& kernel : fused_kernels) {
+                result.name = kernel.name;
+                result.seconds = time_it(iters, [&]() {
+                    pool.parallel_for(n, [&](int i) {
+                        if (kernel.fused) {
+                            PaddleSolution::fused_resize_normalize(mats[i], target, roi, mean, scale, false,
+                                                                   data.data() + i * size, kernel.interpolation);
+                        } else {
+                            cv::resize(mats[i], resized[i], target, 0, 0, kernel.interpolation);
+                            normalize_loop(resized[i], mean, scale, data.data() + i * size);
+                        }
+                    });
+                });
+                result.bytes = (input_bytes + data.size() * sizeof(float)) * iters;
+                if (!kernel.fused) {
+                    reference = data;
+                    result.max_err = -1;
+                } else {
+                    result.max_err = 0;
+                    for (size_t k = 0; k < data.size(); ++k) {
+                        result.max_err = std::max(result.max_err, static_cast<double>(std::fabs(data[k] - reference[k])));
+                    }
+                }
+                report->add(result);
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    Args args(argc, argv);
+    int batch = std::max(1, args.get_int("batch", 8));
+    int iters = std::max(1, args.get_int("iters", 10));
+    auto sets = make_inputs(args, batch);
+    if (sets.empty()) {
+        std::cerr << "Usage: ./preprocess_bench [--sizes=640x480,1280x720] [--threads=1,2,4] [--batch=8] [--iters=10] "
+            "[--image_dir=/path/to/images] [--output=preprocess_bench.jsonl]" << std::endl;
+        return -1;
+    }
+    Report report(args.get("output", "preprocess_bench.jsonl"));
+    for (const auto& item : split(args.get("threads", "1,2,4"), ',')) {
+        int threads = std::max(1, atoi(item.c_str()));
+        // the calling thread works too
+        ThreadPool pool(threads - 1);
+        ThreadPool::set_current(&pool);
+        bench_preprocessors(args, sets, threads, iters, &report);
+        bench_kernels(args, sets, threads, iters, &report);
+        ThreadPool::set_current(nullptr);
+    }
+    return 0;
+}
@@ -0,0 +1,247 @@
+// Check that the batch loop code of this repo stops allocating once warmed up,
+// without Paddle: every case runs a few warm up batches, then the heap
+// allocations of each further batch are counted (operator new is replaced, see
+// utils/alloc_counter.h). Exits with 1 if any of these batches allocated.
+//
+//     ./steady_state_check [--size=1280x720] [--batch=8] [--threads=4]
+//                          [--warmup=5] [--batches=20]
+//                          [--seg_conf=..] [--classify_conf=..] [--tmp_dir=/tmp]
+//
+// Cases:
+//   thread_pool     ThreadPool::parallel_for dispatch
+//   mat_pool        MatPool::acquire of shapes seen before
+//   image_source    ImageSource::next_batch into the blobs of the last batch
+//   seg, classify   batch_process of decoded BGR images with DEPLOY.FUSED_RESIZE,
+//                   which runs no OpenCV kernel. cv::resize, cvtColor and
+//                   imdecode allocate internal buffers on every call, so the
+//                   other preprocessing paths and the detection preprocessor are
+//                   not checked.
+//   classify_native, classify_analysis
+//                   ClassifyPredictor::predict of a batch in either
+//                   PREDICTOR_MODE, the scores printed as to files, with the
+//                   classify config on CPU and DEPLOY.FUSED_RESIZE. Paddle is
+//                   replaced by the fake model of compat/paddle_inference_api.h,
+//                   whose own allocations are not counted.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <yaml-cpp/yaml.h>
+
+#include "utils/alloc_counter.h"
+#include "utils/image_source.h"
+#include "utils/mat_pool.h"
+#include "utils/seg_conf_parser.h"
+#include "utils/thread_pool.h"
+#include "preprocessor/preprocessor_seg.h"
+#include "preprocessor/preprocessor_classify.h"
+#include "predictor/classify_predictor.h"
+
+using PaddleSolution::ImageBlob;
+using PaddleSolution::PaddleSegModelConfigPaser;
+using PaddleSolution::utils::AllocationScope;
+using PaddleSolution::utils::MatPool;
+using PaddleSolution::utils::ThreadPool;
+
+namespace {
+    // --name=value arguments
+    class Args {
+    public:
+        Args(int argc, char** argv) {
+            for (int i = 1; i < argc; ++i) {
+                std::string arg(argv[i]);
+                if (arg.compare(0, 2, "--") != 0) {
+                    continue;
+                }
+                size_t eq = arg.find('=');
+                if (eq == std::string::npos) {
+                    _values[arg.substr(2)] = "1";
+                } else {
+                    _values[arg.substr(2, eq - 2)] = arg.substr(eq + 1);
+                }
+            }
+        }
+
+        std::string get(const std::string& name, const std::string& fallback) const {
+            auto it = _values.find(name);
+            return it != _values.end() ? it->second : fallback;
+        }
+
+        int get_int(const std::string& name, int fallback) const {
+            return atoi(get(name, std::to_string(fallback)).c_str());
+        }
+
+    private:
+        std::map<std::string, std::string> _values;
+    };
+
+    // a photo-like image: smooth noise
+    cv::Mat synthetic_image(int width, int height, int seed) {
+        cv::Mat im(height, width, CV_8UC3);
+        cv::RNG rng(seed);
+        rng.fill(im, cv::RNG::UNIFORM, cv::Scalar::all(0), cv::Scalar::all(256));
+        cv::GaussianBlur(im, im, cv::Size(7, 7), 0);
+        return im;
+    }
+
+    std::shared_ptr<PaddleSegModelConfigPaser> load_config(const std::string& conf) {
+        std::shared_ptr<PaddleSegModelConfigPaser> config(new PaddleSegModelConfigPaser());
+        if (!config->load_config(conf)) {
+            std::cerr << "Fail to load " << conf << std::endl;
+            return nullptr;
+        }
+        // the path without OpenCV kernels
+        config->_fused_resize = 1;
+        return config;
+    }
+
+    // `conf` as the predictor loops are checked: on CPU, without OpenCV kernels
+    // in the preprocessing, in PREDICTOR_MODE `mode` with room for `batch` images
+    bool write_predictor_config(const std::string& conf, const std::string& mode, int batch,
+                                const std::string& output) {
+        YAML::Node config = YAML::LoadFile(conf);
+        YAML::Node deploy = config["DEPLOY"];
+        deploy["USE_GPU"] = 0;
+        deploy["FUSED_RESIZE"] = 1;
+        deploy["PREDICTOR_MODE"] = mode;
+        deploy["BATCH_SIZE"] = std::max(batch, deploy["BATCH_SIZE"].as<int>());
+        std::ofstream out(output);
+        out << config << std::endl;
+        out.close();
+        if (out.fail()) {
+            std::cerr << "Fail to write " << output << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // run `batch` `warmup` times, then `batches` times counting the allocations;
+    // false if any of the counted batches allocated
+    bool check(const std::string& name, int warmup, int batches, const std::function<void()>& batch) {
+        for (int i = 0; i < warmup; ++i) {
+            batch();
+        }
+        uint64_t total = 0;
+        uint64_t most = 0;
+        for (int i = 0; i < batches; ++i) {
+            AllocationScope allocations;
+            batch();
+            uint64_t count = allocations.count();
+            total += count;
+            most = std::max(most, count);
+        }
+        printf("%-18s %6d batches %10llu allocations (%llu at most per batch) %s\n", name.c_str(), batches,
+               static_cast<unsigned long long>(total), static_cast<unsigned long long>(most),
+               total == 0 ? "ok" : "FAILED");
+        fflush(stdout);
+        return total == 0;
+    }
+}
+
+int main(int argc, char** argv) {
+    if (!PaddleSolution::utils::allocation_counter_enabled()) {
+        std::cerr << "Built without PADDLESEG_ALLOC_COUNTER, nothing to check" << std::endl;
+        return 1;
+    }
+    Args args(argc, argv);
+    int width = 0;
+    int height = 0;
+    std::string size = args.get("size", "1280x720");
+    if (sscanf(size.c_str(), "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+        std::cerr << "Bad size: " << size << std::endl;
+        return 1;
+    }
+    int batch = std::max(1, args.get_int("batch", 8));
+    // enough for every worker of the pool to have preprocessed an image
+    int warmup = std::max(1, args.get_int("warmup", 5));
+    int batches = std::max(1, args.get_int("batches", 20));
+    ThreadPool pool(std::max(1, args.get_int("threads", 4)) - 1);
+    ThreadPool::set_current(&pool);
+
+    std::vector<ImageBlob> blobs;
+    for (int i = 0; i < batch; ++i) {
+        blobs.push_back(ImageBlob::from_mat("synthetic_" + std::to_string(i) + ".jpg",
+                                            synthetic_image(width, height, i)));
+    }
+    bool ok = true;
+
+    std::vector<int> touched(batch);
+    ok &= check("thread_pool", warmup, batches, [&]() {
+        pool.parallel_for(batch, [&](int i) {
+            ++touched[i];
+        });
+    });
+
+    // on this thread: the buffers are per thread and a worker that got no
+    // image during the warm up would allocate its own later
+    ok &= check("mat_pool", warmup, batches, [&]() {
+        for (int i = 0; i < batch; ++i) {
+            cv::Mat u8 = MatPool::acquire(height, width, CV_8UC3);
+            cv::Mat f32 = MatPool::acquire(height, width, CV_32FC3);
+        }
+    });
+
+    std::vector<ImageBlob> pulled;
+    ok &= check("image_source", warmup, batches, [&]() {
+        PaddleSolution::BlobImageSource source(blobs);
+        source.next_batch(pulled, batch);
+    });
+
+    std::vector<int> ori_w(batch);
+    std::vector<int> ori_h(batch);
+    auto seg_config = load_config(args.get("seg_conf", "conf/humanseg.yaml"));
+    if (seg_config == nullptr) {
+        return 1;
+    }
+    PaddleSolution::SegPreProcessor seg;
+    seg.init(seg_config);
+    std::vector<float> seg_data(static_cast<size_t>(batch) * seg_config->_channels
+                                * seg_config->_resize[0] * seg_config->_resize[1]);
+    ok &= check("seg", warmup, batches, [&]() {
+        seg.batch_process(blobs, seg_data.data(), ori_w.data(), ori_h.data());
+    });
+
+    auto classify_config = load_config(args.get("classify_conf", "conf/classify.yaml"));
+    if (classify_config == nullptr) {
+        return 1;
+    }
+    PaddleSolution::ClassifyPreProcessor classify;
+    classify.init(classify_config);
+    std::vector<float> classify_data(static_cast<size_t>(batch) * classify_config->_channels
+                                     * classify_config->_resize[0] * classify_config->_resize[1]);
+    ok &= check("classify", warmup, batches, [&]() {
+        classify.batch_process(blobs, classify_data.data());
+    });
+
+    std::string tmp_dir = args.get("tmp_dir", "/tmp");
+    for (const std::string& mode : std::vector<std::string>({ "NATIVE", "ANALYSIS" })) {
+        std::string conf = tmp_dir + "/steady_state_check_" + mode + ".yaml";
+        if (!write_predictor_config(args.get("classify_conf", "conf/classify.yaml"), mode, batch, conf)) {
+            return 1;
+        }
+        PaddleSolution::ClassifyPredictor predictor;
+        int ret = predictor.init(conf);
+        remove(conf.c_str());
+        if (ret != 0) {
+            return 1;
+        }
+        std::string name = mode == "NATIVE" ? "classify_native" : "classify_analysis";
+        ok &= check(name, warmup, batches, [&]() {
+            PaddleSolution::BlobImageSource source(blobs);
+            predictor.predict(source);
+        });
+    }
+
+    ThreadPool::set_current(nullptr);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,62 @@
+// Stress check of ThreadPool: many short parallel_for calls back to back, so
+// workers still leaving one call overlap the start of the next. Exits with 1
+// if an index of a call ran twice or not at all; a lost index would hang the
+// caller instead, ctest times it out.
+//
+//     ./thread_pool_check [--threads=8] [--calls=200000]
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "utils/thread_pool.h"
+
+using PaddleSolution::utils::ThreadPool;
+
+namespace {
+    int get_int(int argc, char** argv, const std::string& name, int fallback) {
+        std::string prefix = "--" + name + "=";
+        for (int i = 1; i < argc; ++i) {
+            if (strncmp(argv[i], prefix.c_str(), prefix.size()) == 0) {
+                return atoi(argv[i] + prefix.size());
+            }
+        }
+        return fallback;
+    }
+}
+
+int main(int argc, char** argv) {
+    int threads = std::max(2, get_int(argc, argv, "threads", 8));
+    int calls = std::max(1, get_int(argc, argv, "calls", 200000));
+    ThreadPool pool(threads - 1);
+    // fewer indices than workers too, so some of them find nothing to take
+    const int kMaxTasks = 2 * threads;
+    std::vector<std::atomic<int>> runs(kMaxTasks);
+    int64_t wrong = 0;
+    for (int call = 0; call < calls; ++call) {
+        // sizes jumping up and down: a worker late from a small call must not
+        // take an index of a larger one
+        int n = 1 + (call * 7) % kMaxTasks;
+        for (int i = 0; i < n; ++i) {
+            runs[i] = 0;
+        }
+        pool.parallel_for(n, [&](int i) {
+            ++runs[i];
+        });
+        for (int i = 0; i < n; ++i) {
+            if (runs[i] != 1) {
+                ++wrong;
+                std::cerr << "call " << call << ": index " << i << " of " << n << " ran "
+                    << runs[i] << " times" << std::endl;
+            }
+        }
+    }
+    printf("thread_pool    %d calls on %d threads, %lld wrong indices %s\n", calls, threads,
+           static_cast<long long>(wrong), wrong == 0 ? "ok" : "FAILED");
+    return wrong == 0 ? 0 : 1;
+}
@@ -0,0 +1,304 @@
+#include "capi/paddleseg_c_api.h"
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "utils/seg_conf_parser.h"
+#include "predictor/seg_predictor.h"
+#include "predictor/classify_predictor.h"
+#include "predictor/detection_predictor.h"
+
+struct PaddleSegPredictor {
+    PaddleSegModelType type;
+    std::unique_ptr<PaddleSolution::Predictor> seg;
+    std::unique_ptr<PaddleSolution::ClassifyPredictor> classify;
+    std::unique_ptr<PaddleSolution::DetectionPredictor> detection;
+
+    // results of the last paddleseg_predict()
+    std::vector<PaddleSolution::SegResult> seg_results;
+    std::vector<PaddleSolution::ClassifyResult> classify_results;
+    std::vector<PaddleSolution::DetectionResult> detection_results;
+    // 1 for the images of the last paddleseg_predict() that could not be decoded
+    std::vector<char> failed;
+    std::vector<int> failed_positions;
+    std::vector<PaddleSolution::ImageBlob> blobs;
+};
+
+namespace {
+    // keep C++ exceptions from crossing the C boundary
+    template <typename Fn>
+    PaddleSegStatus guarded(const char* function, Fn fn) {
+        try {
+            return fn();
+        } catch (const std::exception& e) {
+            LOG(ERROR) << function << ": " << e.what();
+        } catch (...) {
+            LOG(ERROR) << function << ": unknown exception";
+        }
+        return PADDLESEG_ERROR_INTERNAL;
+    }
+
+    bool valid_index(const PaddleSegPredictor* predictor, int index) {
+        return predictor != nullptr && index >= 0 && index < paddleseg_result_count(predictor);
+    }
+}
+
+extern "C" {
+
+PaddleSegStatus paddleseg_create(const char* config_path, PaddleSegPredictor** predictor) {
+    if (config_path == nullptr || predictor == nullptr) {
+        return PADDLESEG_ERROR_INVALID_ARGUMENT;
+    }
+    *predictor = nullptr;
+    return guarded("paddleseg_create", [&]() {
+        PaddleSolution::PaddleSegModelConfigPaser config;
+        if (!config.load_config(config_path)) {
+            LOG(ERROR) << "Fail to load config file: [" << config_path << "]";
+            return PADDLESEG_ERROR_CONFIG;
+        }
+        std::unique_ptr<PaddleSegPredictor> p(new PaddleSegPredictor());
+        int ret = -1;
+        if (config._pre_processor == "SegPreProcessor") {
+            p->type = PADDLESEG_MODEL_SEG;
+            p->seg.reset(new PaddleSolution::Predictor());
+            ret = p->seg->init(config_path);
+        } else if (config._pre_processor == "ClassifyPreProcessor") {
+            p->type = PADDLESEG_MODEL_CLASSIFY;
+            p->classify.reset(new PaddleSolution::ClassifyPredictor());
+            ret = p->classify->init(config_path);
+        } else if (config._pre_processor == "DetectionPreProcessor") {
+            p->type = PADDLESEG_MODEL_DETECTION;
+            p->detection.reset(new PaddleSolution::DetectionPredictor());
+            ret = p->detection->init(config_path);
+        } else {
+            LOG(ERROR) << "Unknown DEPLOY.PRE_PROCESSOR: " << config._pre_processor;
+            return PADDLESEG_ERROR_CONFIG;
+        }
+        if (ret != 0) {
+            return PADDLESEG_ERROR_INIT;
+        }
+        *predictor = p.release();
+        return PADDLESEG_OK;
+    });
+}
+
+void paddleseg_destroy(PaddleSegPredictor* predictor) {
+    guarded("paddleseg_destroy", [&]() {
+        delete predictor;
+        return PADDLESEG_OK;
+    });
+}
+
+PaddleSegModelType paddleseg_model_type(const PaddleSegPredictor* predictor) {
+    return predictor != nullptr ? predictor->type : PADDLESEG_MODEL_SEG;
+}
+
+PaddleSegStatus paddleseg_predict(PaddleSegPredictor* predictor, const PaddleSegImage* images, int count) {
+    if (predictor == nullptr || count < 0 || (images == nullptr && count > 0)) {
+        return PADDLESEG_ERROR_INVALID_ARGUMENT;
+    }
+    predictor->seg_results.clear();
+    predictor->classify_results.clear();
+    predictor->detection_results.clear();
+    predictor->failed.clear();
+    for (int i = 0; i < count; ++i) {
+        const PaddleSegImage& image = images[i];
+        bool encoded = image.data != nullptr && image.size > 0;
+        bool raw = image.pixels != nullptr && image.width > 0 && image.height > 0
+            && (image.stride == 0 || image.stride >= static_cast<size_t>(image.width) * 3);
+        if (!encoded && !raw) {
+            return PADDLESEG_ERROR_INVALID_ARGUMENT;
+        }
+    }
+    return guarded("paddleseg_predict", [&]() {
+        // the blobs borrow the images of the caller
+        auto& blobs = predictor->blobs;
+        blobs.resize(count);
+        for (int i = 0; i < count; ++i) {
+            const PaddleSegImage& image = images[i];
+            std::string name = image.name != nullptr ? image.name : "image_" + std::to_string(i) + ".jpg";
+            if (image.data != nullptr && image.size > 0) {
+                blobs[i] = PaddleSolution::ImageBlob::from_encoded(name, image.data, image.size);
+            } else {
+                size_t stride = image.stride > 0 ? image.stride : static_cast<size_t>(image.width) * 3;
+                cv::Mat mat(image.height, image.width, CV_8UC3, const_cast<uint8_t*>(image.pixels), stride);
+                blobs[i] = PaddleSolution::ImageBlob::from_mat(name, mat);
+            }
+        }
+        auto& failed_positions = predictor->failed_positions;
+        failed_positions.clear();
+        int ret = -1;
+        switch (predictor->type) {
+        case PADDLESEG_MODEL_SEG:
+            ret = predictor->seg->predict(blobs, &predictor->seg_results, &failed_positions);
+            break;
+        case PADDLESEG_MODEL_CLASSIFY:
+            ret = predictor->classify->predict(blobs, &predictor->classify_results, &failed_positions);
+            break;
+        case PADDLESEG_MODEL_DETECTION:
+            ret = predictor->detection->predict(blobs, &predictor->detection_results, &failed_positions);
+            break;
+        }
+        // drop the borrowed pointers, the caller may release the images
+        blobs.clear();
+        if (ret != 0 || paddleseg_result_count(predictor) != count) {
+            predictor->seg_results.clear();
+            predictor->classify_results.clear();
+            predictor->detection_results.clear();
+            return PADDLESEG_ERROR_PREDICT;
+        }
+        predictor->failed.assign(count, 0);
+        for (int i : failed_positions) {
+            predictor->failed[i] = 1;
+        }
+        return PADDLESEG_OK;
+    });
+}
+
+int paddleseg_result_count(const PaddleSegPredictor* predictor) {
+    if (predictor == nullptr) {
+        return 0;
+    }
+    switch (predictor->type) {
+    case PADDLESEG_MODEL_SEG:
+        return static_cast<int>(predictor->seg_results.size());
+    case PADDLESEG_MODEL_CLASSIFY:
+        return static_cast<int>(predictor->classify_results.size());
+    case PADDLESEG_MODEL_DETECTION:
+        return static_cast<int>(predictor->detection_results.size());
+    }
+    return 0;
+}
+
+PaddleSegStatus paddleseg_result_status(const PaddleSegPredictor* predictor, int index) {
+    if (!valid_index(predictor, index)) {
+        return PADDLESEG_ERROR_INVALID_ARGUMENT;
+    }
+    return predictor->failed[index] ? PADDLESEG_ERROR_IMAGE : PADDLESEG_OK;
+}
+
+PaddleSegStatus paddleseg_get_seg_result(const PaddleSegPredictor* predictor, int index,
+                                         uint8_t* mask, size_t mask_size,
+                                         uint8_t* scoremap, size_t scoremap_size,
+                                         PaddleSegSegInfo* info) {
+    if (predictor != nullptr && predictor->type != PADDLESEG_MODEL_SEG) {
+        return PADDLESEG_ERROR_WRONG_MODEL;
+    }
+    PaddleSegStatus status = paddleseg_result_status(predictor, index);
+    if (status != PADDLESEG_OK) {
+        return status;
+    }
+    const PaddleSolution::SegResult& result = predictor->seg_results[index];
+    if (info != nullptr) {
+        info->width = result.mask.cols;
+        info->height = result.mask.rows;
+        info->ori_width = result.ori_width;
+        info->ori_height = result.ori_height;
+    }
+    size_t size = result.mask.total();
+    if ((mask != nullptr && mask_size < size) || (scoremap != nullptr && scoremap_size < size)) {
+        return PADDLESEG_ERROR_BUFFER_TOO_SMALL;
+    }
+    // the result maps are continuous, cloned by the predictor
+    if (mask != nullptr) {
+        memcpy(mask, result.mask.data, size);
+    }
+    if (scoremap != nullptr) {
+        memcpy(scoremap, result.scoremap.data, size);
+    }
+    return PADDLESEG_OK;
+}
+
+PaddleSegStatus paddleseg_get_classify_result(const PaddleSegPredictor* predictor, int index,
+                                              float* scores, size_t scores_size,
+                                              PaddleSegClassifyInfo* info) {
+    if (predictor != nullptr && predictor->type != PADDLESEG_MODEL_CLASSIFY) {
+        return PADDLESEG_ERROR_WRONG_MODEL;
+    }
+    PaddleSegStatus status = paddleseg_result_status(predictor, index);
+    if (status != PADDLESEG_OK) {
+        return status;
+    }
+    const PaddleSolution::ClassifyResult& result = predictor->classify_results[index];
+    if (info != nullptr) {
+        info->label = result.label;
+        info->score = result.score;
+        info->num_classes = static_cast<int>(result.scores.size());
+        info->top_k_count = std::min(static_cast<int>(result.top_k.size()), PADDLESEG_TOP_K);
+        for (int k = 0; k < info->top_k_count; ++k) {
+            info->top_k[k] = result.top_k[k];
+        }
+    }
+    if (scores != nullptr) {
+        if (scores_size < result.scores.size()) {
+            return PADDLESEG_ERROR_BUFFER_TOO_SMALL;
+        }
+        memcpy(scores, result.scores.data(), result.scores.size() * sizeof(float));
+    }
+    return PADDLESEG_OK;
+}
+
+PaddleSegStatus paddleseg_get_detection_result(const PaddleSegPredictor* predictor, int index,
+                                               PaddleSegBox* boxes, int capacity, int* num_boxes) {
+    if (predictor != nullptr && predictor->type != PADDLESEG_MODEL_DETECTION) {
+        return PADDLESEG_ERROR_WRONG_MODEL;
+    }
+    if (!valid_index(predictor, index) || num_boxes == nullptr) {
+        return PADDLESEG_ERROR_INVALID_ARGUMENT;
+    }
+    if (predictor->failed[index]) {
+        *num_boxes = 0;
+        return PADDLESEG_ERROR_IMAGE;
+    }
+    const PaddleSolution::DetectionResult& result = predictor->detection_results[index];
+    int count = result.detection_boxes_size();
+    *num_boxes = count;
+    if (boxes == nullptr) {
+        return PADDLESEG_OK;
+    }
+    if (capacity < count) {
+        return PADDLESEG_ERROR_BUFFER_TOO_SMALL;
+    }
+    for (int i = 0; i < count; ++i) {
+        const PaddleSolution::DetectionBox& box = result.detection_boxes(i);
+        boxes[i].category = box.class_();
+        boxes[i].score = box.score();
+        boxes[i].left = box.left_top_x();
+        boxes[i].top = box.left_top_y();
+        boxes[i].right = box.right_bottom_x();
+        boxes[i].bottom = box.right_bottom_y();
+    }
+    return PADDLESEG_OK;
+}
+
+const char* paddleseg_status_string(PaddleSegStatus status) {
+    switch (status) {
+    case PADDLESEG_OK:
+        return "ok";
+    case PADDLESEG_ERROR_INVALID_ARGUMENT:
+        return "invalid argument";
+    case PADDLESEG_ERROR_CONFIG:
+        return "bad config";
+    case PADDLESEG_ERROR_INIT:
+        return "fail to create the model";
+    case PADDLESEG_ERROR_PREDICT:
+        return "predict failed";
+    case PADDLESEG_ERROR_BUFFER_TOO_SMALL:
+        return "buffer too small";
+    case PADDLESEG_ERROR_WRONG_MODEL:
+        return "result of another kind of model";
+    case PADDLESEG_ERROR_INTERNAL:
+        return "internal error";
+    case PADDLESEG_ERROR_IMAGE:
+        return "image could not be decoded";
+    }
+    return "unknown status";
+}
+
+}
@@ -0,0 +1,156 @@
+#ifndef PADDLESEG_C_API_H
+#define PADDLESEG_C_API_H
+
+/* C API of the inference pipeline, exported by the shared library
+ * paddleseg_capi (built with -DWITH_CAPI=ON), for embedding it in services
+ * written in other languages.
+ *
+ *     PaddleSegPredictor* predictor = NULL;
+ *     if (paddleseg_create("conf/humanseg.yaml", &predictor) != PADDLESEG_OK) { ... }
+ *     PaddleSegImage image = { "a.jpg", bytes, size, NULL, 0, 0, 0 };
+ *     paddleseg_predict(predictor, &image, 1);
+ *     PaddleSegSegInfo info;
+ *     paddleseg_get_seg_result(predictor, 0, mask, mask_size, NULL, 0, &info);
+ *     paddleseg_destroy(predictor);
+ *
+ * Images are borrowed, not copied; the results of a paddleseg_predict() stay
+ * in the predictor until the next call and are copied once, straight into
+ * the buffers of the caller. A predictor must be used by one thread at a
+ * time; different predictors may run in parallel. No function aborts the
+ * process: errors are returned as PaddleSegStatus and logged to stderr.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#if defined(PADDLESEG_CAPI_BUILD)
+#define PADDLESEG_CAPI __declspec(dllexport)
+#else
+#define PADDLESEG_CAPI __declspec(dllimport)
+#endif
+#else
+#define PADDLESEG_CAPI __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    PADDLESEG_OK = 0,
+    // a null pointer, a negative count or an index past the results
+    PADDLESEG_ERROR_INVALID_ARGUMENT = 1,
+    // the config file cannot be read or has an unsupported value
+    PADDLESEG_ERROR_CONFIG = 2,
+    // the model or the preprocessor cannot be created
+    PADDLESEG_ERROR_INIT = 3,
+    // the batch failed, no result is available
+    PADDLESEG_ERROR_PREDICT = 4,
+    // the buffer of the caller is too small, the info holds the needed sizes
+    PADDLESEG_ERROR_BUFFER_TOO_SMALL = 5,
+    // the result asked for is not the kind of the model
+    PADDLESEG_ERROR_WRONG_MODEL = 6,
+    // an unexpected C++ exception
+    PADDLESEG_ERROR_INTERNAL = 7,
+    // the image could not be decoded, it has no result
+    PADDLESEG_ERROR_IMAGE = 8
+} PaddleSegStatus;
+
+// the kind of model, from DEPLOY.PRE_PROCESSOR
+typedef enum {
+    PADDLESEG_MODEL_SEG = 0,
+    PADDLESEG_MODEL_CLASSIFY = 1,
+    PADDLESEG_MODEL_DETECTION = 2
+} PaddleSegModelType;
+
+/* One input image, either encoded (jpeg, png... `data` and `size`) or raw
+ * 8-bit BGR pixels (`pixels`, `width`, `height` and `stride` in bytes, 0 for
+ * width * 3). `name` names the result, it may be NULL.
+ */
+typedef struct {
+    const char* name;
+    const uint8_t* data;
+    size_t size;
+    const uint8_t* pixels;
+    int width;
+    int height;
+    size_t stride;
+} PaddleSegImage;
+
+typedef struct {
+    // size of the label map and of the score map (EVAL_CROP_SIZE)
+    int width;
+    int height;
+    // size of the input image
+    int ori_width;
+    int ori_height;
+} PaddleSegSegInfo;
+
+#define PADDLESEG_TOP_K 5
+
+typedef struct {
+    int label;
+    float score;
+    int num_classes;
+    // the best classes, best first
+    int top_k[PADDLESEG_TOP_K];
+    int top_k_count;
+} PaddleSegClassifyInfo;
+
+typedef struct {
+    int category;
+    float score;
+    float left;
+    float top;
+    float right;
+    float bottom;
+} PaddleSegBox;
+
+typedef struct PaddleSegPredictor PaddleSegPredictor;
+
+// create a predictor from a yaml config file, *predictor is NULL on error
+PADDLESEG_CAPI PaddleSegStatus paddleseg_create(const char* config_path, PaddleSegPredictor** predictor);
+
+PADDLESEG_CAPI void paddleseg_destroy(PaddleSegPredictor* predictor);
+
+PADDLESEG_CAPI PaddleSegModelType paddleseg_model_type(const PaddleSegPredictor* predictor);
+
+// predict `count` images as batches of up to BATCH_SIZE; the images may be
+// released when it returns
+PADDLESEG_CAPI PaddleSegStatus paddleseg_predict(PaddleSegPredictor* predictor, const PaddleSegImage* images, int count);
+
+// number of results of the last paddleseg_predict()
+PADDLESEG_CAPI int paddleseg_result_count(const PaddleSegPredictor* predictor);
+
+// PADDLESEG_ERROR_IMAGE if image `index` of the last paddleseg_predict() could
+// not be decoded (the batch still succeeds), PADDLESEG_OK if it has a result;
+// the paddleseg_get_*_result() functions return the same for it
+PADDLESEG_CAPI PaddleSegStatus paddleseg_result_status(const PaddleSegPredictor* predictor, int index);
+
+/* Copy the label map of image `index` into `mask` (width * height bytes) and,
+ * if `scoremap` is not NULL, its score map (same size, scores scaled to
+ * [0, 255]). With a NULL `mask` only `info` is filled.
+ */
+PADDLESEG_CAPI PaddleSegStatus paddleseg_get_seg_result(const PaddleSegPredictor* predictor, int index,
+                                                        uint8_t* mask, size_t mask_size,
+                                                        uint8_t* scoremap, size_t scoremap_size,
+                                                        PaddleSegSegInfo* info);
+
+// copy the score of every class into `scores` (num_classes floats) unless it is NULL
+PADDLESEG_CAPI PaddleSegStatus paddleseg_get_classify_result(const PaddleSegPredictor* predictor, int index,
+                                                             float* scores, size_t scores_size,
+                                                             PaddleSegClassifyInfo* info);
+
+// copy the boxes into `boxes` (room for `capacity`), *num_boxes is their count;
+// with a NULL `boxes` only *num_boxes is set
+PADDLESEG_CAPI PaddleSegStatus paddleseg_get_detection_result(const PaddleSegPredictor* predictor, int index,
+                                                              PaddleSegBox* boxes, int capacity, int* num_boxes);
+
+PADDLESEG_CAPI const char* paddleseg_status_string(PaddleSegStatus status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,38 @@
+#include <glog/logging.h>
+#include <utils/utils.h>
+#include <utils/image_source.h>
+#include <predictor/cascade_predictor.h>
+
+DEFINE_string(detection_conf, "", "Configuration File Path of the detection model");
+DEFINE_string(classify_conf, "", "Configuration File Path of the classification model run on every box");
+DEFINE_double(min_score, 0, "Only classify the boxes with a detection score not below this");
+DEFINE_string(input_dir, "", "Directory of Input Images");
+DEFINE_string(input_list, "", "File (or - for stdin) streaming the input images");
+DEFINE_string(input_format, "path", "Format of input_list: path (one path per line), encoded (length-prefixed images), shard (comma separated shard files) or remote (address of a coordinator)");
+
+int main(int argc, char** argv) {
+    // 0. parse args
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    if (FLAGS_detection_conf.empty() || FLAGS_classify_conf.empty()
+        || (FLAGS_input_dir.empty() && FLAGS_input_list.empty())) {
+        std::cout << "Usage: ./cascade_demo --detection_conf=/detection/config --classify_conf=/classify/config "
+            << "--input_dir=/directory/of/your/input/images [--min_score=0.5]";
+        return -1;
+    }
+    // 1. create the cascade and init it with the two configs
+    PaddleSolution::CascadePredictor predictor;
+    if (predictor.init(FLAGS_detection_conf, FLAGS_classify_conf, FLAGS_min_score) != 0) {
+        LOG(FATAL) << "Fail to init predictor";
+        return -1;
+    }
+
+    // 2. open the input images: all the images at input_dir, or streamed from input_list
+    auto source = PaddleSolution::create_image_source(FLAGS_input_dir, FLAGS_input_list, FLAGS_input_format, ".jpeg|.jpg|.JPEG|.JPG");
+    if (source == nullptr) {
+        return -1;
+    }
+
+    // 3. predict
+    predictor.predict(*source);
+    return 0;
+}
@@ -1,28 +1,89 @@
 #include <glog/logging.h>
 #include <utils/utils.h>
+#include <utils/image_source.h>
+#include <utils/read_ahead.h>
+#include <utils/progress_journal.h>
 #include <predictor/classify_predictor.h>
+#include <predictor/model_reloader.h>
+#include <predictor/sharded_predictor.h>
 
 DEFINE_string(conf, "", "Configuration File Path");
 DEFINE_string(input_dir, "", "Directory of Input Images");
+DEFINE_string(input_list, "", "File (or - for stdin) streaming the input images");
+DEFINE_string(input_format, "path", "Format of input_list: path (one path per line), encoded (length-prefixed images), shard (comma separated shard files) or remote (address of a coordinator)");
+DEFINE_bool(hot_reload, false, "Reload the model on SIGHUP or when the config or model files change");
+DEFINE_string(journal, "", "File recording the finished images batch by batch");
+DEFINE_bool(resume, false, "Skip the images the journal lists as finished and continue the journal");
+DEFINE_string(trace, "", "Write a Chrome trace JSON timeline of the pipeline stages to this file (builds with WITH_TRACE)");
 
-int main(int argc, char** argv) {
-    // 0. parse args
-    google::ParseCommandLineFlags(&argc, &argv, true);
-    if (FLAGS_conf.empty() || FLAGS_input_dir.empty()) {
-        std::cout << "Usage: ./predictor --conf=/config/path/to/your/model --input_dir=/directory/of/your/input/images";
-        return -1;
-    }
-    // 1. create a predictor and init it with conf
-    PaddleSolution::ClassifyPredictor predictor;
+template <typename PredictorT>
+int run(PredictorT& predictor) {
+    // 1. init the predictor with conf
     if (predictor.init(FLAGS_conf) != 0) {
         LOG(FATAL) << "Fail to init predictor";
         return -1;
     }
 
-    // 2. get all the images with extension '.jpeg' at input_dir
-    auto imgs = PaddleSolution::utils::get_directory_images(FLAGS_input_dir, ".jpeg|.jpg");
+    // 2. reload the model in the background without stopping the predictions
+    PaddleSolution::ModelReloader<PredictorT> reloader(predictor, FLAGS_conf);
+    if (FLAGS_hot_reload) {
+        reloader.start(true, true);
+    }
+
+    // 3. open the input images: all the images at input_dir, or streamed from input_list
+    auto source = PaddleSolution::create_image_source(FLAGS_input_dir, FLAGS_input_list, FLAGS_input_format, ".jpeg|.jpg");
+    if (source == nullptr) {
+        return -1;
+    }
+    // with DEPLOY.READ_AHEAD the files of the next batches are read while the current one is predicted
+    source = PaddleSolution::create_read_ahead_source(std::move(source), FLAGS_conf);
+    if (source == nullptr) {
+        return -1;
+    }
+
+    // 4. record the finished images, with --resume skip the ones an earlier run finished
+    if (!FLAGS_journal.empty()) {
+        source = PaddleSolution::create_journal_source(std::move(source), FLAGS_journal, FLAGS_resume);
+        if (source == nullptr) {
+            return -1;
+        }
+    }
 
-    // 3. predict
-    predictor.predict(imgs);
+    // 5. predict, with --trace the stages of every image are recorded as a timeline
+    if (!FLAGS_trace.empty()) {
+        PaddleSolution::utils::Tracer::start(FLAGS_trace);
+    }
+    predictor.predict(*source);
+    PaddleSolution::utils::Tracer::stop();
     return 0;
 }
+
+int main(int argc, char** argv) {
+    // 0. parse args
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    if (FLAGS_conf.empty() || (FLAGS_input_dir.empty() && FLAGS_input_list.empty())) {
+        std::cout << "Usage: ./predictor --conf=/config/path/to/your/model --input_dir=/directory/of/your/input/images" << std::endl;
+        std::cout << "   or: ./predictor --conf=/config/path/to/your/model --input_list=/path/to/list/or/- [--input_format=path|encoded|shard|remote]";
+        return -1;
+    }
+    // a single predictor, or a pinned predictor shard per NUMA node or core
+    // group when DEPLOY.SHARDING is set
+    PaddleSolution::PaddleSegModelConfigPaser config;
+    config.load_config(FLAGS_conf);
+    if (FLAGS_input_format == "remote" && (config._read_ahead_batches > 0 || config._sharding_mode != "NONE")) {
+        // both pull images ahead of the batches being predicted
+        LOG(ERROR) << "--input_format=remote does not support DEPLOY.READ_AHEAD nor DEPLOY.SHARDING";
+        return -1;
+    }
+    if (config._sharding_mode != "NONE") {
+        if (!FLAGS_journal.empty()) {
+            // the shards read ahead of the batches they predict
+            LOG(ERROR) << "--journal does not support DEPLOY.SHARDING";
+            return -1;
+        }
+        PaddleSolution::ShardedPredictor<PaddleSolution::ClassifyPredictor> predictor;
+        return run(predictor);
+    }
+    PaddleSolution::ClassifyPredictor predictor;
+    return run(predictor);
+}
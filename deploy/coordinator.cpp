@@ -0,0 +1,39 @@
+#include <glog/logging.h>
+#include <utils/utils.h>
+#include <utils/image_source.h>
+#include <utils/job_coordinator.h>
+
+DEFINE_string(input_dir, "", "Directory of Input Images");
+DEFINE_string(input_list, "", "File (or - for stdin) listing the input images, one path per line");
+DEFINE_string(listen, "", "Address to serve the workers on: unix:/path/to.sock or host:port");
+DEFINE_int32(unit_size, 64, "Number of images in each work unit");
+DEFINE_int32(reserve_units, 4, "Number of consecutive units a worker reserves at a time");
+
+int main(int argc, char** argv) {
+    // 0. parse args
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    if (FLAGS_listen.empty() || (FLAGS_input_dir.empty() && FLAGS_input_list.empty())
+        || FLAGS_unit_size <= 0 || FLAGS_reserve_units <= 0) {
+        std::cout << "Usage: ./coordinator --input_dir=/directory/of/your/input/images --listen=unix:/tmp/job.sock" << std::endl;
+        std::cout << "   or: ./coordinator --input_list=/path/to/list/or/- --listen=:9527 [--unit_size=64] [--reserve_units=4]" << std::endl;
+        std::cout << "then start the workers with: ./seg_demo --conf=/config/path/to/your/model --input_format=remote --input_list=unix:/tmp/job.sock";
+        return -1;
+    }
+    // 1. list the input images, only the paths are needed
+    auto source = PaddleSolution::create_image_source(FLAGS_input_dir, FLAGS_input_list, "path", ".jpeg|.jpg|.JPEG|.JPG|.png|.PNG");
+    if (source == nullptr) {
+        return -1;
+    }
+    std::vector<std::string> imgs;
+    PaddleSolution::ImageBlob blob;
+    while (source->next(blob)) {
+        imgs.push_back(blob.name);
+    }
+
+    // 2. hand them out to the workers until all are done
+    PaddleSolution::JobCoordinator coordinator(FLAGS_unit_size, FLAGS_reserve_units);
+    if (!coordinator.init(imgs, FLAGS_listen)) {
+        return -1;
+    }
+    return coordinator.run();
+}
@@ -16,6 +16,7 @@ ExternalProject_Add(
         -DYAML_CPP_BUILD_CONTRIB=OFF
 		-DMSVC_SHARED_RT=OFF
 		-DBUILD_SHARED_LIBS=OFF
+		-DCMAKE_POSITION_INDEPENDENT_CODE=ON
         -DCMAKE_BUILD_TYPE=${CMAKE_BUILD_TYPE}
         -DCMAKE_CXX_FLAGS=${CMAKE_CXX_FLAGS}
         -DCMAKE_CXX_FLAGS_DEBUG=${CMAKE_CXX_FLAGS_DEBUG}
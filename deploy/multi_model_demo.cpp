@@ -0,0 +1,46 @@
+#include <sstream>
+
+#include <glog/logging.h>
+#include <utils/utils.h>
+#include <utils/image_source.h>
+#include <predictor/model_host.h>
+
+DEFINE_string(host_conf, "", "Configuration File Path listing the models served together");
+DEFINE_string(models, "", "Comma separated names of the models to run, all the models of host_conf when empty");
+DEFINE_string(input_dir, "", "Directory of Input Images");
+DEFINE_string(input_list, "", "File (or - for stdin) streaming the input images");
+DEFINE_string(input_format, "path", "Format of input_list: path (one path per line), encoded (length-prefixed images), shard (comma separated shard files) or remote (address of a coordinator)");
+
+int main(int argc, char** argv) {
+    // 0. parse args
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    if (FLAGS_host_conf.empty() || (FLAGS_input_dir.empty() && FLAGS_input_list.empty())) {
+        std::cout << "Usage: ./multi_model_demo --host_conf=/host/config --input_dir=/directory/of/your/input/images [--models=humanseg,classify]";
+        return -1;
+    }
+    std::vector<std::string> models;
+    std::stringstream ss(FLAGS_models);
+    std::string model;
+    while (std::getline(ss, model, ',')) {
+        if (!model.empty()) {
+            models.push_back(model);
+        }
+    }
+
+    // 1. load all the models of the host config
+    PaddleSolution::MultiModelHost host;
+    if (host.init(FLAGS_host_conf) != 0) {
+        LOG(FATAL) << "Fail to init the models";
+        return -1;
+    }
+
+    // 2. open the input images: all the images at input_dir, or streamed from input_list
+    auto source = PaddleSolution::create_image_source(FLAGS_input_dir, FLAGS_input_list, FLAGS_input_format, ".jpeg|.jpg|.JPEG|.JPG|.png|.PNG");
+    if (source == nullptr) {
+        return -1;
+    }
+
+    // 3. predict, every image is decoded once for all the models
+    host.predict(*source, models);
+    return 0;
+}
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <utils/seg_conf_parser.h>
+#include <utils/image_source.h>
+#include <utils/prediction_result.h>
+#include <predictor/seg_predictor.h>
+#include <predictor/classify_predictor.h>
+#include <predictor/detection_predictor.h>
+
+namespace PaddleSolution {
+
+    /* Non blocking front end of a predictor for services: submit() queues one
+     * image and returns at once, with a future of its result or with a
+     * callback run when it is done.
+     *
+     * An executor thread owns the PredictorT (the Paddle predictors are not
+     * thread safe). It takes the queued images, up to BATCH_SIZE at a time and
+     * without waiting for a batch to fill, and predicts them with
+     * PredictorT::predict(imgs, &results); the preprocessing runs on
+     * ThreadPool::current() of the executor. Failed batches, and images that
+     * cannot be decoded, fail their futures with std::runtime_error and call
+     * their callbacks with -1.
+     * submit() blocks while kMaxQueuedBatches batches are already waiting, so
+     * a fast producer cannot queue unbounded memory.
+     *
+     * Works with Predictor (SegResult), ClassifyPredictor (ClassifyResult) and
+     * DetectionPredictor (DetectionResult), see the typedefs below.
+     */
+    template <typename PredictorT, typename ResultT>
+    class AsyncPredictor {
+    public:
+        // status is 0 on success, -1 if the image could not be predicted
+        typedef std::function<void(int status, const ResultT& result)> Callback;
+
+        // batches waiting besides the running one
+        static const int kMaxQueuedBatches = 4;
+
+        AsyncPredictor() : _batch_size(1), _running(false), _in_flight(0), _stop(false) {
+        }
+
+        ~AsyncPredictor() {
+            stop();
+        }
+
+        // start the executor and init its predictor with `conf`
+        int init(const std::string& conf) {
+            PaddleSegModelConfigPaser config;
+            if (!config.load_config(conf)) {
+                LOG(ERROR) << "Fail to load config file: [" << conf << "]";
+                return -1;
+            }
+            _batch_size = std::max(1, config._batch_size);
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _stop = false;
+            }
+            std::promise<int> inited;
+            std::future<int> init_result = inited.get_future();
+            _executor = std::thread([this, conf, &inited] { run(conf, &inited); });
+            if (init_result.get() != 0) {
+                LOG(ERROR) << "Fail to init the async predictor";
+                stop();
+                return -1;
+            }
+            std::lock_guard<std::mutex> lock(_mutex);
+            _running = true;
+            return 0;
+        }
+
+        // predict `img` in the background. An image borrowed by the blob (`mat`,
+        // `bytes`) must stay valid until the future is ready.
+        std::future<ResultT> submit(const ImageBlob& img) {
+            std::shared_ptr<std::promise<ResultT>> promise = std::make_shared<std::promise<ResultT>>();
+            std::future<ResultT> result = promise->get_future();
+            submit(img, [promise](int status, const ResultT& r) {
+                if (status == 0) {
+                    promise->set_value(r);
+                } else {
+                    promise->set_exception(std::make_exception_ptr(std::runtime_error("predict failed")));
+                }
+            });
+            return result;
+        }
+
+        // predict `img` in the background and call `done` from the executor
+        // thread; keep `done` short, the next batch waits for it, and do not
+        // submit() from it
+        void submit(const ImageBlob& img, Callback done) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _space_cv.wait(lock, [this] {
+                return _stop || static_cast<int>(_queue.size()) < kMaxQueuedBatches * _batch_size;
+            });
+            if (_stop || !_running) {
+                lock.unlock();
+                done(-1, ResultT());
+                return;
+            }
+            _queue.push_back(Task(img, std::move(done)));
+            lock.unlock();
+            _task_cv.notify_one();
+        }
+
+        // images queued or running
+        int pending() {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return static_cast<int>(_queue.size()) + _in_flight;
+        }
+
+        // predict what is queued, then stop the executor
+        void stop() {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _stop = true;
+            }
+            _task_cv.notify_all();
+            _space_cv.notify_all();
+            if (_executor.joinable()) {
+                _executor.join();
+            }
+            std::lock_guard<std::mutex> lock(_mutex);
+            _running = false;
+        }
+
+    private:
+        struct Task {
+            Task(const ImageBlob& img_, Callback done_) : img(img_), done(std::move(done_)) {
+            }
+
+            ImageBlob img;
+            Callback done;
+        };
+
+        void run(const std::string& conf, std::promise<int>* inited) {
+            std::unique_ptr<PredictorT> predictor(new PredictorT());
+            int ret = -1;
+            try {
+                ret = predictor->init(conf);
+            } catch (const std::exception& e) {
+                LOG(ERROR) << "Fail to init the async predictor: " << e.what();
+            }
+            inited->set_value(ret);
+            if (ret != 0) {
+                return;
+            }
+
+            std::vector<Task> batch;
+            std::vector<ImageBlob> imgs;
+            std::vector<ResultT> results;
+            // positions in `imgs` of the images that failed to decode
+            std::vector<int> failed_images;
+            const ResultT failed;
+            while (true) {
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _in_flight = 0;
+                    _task_cv.wait(lock, [this] { return _stop || !_queue.empty(); });
+                    if (_queue.empty()) {
+                        break;
+                    }
+                    int n = std::min(static_cast<int>(_queue.size()), _batch_size);
+                    batch.clear();
+                    for (int i = 0; i < n; ++i) {
+                        batch.push_back(std::move(_queue.front()));
+                        _queue.pop_front();
+                    }
+                    _in_flight = n;
+                }
+                _space_cv.notify_all();
+
+                imgs.clear();
+                for (const auto& task : batch) {
+                    imgs.push_back(task.img);
+                }
+                results.clear();
+                failed_images.clear();
+                int status = -1;
+                try {
+                    status = predictor->predict(imgs, &results, &failed_images);
+                } catch (const std::exception& e) {
+                    LOG(ERROR) << "Async predict failed: " << e.what();
+                }
+                if (status == 0 && results.size() != batch.size()) {
+                    LOG(ERROR) << "Async predict returned " << results.size() << " results for "
+                        << batch.size() << " images";
+                    status = -1;
+                }
+                size_t f = 0;
+                for (size_t i = 0; i < batch.size(); ++i) {
+                    int image_status = status;
+                    if (f < failed_images.size() && failed_images[f] == static_cast<int>(i)) {
+                        image_status = -1;
+                        ++f;
+                    }
+                    try {
+                        batch[i].done(image_status, image_status == 0 ? results[i] : failed);
+                    } catch (const std::exception& e) {
+                        LOG(ERROR) << "Async predict callback failed: " << e.what();
+                    }
+                }
+            }
+        }
+
+        int _batch_size;
+        bool _running;
+        std::thread _executor;
+        std::mutex _mutex;
+        // signaled when a task is queued or on stop
+        std::condition_variable _task_cv;
+        // signaled when the queue has room again
+        std::condition_variable _space_cv;
+        std::deque<Task> _queue;
+        // images of the running batch, guarded by `_mutex` like `_running` and `_stop`
+        int _in_flight;
+        bool _stop;
+    };
+
+    typedef AsyncPredictor<Predictor, SegResult> AsyncSegPredictor;
+    typedef AsyncPredictor<ClassifyPredictor, ClassifyResult> AsyncClassifyPredictor;
+    typedef AsyncPredictor<DetectionPredictor, DetectionResult> AsyncDetectionPredictor;
+}
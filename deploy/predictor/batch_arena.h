@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+
+#include <paddle_inference_api.h>
+
+#include <utils/resident_memory.h>
+
+namespace PaddleSolution {
+    /* Per-batch scratch of the predict loops, owned by the predictor and reused
+     * by every batch. The vectors are only cleared or resized, which keeps their
+     * capacity, so once the largest batch has gone through, the loops stop
+     * allocating for their own bookkeeping.
+     */
+    struct BatchArena {
+        // make room for `batch_size` images up front
+        void reserve(int batch_size) {
+            ori_widths.reserve(batch_size);
+            ori_heights.reserve(batch_size);
+            resize_widths.reserve(batch_size);
+            resize_heights.reserve(batch_size);
+            scale_ratios.reserve(batch_size);
+            image_infos.reserve(batch_size * 3);
+            image_size.reserve(batch_size * 2);
+            image_size_f.reserve(batch_size * 3);
+            if (lod_buffer.size() < batch_size) {
+                lod_buffer.resize(batch_size);
+            }
+            feeds.reserve(3);
+        }
+
+        // size of the input images, and of the images fed after resizing
+        std::vector<int> ori_widths;
+        std::vector<int> ori_heights;
+        std::vector<int> resize_widths;
+        std::vector<int> resize_heights;
+        std::vector<float> scale_ratios;
+        // detection side inputs: im_info and im_size (int32 or float)
+        std::vector<float> image_infos;
+        std::vector<int> image_size;
+        std::vector<float> image_size_f;
+        // preprocessed images of variable size, only grows so the buffers of
+        // the images past the current batch size are kept
+        std::vector<std::vector<float>> lod_buffer;
+        std::vector<paddle::PaddleTensor> feeds;
+        // input staged for a zero copy tensor
+        paddle::PaddleTensor input;
+        // output copied out of the zero copy tensor, placed as DEPLOY.MEMORY says
+        utils::ResidentVector<float> out_data;
+    };
+}
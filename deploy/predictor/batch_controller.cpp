@@ -0,0 +1,144 @@
+#include "batch_controller.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include <glog/logging.h>
+
+namespace PaddleSolution {
+
+    namespace {
+        // the size grows only while the p99 stays under this share of the SLO
+        const double kHeadroom = 0.9;
+        const double kPercentile = 0.99;
+
+        double elapsed_ms(std::chrono::steady_clock::time_point since) {
+            return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - since).count() / 1000.0;
+        }
+    }
+
+    BatchSizeController::BatchSizeController()
+        : _enabled(false), _slo_ms(0), _min_size(1), _window(1), _output(nullptr), _size(0), _max_size(0), _batches(0),
+          _preprocess_ms(0), _run_ms(0), _window_images(0) {
+    }
+
+    BatchSizeController::~BatchSizeController() {
+        if (_output != nullptr) {
+            fclose(_output);
+        }
+    }
+
+    void BatchSizeController::init(const PaddleSegModelConfigPaser& config) {
+        _enabled = config._adaptive_batch != 0 && config._adaptive_batch_slo_ms > 0;
+        _slo_ms = config._adaptive_batch_slo_ms;
+        _min_size = std::max(1, config._adaptive_batch_min_size);
+        _window = std::max(1, config._adaptive_batch_window);
+        _size = 0;
+        _batches = 0;
+        _latencies.clear();
+        _latencies.reserve(_window);
+        // opened at the first decision, a model built for a reload only warms up;
+        // kept open over a reload to the same file
+        std::string output = _enabled ? config._adaptive_batch_output : std::string();
+        if (_output != nullptr && output != _output_path) {
+            fclose(_output);
+            _output = nullptr;
+        }
+        _output_path = output;
+    }
+
+    int BatchSizeController::batch_size(int max_size) {
+        if (!_enabled) {
+            return max_size;
+        }
+        _max_size = max_size;
+        int size = _size == 0 ? max_size : std::min(_size, max_size);
+        size = std::max(std::min(_min_size, max_size), size);
+        if (size != _size) {
+            // a new size (or a lower cap) starts a new window
+            _size = size;
+            _latencies.clear();
+        }
+        return _size;
+    }
+
+    void BatchSizeController::start() {
+        if (!_enabled) {
+            return;
+        }
+        _start = std::chrono::steady_clock::now();
+        if (_latencies.empty()) {
+            _window_start = _start;
+            _window_images = 0;
+            _preprocess_ms = 0;
+            _run_ms = 0;
+        }
+    }
+
+    void BatchSizeController::observe(int images, int64_t run_us) {
+        if (!_enabled) {
+            return;
+        }
+        ++_batches;
+        if (images < _size) {
+            return;
+        }
+        double latency = elapsed_ms(_start);
+        double run_ms = run_us / 1000.0;
+        _latencies.push_back(latency);
+        _preprocess_ms += std::max(0.0, latency - run_ms);
+        _run_ms += run_ms;
+        _window_images += images;
+        // decide on full windows only, the p99 of a partial one is not meaningful
+        if (static_cast<int>(_latencies.size()) < _window) {
+            return;
+        }
+        double p99 = window_p99();
+        if (p99 > _slo_ms) {
+            decide(std::max(_min_size, _size / 2), "over_slo", p99);
+        } else if (p99 < _slo_ms * kHeadroom && _size < _max_size) {
+            decide(_size + 1, "headroom", p99);
+        } else {
+            decide(_size, "hold", p99);
+        }
+    }
+
+    // the slowest batch for a window of less than 100 batches
+    double BatchSizeController::window_p99() const {
+        std::vector<double> sorted(_latencies);
+        std::sort(sorted.begin(), sorted.end());
+        return sorted[std::min(sorted.size() - 1, static_cast<std::size_t>(sorted.size() * kPercentile))];
+    }
+
+    void BatchSizeController::decide(int size, const char* reason, double p99) {
+        int batches = static_cast<int>(_latencies.size());
+        double preprocess_ms = _preprocess_ms / batches;
+        double run_ms = _run_ms / batches;
+        double seconds = elapsed_ms(_window_start) / 1000.0;
+        double images_per_s = seconds > 0 ? _window_images / seconds : 0;
+
+        std::cout << "adaptive batch: " << _size << " -> " << size << " (" << reason << ")"
+            << ", p99 = " << p99 << " ms (slo " << _slo_ms << " ms)"
+            << ", preprocess = " << preprocess_ms << " ms, inference = " << run_ms << " ms"
+            << ", " << images_per_s << " images/s" << std::endl;
+        if (_output == nullptr && !_output_path.empty()) {
+            _output = fopen(_output_path.c_str(), "w");
+            if (_output == nullptr) {
+                LOG(ERROR) << "Fail to open the adaptive batch output: " << _output_path;
+                _output_path.clear();
+            }
+        }
+        if (_output != nullptr) {
+            fprintf(_output, "{\"batch\": %lld, \"from\": %d, \"to\": %d, \"reason\": \"%s\", \"batches\": %d, "
+                "\"p99_ms\": %.3f, \"slo_ms\": %.3f, \"preprocess_ms\": %.3f, \"inference_ms\": %.3f, "
+                "\"images_per_s\": %.2f}\n",
+                static_cast<long long>(_batches), _size, size, reason, batches,
+                p99, _slo_ms, preprocess_ms, run_ms, images_per_s);
+            fflush(_output);
+        }
+        // the window restarts, at the new size or at the same one
+        _size = size;
+        _latencies.clear();
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <utils/seg_conf_parser.h>
+
+namespace PaddleSolution {
+    /* DEPLOY.ADAPTIVE_BATCH: picks the batch size of the predict loops online,
+     * the largest one (for throughput) whose p99 batch latency, preprocessing
+     * plus inference, stays under LATENCY_SLO_MS.
+     *
+     * AIMD: the size starts at BATCH_SIZE and is decided once per full WINDOW
+     * of batches: halved (down to MIN_BATCH_SIZE) when the p99 of the window
+     * is over the SLO, grown by one when it is under 90% of the SLO. With a
+     * WINDOW under 100 the p99 is the slowest batch of the window, so a
+     * single batch over the SLO halves the size. Only batches of the full
+     * current size are measured, the last short batch of an input or one cut
+     * by DEPLOY.MEMORY_BUDGET_MB is not. Every decision is printed with the
+     * p99, the mean preprocess and inference times and the throughput of its
+     * window, and appended to OUTPUT as a JSON line.
+     */
+    class BatchSizeController {
+    public:
+        BatchSizeController();
+        ~BatchSizeController();
+
+        void init(const PaddleSegModelConfigPaser& config);
+
+        // images to pull for the next batch, at most `max_size`
+        int batch_size(int max_size);
+
+        // call when a batch starts, before it is preprocessed
+        void start();
+        // call once the batch of `images` ran, `run_us` being the inference time
+        void observe(int images, int64_t run_us);
+
+    private:
+        BatchSizeController(const BatchSizeController&);
+        BatchSizeController& operator=(const BatchSizeController&);
+
+        double window_p99() const;
+        void decide(int size, const char* reason, double p99);
+
+        bool _enabled;
+        double _slo_ms;
+        int _min_size;
+        int _window;
+        std::string _output_path;
+        std::FILE* _output;
+
+        // current size, 0 until the first batch_size() call, and its upper bound
+        int _size;
+        int _max_size;
+        int64_t _batches;
+        std::chrono::steady_clock::time_point _start;
+        // latencies of the batches of the current window, in ms
+        std::vector<double> _latencies;
+        double _preprocess_ms;
+        double _run_ms;
+        int64_t _window_images;
+        std::chrono::steady_clock::time_point _window_start;
+    };
+}
@@ -0,0 +1,154 @@
+#include "cascade_predictor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+
+#include <glog/logging.h>
+
+#include <utils/thread_pool.h>
+#include <preprocessor/preprocessor.h>
+
+namespace PaddleSolution {
+
+    int CascadePredictor::init(const std::string& detection_conf, const std::string& classify_conf, float min_score) {
+        PaddleSegModelConfigPaser config;
+        if (!config.load_config(detection_conf)) {
+            LOG(ERROR) << "Fail to load config file: [" << detection_conf << "]";
+            return -1;
+        }
+        _batch_size = std::max(1, config._batch_size);
+        _min_score = min_score;
+        if (_detector.init(detection_conf) != 0) {
+            LOG(ERROR) << "Fail to init the detection model: [" << detection_conf << "]";
+            return -1;
+        }
+        if (_classifier.init(classify_conf) != 0) {
+            LOG(ERROR) << "Fail to init the classification model: [" << classify_conf << "]";
+            return -1;
+        }
+        return 0;
+    }
+
+    int CascadePredictor::predict(const std::vector<ImageBlob>& imgs, std::vector<CascadeResult>* results) {
+        BlobImageSource source(imgs);
+        return predict(source, results);
+    }
+
+    int CascadePredictor::predict(ImageSource& source, std::vector<CascadeResult>* results) {
+        std::vector<CascadeResult> batch_results;
+        while (source.next_batch(_imgs_batch, _batch_size) > 0) {
+            batch_results.clear();
+            if (predict_batch(_imgs_batch, &batch_results) != 0) {
+                return -1;
+            }
+            for (auto& result : batch_results) {
+                if (results != nullptr) {
+                    results->push_back(std::move(result));
+                } else {
+                    output_result(result);
+                }
+            }
+            source.done(_imgs_batch.size(), std::vector<int>());
+        }
+        return 0;
+    }
+
+    int CascadePredictor::predict_batch(const std::vector<ImageBlob>& imgs, std::vector<CascadeResult>* results) {
+        // 1. decode every image once, both models borrow the decoded image
+        _decoded.resize(imgs.size());
+        std::atomic<bool> decoded(true);
+        utils::ThreadPool::current().parallel_for(imgs.size(), [&](int i) {
+            cv::Mat im = ImagePreProcessor::read_image(imgs[i], cv::IMREAD_COLOR);
+            if (im.empty()) {
+                LOG(ERROR) << "Failed to open image: " << imgs[i].name;
+                decoded = false;
+            }
+            _decoded[i] = ImageBlob::from_mat(imgs[i].name, im);
+        });
+        if (!decoded) {
+            return -1;
+        }
+
+        // 2. detection
+        _detections.clear();
+        if (_detector.predict(_decoded, &_detections) != 0 || _detections.size() != imgs.size()) {
+            LOG(ERROR) << "Fail to run the detection model";
+            return -1;
+        }
+
+        // 3. crop the boxes of all the images, views into the decoded images
+        _crops.clear();
+        _crop_boxes.clear();
+        for (int i = 0; i < _detections.size(); ++i) {
+            const cv::Mat& im = _decoded[i].mat;
+            const auto& detection = _detections[i];
+            for (int j = 0; j < detection.detection_boxes_size(); ++j) {
+                const auto& box = detection.detection_boxes(j);
+                if (box.score() < _min_score) {
+                    continue;
+                }
+                int x1 = std::max(0, static_cast<int>(std::floor(box.left_top_x())));
+                int y1 = std::max(0, static_cast<int>(std::floor(box.left_top_y())));
+                int x2 = std::min(im.cols, static_cast<int>(std::ceil(box.right_bottom_x())));
+                int y2 = std::min(im.rows, static_cast<int>(std::ceil(box.right_bottom_y())));
+                if (x2 <= x1 || y2 <= y1) {
+                    continue;
+                }
+                cv::Mat crop(im, cv::Rect(x1, y1, x2 - x1, y2 - y1));
+                _crops.push_back(ImageBlob::from_mat(imgs[i].name + "_box_" + std::to_string(j), crop));
+                _crop_boxes.push_back(std::make_pair(i, j));
+            }
+        }
+
+        // 4. classify all the crops, the classifier batches them by its BATCH_SIZE
+        _classes.clear();
+        if (!_crops.empty()
+            && (_classifier.predict(_crops, &_classes) != 0 || _classes.size() != _crops.size())) {
+            LOG(ERROR) << "Fail to run the classification model";
+            return -1;
+        }
+
+        // 5. attach the classes to their boxes
+        int first = results->size();
+        for (int i = 0; i < _detections.size(); ++i) {
+            CascadeResult result;
+            result.box_classes.resize(_detections[i].detection_boxes_size());
+            for (auto& box_class : result.box_classes) {
+                box_class.label = -1;
+            }
+            result.detection.Swap(&_detections[i]);
+            results->push_back(std::move(result));
+        }
+        for (int k = 0; k < _crop_boxes.size(); ++k) {
+            auto& result = (*results)[first + _crop_boxes[k].first];
+            result.box_classes[_crop_boxes[k].second] = std::move(_classes[k]);
+        }
+        // release the decoded images, the results do not refer to them
+        for (auto& blob : _decoded) {
+            blob.mat.release();
+        }
+        _crops.clear();
+        return 0;
+    }
+
+    void CascadePredictor::output_result(const CascadeResult& result) {
+        const auto& detection = result.detection;
+        std::cout << detection.filename() << ":" << std::endl;
+        std::ofstream text(detection.filename() + ".txt", std::ios::out | std::ios::trunc);
+        for (int j = 0; j < detection.detection_boxes_size(); ++j) {
+            const auto& box = detection.detection_boxes(j);
+            const auto& box_class = result.box_classes[j];
+            printf("Class %d, score = %f, left top = [%f, %f], right bottom = [%f, %f], label %d, label score = %f\n",
+                   box.class_(), box.score(), box.left_top_x(), box.left_top_y(),
+                   box.right_bottom_x(), box.right_bottom_y(), box_class.label, box_class.score);
+            text << box.class_() << " " << box.score() << " " << box.left_top_x() << " " << box.left_top_y() << " "
+                 << box.right_bottom_x() << " " << box.right_bottom_y() << " "
+                 << box_class.label << " " << box_class.score << std::endl;
+        }
+        printf("\n");
+        std::ofstream output(detection.filename() + ".pb", std::ios::out | std::ios::trunc | std::ios::binary);
+        detection.SerializeToOstream(&output);
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include <utils/image_source.h>
+#include <utils/prediction_result.h>
+#include <predictor/detection_predictor.h>
+#include <predictor/classify_predictor.h>
+
+namespace PaddleSolution {
+    /* Detection followed by classification of every detected box, in memory:
+     * each image is decoded once, the detection model runs on the decoded image,
+     * the boxes are cropped as views of it (no copy) and the crops of all the
+     * images of a batch go to the classification model together.
+     */
+    class CascadePredictor {
+    public:
+        CascadePredictor() : _batch_size(1), _min_score(0) {
+        }
+        // init the two models, boxes scoring below `min_score` are not classified
+        int init(const std::string& detection_conf, const std::string& classify_conf, float min_score = 0);
+        // predict the images of `source`, batch by batch of the detection BATCH_SIZE.
+        // With `results` null, the boxes are printed and each image gets
+        // `<name>.pb` (the detection result, as detection_demo) and `<name>.txt`
+        // (one line per box: class score x1 y1 x2 y2 label label_score)
+        int predict(ImageSource& source, std::vector<CascadeResult>* results = nullptr);
+        int predict(const std::vector<ImageBlob>& imgs, std::vector<CascadeResult>* results);
+
+    private:
+        int predict_batch(const std::vector<ImageBlob>& imgs, std::vector<CascadeResult>* results);
+        void output_result(const CascadeResult& result);
+
+        DetectionPredictor _detector;
+        ClassifyPredictor _classifier;
+        int _batch_size;
+        float _min_score;
+
+        // decoded images of the current batch, the crops point into them
+        std::vector<ImageBlob> _decoded;
+        std::vector<ImageBlob> _crops;
+        // (image, box) of every crop
+        std::vector<std::pair<int, int>> _crop_boxes;
+        std::vector<DetectionResult> _detections;
+        std::vector<ClassifyResult> _classes;
+        std::vector<ImageBlob> _imgs_batch;
+    };
+}
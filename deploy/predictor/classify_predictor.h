@@ -1,6 +1,8 @@
 #pragma once
 
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <thread>
@@ -13,26 +15,105 @@
 
 #include <utils/seg_conf_parser.h>
 #include <utils/utils.h>
+#include <utils/metrics.h>
+#include <utils/trace.h>
+#include <utils/image_source.h>
+#include <utils/prediction_result.h>
 #include <preprocessor/preprocessor.h>
+#include <predictor/quantizer.h>
+#include <predictor/batch_arena.h>
+#include <predictor/result_cache.h>
+#include <predictor/op_profiler.h>
+#include <predictor/memory_planner.h>
+#include <predictor/batch_controller.h>
 
 namespace PaddleSolution {
+    // print the scores of every class and the top one of an image
+    void print_classify_result(const ClassifyResult& result);
+    // the same straight from the `class_num` scores of the model output
+    void print_classify_scores(const std::string& name, const float* scores, int class_num);
+
     class ClassifyPredictor {
     public:
+        ClassifyPredictor() : _cpu_math_threads(0), _has_reloaded(false) {
+        }
+        ~ClassifyPredictor();
         // init a predictor with a yaml config file
         int init(const std::string& conf);
+        // number of MKL / OpenMP threads of the model on CPU, set before init;
+        // 0 keeps the Paddle default
+        void set_cpu_math_threads(int num_threads) {
+            _cpu_math_threads = num_threads;
+        }
+        // build a new predictor from `conf` (its MODEL_PATH may hold an updated model)
+        // in the calling thread and warm it up; the running predict switches to it
+        // at the next batch and the old model is released. Returns -1 and keeps the
+        // current model if the new one fails to load.
+        int reload(const std::string& conf);
         // predict api
         int predict(const std::vector<std::string>& imgs);
+        // predict the images pulled batch by batch from an input source
+        int predict(ImageSource& source);
+        // predict images held in memory (encoded bytes or decoded cv::Mat), the
+        // results are appended to `results` in input order instead of written to files
+        // (one per input: -1 is returned if a batch fails to run). An image that cannot
+        // be decoded gets an empty result, only named (no scores); `failed`, if
+        // given, gets their positions in `imgs`. An ImageSource is told through done().
+        int predict(const std::vector<ImageBlob>& imgs, std::vector<ClassifyResult>* results,
+                    std::vector<int>* failed = nullptr);
+        int predict(const std::vector<cv::Mat>& imgs, std::vector<ClassifyResult>* results,
+                    std::vector<int>* failed = nullptr);
+        int predict(ImageSource& source, std::vector<ClassifyResult>* results);
+        // preprocess `imgs` into one batch of input tensors that own their data,
+        // used as the warmup data of the INT8 quantizer (see quantize_tool)
+        int make_warmup_data(const std::vector<ImageBlob>& imgs, std::vector<paddle::PaddleTensor>* feeds);
+        // hits and misses of DEPLOY.RESULT_CACHE, all 0 when it is disabled
+        ResultCacheStats result_cache_stats() const {
+            return _result_cache != nullptr ? _result_cache->stats() : ResultCacheStats();
+        }
 
     private:
-        int native_predict(const std::vector<std::string>& imgs);
-        int analysis_predict(const std::vector<std::string>& imgs);
+        // predict without looking at the result cache
+        int predict_uncached(ImageSource& source, std::vector<ClassifyResult>* results);
+        // returned by the two loops below when they stop to switch to a reloaded model
+        static const int kReloaded = 1;
+        int native_predict(ImageSource& source, std::vector<ClassifyResult>* results);
+        int analysis_predict(ImageSource& source, std::vector<ClassifyResult>* results);
+        // preprocess a batch into the float or uint8 input buffer, as DEPLOY.INPUT_DTYPE
+        // says; `tensor` gets the shape, dtype and data borrowed from that buffer
+        bool fill_input(const std::vector<ImageBlob>& imgs, paddle::PaddleTensor* tensor);
+        // take over the model built by reload() if any, return true when switched
+        bool swap_reloaded_model();
+        // a paddle predictor of the model in `_model_config`, null if it cannot be
+        // built; `profile` turns on the Paddle operator profiler (DEPLOY.PROFILE)
+        std::unique_ptr<paddle::PaddlePredictor> create_paddle_predictor(bool profile);
     private:
-        std::vector<float> _buffer;
-        std::vector<std::string> _imgs_batch;
+        // batch input, placed as DEPLOY.MEMORY says
+        utils::ResidentVector<float> _buffer;
+        utils::ResidentVector<uint8_t> _u8_buffer;
+        BatchArena _arena;
+        std::vector<ImageBlob> _imgs_batch;
+        // positions in the batch of the images that failed to preprocess
+        std::vector<int> _failed_images;
         std::vector<paddle::PaddleTensor> _outputs;
 
         PaddleSolution::PaddleSegModelConfigPaser _model_config;
         std::shared_ptr<PaddleSolution::ImagePreProcessor> _preprocessor;
         std::unique_ptr<paddle::PaddlePredictor> _main_predictor;
+        // DEPLOY.RESULT_CACHE, null when disabled
+        std::shared_ptr<ResultCache<ClassifyResult>> _result_cache;
+
+        int _cpu_math_threads;
+        // DEPLOY.PROFILE window
+        OpProfiler _op_profiler;
+        // DEPLOY.MEMORY_BUDGET_MB
+        MemoryPlanner _memory_planner;
+        // DEPLOY.ADAPTIVE_BATCH
+        BatchSizeController _batch_controller;
+
+        // predictor built by reload(), waiting to be switched in
+        std::mutex _reload_mutex;
+        std::unique_ptr<ClassifyPredictor> _reloaded;
+        std::atomic<bool> _has_reloaded;
     };
 }
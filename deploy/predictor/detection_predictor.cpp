@@ -1,16 +1,19 @@
 #include "detection_predictor.h"
+#include <algorithm>
 #include <cstring>
 #include <cmath>
 #include <fstream>
 #include "utils/detection_result.pb.h"
 
 namespace PaddleSolution {
-    /* lod_buffer: every item in lod_buffer is an image matrix after preprocessing
+    /* lod_buffer: every item in lod_buffer is an image matrix after preprocessing, only the
+     * first resize_heights.size() items are used
      * input_buffer: same data with lod_buffer after flattening to 1-D vector and padding, needed to be empty before using this function
      */
-    void padding_minibatch(const std::vector<std::vector<float>> &lod_buffer, std::vector<float> &input_buffer, 
+    void padding_minibatch(const std::vector<std::vector<float>> &lod_buffer, utils::ResidentVector<float> &input_buffer, 
                            std::vector<int> &resize_heights, std::vector<int> &resize_widths, int channels, int coarsest_stride = 1) {
-        int batch_size = lod_buffer.size();
+        PADDLESEG_TRACE_SPAN("padding");
+        int batch_size = resize_heights.size();
         int max_h = -1;
         int max_w = -1;
         for(int i = 0; i < batch_size; ++i) {
@@ -22,7 +25,7 @@ namespace PaddleSolution {
         std::cout << "max_w: " << max_w << " max_h: " << max_h << std::endl;
         input_buffer.insert(input_buffer.end(), batch_size * channels * max_h * max_w, 0);
         // flatten tensor and padding
-        for(int i = 0; i < lod_buffer.size(); ++i) {
+        for(int i = 0; i < batch_size; ++i) {
             float *input_buffer_ptr = input_buffer.data() + i * channels * max_h * max_w;
             const float *lod_ptr = lod_buffer[i].data();
             for(int c = 0; c < channels; ++c) {
@@ -41,11 +44,41 @@ namespace PaddleSolution {
         }
     }
 
-    void output_detection_result(const float* out_addr, const std::vector<std::vector<size_t>> &lod_vector, const std::vector<std::string> &imgs_batch){
+    void save_detection_result(const DetectionResult& result) {
+        PADDLESEG_TRACE_SPAN("write");
+        std::cout << result.filename() << ":" << std::endl;
+        for (int j = 0; j < result.detection_boxes_size(); ++j) {
+            const DetectionBox& box = result.detection_boxes(j);
+            printf("Class %d, score = %f, left top = [%f, %f], right bottom = [%f, %f]\n",
+                   box.class_(), box.score(), box.left_top_x(), box.left_top_y(),
+                   box.right_bottom_x(), box.right_bottom_y());
+        }
+        printf("\n");
+        std::ofstream output(result.filename() + ".pb", std::ios::out | std::ios::trunc | std::ios::binary);
+        result.SerializeToOstream(&output);
+        output.close();
+    }
+
+    /* results: when not null, the detection results are appended to it instead of
+     * being printed and written to `<filename>.pb`
+     * failed: positions (ascending) of the images that failed to preprocess, they
+     * get an empty result and no file
+     */
+    void output_detection_result(const float* out_addr, const std::vector<std::vector<size_t>> &lod_vector, const std::vector<ImageBlob> &imgs_batch,
+                                 const std::vector<int>& failed, std::vector<DetectionResult>* results = nullptr){
+        size_t f = 0;
         for(int i = 0; i < lod_vector[0].size() - 1; ++i) {
+            PADDLESEG_TRACE_IMAGE(i);
+            PADDLESEG_TRACE_SPAN("postprocess");
             DetectionResult detection_result;
-            detection_result.set_filename(imgs_batch[i]);
-            std::cout << imgs_batch[i] << ":" << std::endl;
+            detection_result.set_filename(imgs_batch[i].name);
+            if (f < failed.size() && failed[f] == i) {
+                ++f;
+                if (results != nullptr) {
+                    results->push_back(detection_result);
+                }
+                continue;
+            }
             for (int j = lod_vector[0][i]; j < lod_vector[0][i+1]; ++j) {
                 DetectionBox *box_ptr = detection_result.add_detection_boxes();
                 box_ptr->set_class_(static_cast<int>(round(out_addr[0 + j * 6])));
@@ -54,28 +87,87 @@ namespace PaddleSolution {
                 box_ptr->set_left_top_y(out_addr[3 + j * 6]);
                 box_ptr->set_right_bottom_x(out_addr[4 + j * 6]);
                 box_ptr->set_right_bottom_y(out_addr[5 + j * 6]);
-                printf("Class %d, score = %f, left top = [%f, %f], right bottom = [%f, %f]\n",
-                          static_cast<int>(round(out_addr[0 + j * 6])), out_addr[1 + j * 6], out_addr[2 + j * 6], 
-                                             out_addr[3 + j * 6], out_addr[4 + j * 6], out_addr[5 + j * 6]);    
             }
-            printf("\n");
-            std::ofstream output(imgs_batch[i] + ".pb", std::ios::out | std::ios::trunc | std::ios::binary);
-            detection_result.SerializeToOstream(&output);
-            output.close();
+            if (results != nullptr) {
+                results->push_back(detection_result);
+                continue;
+            }
+            save_detection_result(detection_result);
         }
     }
     
+    // a batch none of whose images could be preprocessed is not run
+    void output_failed_batch(const std::vector<ImageBlob> &imgs_batch, int batch_size,
+                             std::vector<DetectionResult>* results) {
+        if (results == nullptr) {
+            return;
+        }
+        for (int i = 0; i < batch_size; ++i) {
+            results->push_back(DetectionResult());
+            results->back().set_filename(imgs_batch[i].name);
+        }
+    }
+
+    DetectionPredictor::~DetectionPredictor() {
+        // report a profile window cut short by the end of the input
+        _op_profiler.finish(&_main_predictor);
+    }
+
     int DetectionPredictor::init(const std::string& conf) {
         if (!_model_config.load_config(conf)) {
-            LOG(FATAL) << "Fail to load config file: [" << conf << "]";
+            LOG(ERROR) << "Fail to load config file: [" << conf << "]";
             return -1;
         }
         _preprocessor = PaddleSolution::create_processor(conf);
         if (_preprocessor == nullptr) {
-            LOG(FATAL) << "Failed to create_processor";
+            LOG(ERROR) << "Failed to create_processor";
+            return -1;
+        }
+        // the detection preprocessor pads variable sized float images, uint8 input is not supported
+        if (_model_config._input_dtype != "FLOAT32") {
+            LOG(ERROR) << "DetectionPredictor only supports DEPLOY.INPUT_DTYPE FLOAT32";
+            return -1;
+        }
+        if (_model_config._result_cache) {
+            _result_cache = std::make_shared<ResultCache<DetectionResult>>(model_fingerprint(conf, _model_config),
+                _model_config._result_cache_capacity, _model_config._result_cache_dir);
+        }
+
+        // DEPLOY.MEMORY: place the padded batch input and, with PREFAULT, fault it
+        // in now rather than in the first batches; the output size depends on the
+        // number of boxes and is left to the first batches
+        utils::MemoryResidency residency;
+        if (!utils::memory_residency(_model_config, &residency)) {
             return -1;
         }
+        std::size_t input_size = 0;
+        if (_model_config._memory_prefault) {
+            // padded to the longest side the resize allows
+            int max_side = std::max(_model_config._resize_max_size,
+                std::max(_model_config._resize[0], _model_config._resize[1]));
+            int stride = std::max(1, _model_config._coarsest_stride);
+            max_side = (max_side + stride - 1) / stride * stride;
+            input_size = static_cast<std::size_t>(_model_config._batch_size) * _model_config._channels
+                * max_side * max_side;
+        }
+        utils::place_buffer(&_buffer, residency, input_size);
+        utils::place_buffer(&_arena.out_data, residency, 0);
 
+        _op_profiler.init(_model_config);
+        _memory_planner.init(_model_config);
+        _batch_controller.init(_model_config);
+        utils::MappingSnapshot mappings;
+        _main_predictor = create_paddle_predictor(false);
+        if (_main_predictor == nullptr) {
+            return -1;
+        }
+        if (_model_config._memory_lock > 1) {
+            mappings.lock_new();
+        }
+        return 0;
+    }
+
+    std::unique_ptr<paddle::PaddlePredictor> DetectionPredictor::create_paddle_predictor(bool profile) {
         bool use_gpu = _model_config._use_gpu;
         const auto& model_dir = _model_config._model_path;
         const auto& model_filename = _model_config._model_file_name;
@@ -91,7 +183,10 @@ namespace PaddleSolution {
             config.fraction_of_gpu_memory = 0;
             config.use_gpu = use_gpu;
             config.device = 0;
-            _main_predictor = paddle::CreatePaddlePredictor(config);
+            if (_cpu_math_threads > 0) {
+                config.SetCpuMathLibraryNumThreads(_cpu_math_threads);
+            }
+            return paddle::CreatePaddlePredictor(config);
         } else if (_model_config._predictor_mode == "ANALYSIS") {
             paddle::AnalysisConfig config;
             if (use_gpu) {
@@ -100,117 +195,321 @@ namespace PaddleSolution {
             auto prog_file = utils::path_join(model_dir, model_filename);
             auto param_file = utils::path_join(model_dir, params_filename);
             config.SetModel(prog_file, param_file);
+            if (_cpu_math_threads > 0) {
+                config.SetCpuMathLibraryNumThreads(_cpu_math_threads);
+            }
             config.SwitchUseFeedFetchOps(false);
             config.SwitchSpecifyInputNames(true);
             config.EnableMemoryOptim();
-            _main_predictor = paddle::CreatePaddlePredictor(config);
-        } else {
+            if (profile) {
+                config.EnableProfile();
+            }
+            if (!enable_quantizer(_model_config, &config)) {
+                return nullptr;
+            }
+            return paddle::CreatePaddlePredictor(config);
+        }
+        return nullptr;
+    }
+
+    int DetectionPredictor::reload(const std::string& conf) {
+        std::unique_ptr<DetectionPredictor> fresh(new DetectionPredictor());
+        fresh->_cpu_math_threads = _cpu_math_threads;
+        // a broken config or model must not take the running service down
+        try {
+            if (fresh->init(conf) != 0) {
+                LOG(ERROR) << "Fail to reload model with config: [" << conf << "]";
+                return -1;
+            }
+        } catch (const std::exception& e) {
+            LOG(ERROR) << "Fail to reload model with config: [" << conf << "]: " << e.what();
+            return -1;
+        }
+        // warm up with a blank image so the first real batch does not pay for it,
+        // past the result cache and the operator profiler so neither records it
+        fresh->_op_profiler.disable();
+        const auto& crop_size = fresh->_model_config._crop_size;
+        std::vector<ImageBlob> warmup_imgs(1, ImageBlob::from_mat("warmup.jpg",
+            cv::Mat(crop_size[1], crop_size[0], CV_8UC3, cv::Scalar(0, 0, 0))));
+        BlobImageSource warmup_source(warmup_imgs);
+        std::vector<DetectionResult> warmup_results;
+        if (fresh->predict_uncached(warmup_source, &warmup_results) != 0) {
+            LOG(ERROR) << "Fail to warm up the reloaded model: [" << conf << "]";
             return -1;
         }
+        std::lock_guard<std::mutex> lock(_reload_mutex);
+        _reloaded = std::move(fresh);
+        _has_reloaded = true;
         return 0;
+    }
 
+    bool DetectionPredictor::swap_reloaded_model() {
+        if (!_has_reloaded) {
+            return false;
+        }
+        std::unique_ptr<DetectionPredictor> fresh;
+        {
+            std::lock_guard<std::mutex> lock(_reload_mutex);
+            fresh = std::move(_reloaded);
+            _has_reloaded = false;
+        }
+        _model_config = fresh->_model_config;
+        _preprocessor = fresh->_preprocessor;
+        // end a profile window before its predictor is replaced
+        _op_profiler.finish(&_main_predictor);
+        // the old paddle predictor is released here
+        _main_predictor = std::move(fresh->_main_predictor);
+        // the batch buffers as the new DEPLOY.MEMORY placed them, and the
+        // batch size, memory budget and profile window of the new config
+        _buffer = std::move(fresh->_buffer);
+        _arena.out_data = std::move(fresh->_arena.out_data);
+        _op_profiler.init(_model_config);
+        _memory_planner.init(_model_config);
+        _batch_controller.init(_model_config);
+        if (_result_cache != nullptr) {
+            _result_cache->retire();
+        }
+        _result_cache = fresh->_result_cache;
+        std::cout << "switch to the reloaded model: " << _model_config._model_path << std::endl;
+        return true;
     }
 
     int DetectionPredictor::predict(const std::vector<std::string>& imgs) {
-        if (_model_config._predictor_mode == "NATIVE") {
-            return native_predict(imgs);
+        VectorImageSource source(imgs);
+        return predict(source);
+    }
+
+    int DetectionPredictor::predict(ImageSource& source) {
+        return predict(source, nullptr);
+    }
+
+    int DetectionPredictor::predict(const std::vector<ImageBlob>& imgs, std::vector<DetectionResult>* results,
+                                    std::vector<int>* failed) {
+        BlobImageSource source(imgs);
+        int ret = predict(source, results);
+        if (failed != nullptr) {
+            *failed = source.failed_positions();
+        }
+        return ret;
+    }
+
+    int DetectionPredictor::predict(const std::vector<cv::Mat>& imgs, std::vector<DetectionResult>* results,
+                                    std::vector<int>* failed) {
+        std::vector<ImageBlob> blobs(imgs.size());
+        for (int i = 0; i < imgs.size(); ++i) {
+            blobs[i] = ImageBlob::from_mat("image_" + std::to_string(i) + ".jpg", imgs[i]);
+        }
+        return predict(blobs, results, failed);
+    }
+
+    int DetectionPredictor::predict(ImageSource& source, std::vector<DetectionResult>* results) {
+        // a reload may replace _result_cache during the call, keep this one alive
+        auto cache = _result_cache;
+        if (cache != nullptr) {
+            return cached_predict(*cache, source, _model_config._batch_size, results,
+                [this](const std::vector<ImageBlob>& imgs, std::vector<DetectionResult>* miss_results,
+                       std::vector<int>* failed) {
+                    BlobImageSource misses(imgs);
+                    int ret = predict_uncached(misses, miss_results);
+                    *failed = misses.failed_positions();
+                    return ret;
+                },
+                save_detection_result);
+        }
+        return predict_uncached(source, results);
+    }
+
+    int DetectionPredictor::predict_uncached(ImageSource& source, std::vector<DetectionResult>* results) {
+        // the loops stop at a reloaded model, the rest of the source runs in the
+        // mode of its config (a RESULT_CACHE it turns on applies from the next call)
+        int ret = kReloaded;
+        while (ret == kReloaded) {
+            if (_model_config._predictor_mode == "NATIVE") {
+                ret = native_predict(source, results);
+            }
+            else if (_model_config._predictor_mode == "ANALYSIS") {
+                ret = analysis_predict(source, results);
+            }
+            else {
+                return -1;
+            }
+        }
+        return ret;
+    }
+
+    int DetectionPredictor::make_warmup_data(const std::vector<ImageBlob>& imgs, std::vector<paddle::PaddleTensor>* feeds) {
+        int batch_size = imgs.size();
+        int channels = _model_config._channels;
+        int feeds_size = _model_config._feeds_size;
+        std::vector<int> ori_widths(batch_size);
+        std::vector<int> ori_heights(batch_size);
+        std::vector<int> resize_widths(batch_size);
+        std::vector<int> resize_heights(batch_size);
+        std::vector<float> scale_ratios(batch_size);
+        std::vector<std::vector<float>> lod_buffer(batch_size);
+        if (!_preprocessor->batch_process(imgs, lod_buffer, ori_widths.data(), ori_heights.data(),
+                                          resize_widths.data(), resize_heights.data(), scale_ratios.data())) {
+            return -1;
+        }
+        utils::ResidentVector<float> input_buffer;
+        padding_minibatch(lod_buffer, input_buffer, resize_heights, resize_widths, channels, _model_config._coarsest_stride);
+
+        // same feeds as the predict loops: image, info (3 feeds only) and im_size
+        auto input_names = _main_predictor->GetInputNames();
+        if (input_names.empty()) {
+            input_names = feeds_size > 2 ? std::vector<std::string>({ "image", "info", "im_size" })
+                                         : std::vector<std::string>({ "image", "im_size" });
+        }
+        feeds->clear();
+        paddle::PaddleTensor im_tensor;
+        im_tensor.name = input_names.front();
+        im_tensor.shape = std::vector<int>({ batch_size, channels, resize_heights[0], resize_widths[0] });
+        im_tensor.data.Resize(input_buffer.size() * sizeof(float));
+        memcpy(im_tensor.data.data(), input_buffer.data(), input_buffer.size() * sizeof(float));
+        im_tensor.dtype = paddle::PaddleDType::FLOAT32;
+        feeds->push_back(im_tensor);
+        if (feeds_size > 2) {
+            paddle::PaddleTensor im_info_tensor;
+            im_info_tensor.name = input_names[1];
+            im_info_tensor.shape = std::vector<int>({ batch_size, 3 });
+            im_info_tensor.data.Resize(batch_size * 3 * sizeof(float));
+            im_info_tensor.dtype = paddle::PaddleDType::FLOAT32;
+            float* info = static_cast<float*>(im_info_tensor.data.data());
+            for (int i = 0; i < batch_size; ++i) {
+                info[i * 3] = resize_heights[i];
+                info[i * 3 + 1] = resize_widths[i];
+                info[i * 3 + 2] = scale_ratios[i];
+            }
+            feeds->push_back(im_info_tensor);
         }
-        else if (_model_config._predictor_mode == "ANALYSIS") {
-            return analysis_predict(imgs);
+        paddle::PaddleTensor im_size_tensor;
+        im_size_tensor.name = input_names.back();
+        if (feeds_size == 2) {
+            im_size_tensor.shape = std::vector<int>({ batch_size, 2 });
+            im_size_tensor.data.Resize(batch_size * 2 * sizeof(int));
+            im_size_tensor.dtype = paddle::PaddleDType::INT32;
+            int* size = static_cast<int*>(im_size_tensor.data.data());
+            for (int i = 0; i < batch_size; ++i) {
+                size[i * 2] = ori_heights[i];
+                size[i * 2 + 1] = ori_widths[i];
+            }
+        } else {
+            im_size_tensor.shape = std::vector<int>({ batch_size, 3 });
+            im_size_tensor.data.Resize(batch_size * 3 * sizeof(float));
+            im_size_tensor.dtype = paddle::PaddleDType::FLOAT32;
+            float* size = static_cast<float*>(im_size_tensor.data.data());
+            for (int i = 0; i < batch_size; ++i) {
+                size[i * 3] = ori_heights[i];
+                size[i * 3 + 1] = ori_widths[i];
+                size[i * 3 + 2] = 1.0;
+            }
         }
-        return -1;
+        feeds->push_back(im_size_tensor);
+        return 0;
     }
 
-    int DetectionPredictor::native_predict(const std::vector<std::string>& imgs) {
+    bool DetectionPredictor::prepare_batch(int batch_size) {
+        PADDLESEG_TRACE_SPAN("preprocess");
+        auto& arena = _arena;
+        arena.reserve(batch_size);
+        arena.ori_widths.resize(batch_size);
+        arena.ori_heights.resize(batch_size);
+        arena.resize_widths.resize(batch_size);
+        arena.resize_heights.resize(batch_size);
+        arena.scale_ratios.resize(batch_size);
+        if (!_preprocessor->batch_process(_imgs_batch, arena.lod_buffer, arena.ori_widths.data(), arena.ori_heights.data(),
+                                          arena.resize_widths.data(), arena.resize_heights.data(), arena.scale_ratios.data())) {
+            return false;
+        }
+        // the slots of the images that failed still hold the previous batch,
+        // empty them so they are padded with zeros
+        _preprocessor->failed_positions(&_failed_images);
+        for (int i : _failed_images) {
+            arena.lod_buffer[i].clear();
+            arena.ori_widths[i] = arena.ori_heights[i] = 0;
+            arena.resize_widths[i] = arena.resize_heights[i] = 0;
+            arena.scale_ratios[i] = 1.0;
+        }
+        // flatten and padding
+        _buffer.clear();
+        padding_minibatch(arena.lod_buffer, _buffer, arena.resize_heights, arena.resize_widths,
+                          _model_config._channels, _model_config._coarsest_stride);
+
+        arena.image_infos.clear();
+        arena.image_size.clear();
+        arena.image_size_f.clear();
+        for (int i = 0; i < batch_size; ++i) {
+            arena.image_infos.push_back(arena.resize_heights[i]);
+            arena.image_infos.push_back(arena.resize_widths[i]);
+            arena.image_infos.push_back(arena.scale_ratios[i]);
+            arena.image_size.push_back(arena.ori_heights[i]);
+            arena.image_size.push_back(arena.ori_widths[i]);
+            arena.image_size_f.push_back(static_cast<float>(arena.ori_heights[i]));
+            arena.image_size_f.push_back(static_cast<float>(arena.ori_widths[i]));
+            arena.image_size_f.push_back(1.0);
+        }
+        return true;
+    }
+
+    int DetectionPredictor::native_predict(ImageSource& source, std::vector<DetectionResult>* results) {
         int config_batch_size = _model_config._batch_size;
 
         int channels = _model_config._channels;
         int eval_width = _model_config._resize[0];
         int eval_height = _model_config._resize[1];
-        std::size_t total_size = imgs.size();
-        int default_batch_size = std::min(config_batch_size, (int)total_size);
-        int batch = total_size / default_batch_size + ((total_size % default_batch_size) != 0);
-        int batch_buffer_size = default_batch_size * channels * eval_width * eval_height;
+        int batch_buffer_size = config_batch_size * channels * eval_width * eval_height;
 
         auto& input_buffer = _buffer;
         auto& imgs_batch = _imgs_batch;
         float sr;
     //    DetectionResultsContainer result_container;
-        for (int u = 0; u < batch; ++u) {
-            int batch_size = default_batch_size;
-            if (u == (batch - 1) && (total_size % default_batch_size)) {
-                batch_size = total_size % default_batch_size;
-            }
-
-            int real_buffer_size = batch_size * channels * eval_width * eval_height;
-            std::vector<paddle::PaddleTensor> feeds;
-            input_buffer.clear();
-            imgs_batch.clear();
-            for (int i = 0; i < batch_size; ++i) {
-                int idx = u * default_batch_size + i;
-                imgs_batch.push_back(imgs[idx]);
-            }
-            std::vector<int> ori_widths;
-            std::vector<int> ori_heights;
-            std::vector<int> resize_widths;
-            std::vector<int> resize_heights;
-            std::vector<float> scale_ratios;
-            ori_widths.resize(batch_size);
-            ori_heights.resize(batch_size);
-            resize_widths.resize(batch_size);
-            resize_heights.resize(batch_size);
-            scale_ratios.resize(batch_size);
-            std::vector<std::vector<float>> lod_buffer(batch_size);
-            if (!_preprocessor->batch_process(imgs_batch, lod_buffer, ori_widths.data(), ori_heights.data(),
-                                          resize_widths.data(), resize_heights.data(), scale_ratios.data())) {
+        int batch_size = 0;
+        // a reloaded model is switched in between batches, the in-flight batch
+        // finishes on the old one
+        bool reloaded = false;
+        for (int u = 0; !(reloaded = swap_reloaded_model())
+            && (batch_size = source.next_batch(imgs_batch, _batch_controller.batch_size(_memory_planner.batch_size(config_batch_size)))) > 0; ++u) {
+            // allocations are counted only in WITH_ALLOC_COUNTER builds
+            utils::BatchMetrics batch_metrics;
+            _batch_controller.start();
+            PADDLESEG_TRACE_BATCH(u);
+            _op_profiler.before_batch(&_main_predictor, [this]() { return create_paddle_predictor(true); });
+            if (!prepare_batch(batch_size)) {
                 return -1;
             }
-            // flatten and padding 
-            padding_minibatch(lod_buffer, input_buffer, resize_heights, resize_widths, channels, _model_config._coarsest_stride);
+            if (_failed_images.size() == batch_size) {
+                output_failed_batch(imgs_batch, batch_size, results);
+                source.failed(batch_size);
+                continue;
+            }
+            auto& arena = _arena;
             paddle::PaddleTensor im_tensor, im_size_tensor, im_info_tensor;
 
             im_tensor.name = "image";
-            im_tensor.shape = std::vector<int>({ batch_size, channels, resize_heights[0], resize_widths[0] });
+            im_tensor.shape = std::vector<int>({ batch_size, channels, arena.resize_heights[0], arena.resize_widths[0] });
             im_tensor.data.Reset(input_buffer.data(), input_buffer.size() * sizeof(float));
             im_tensor.dtype = paddle::PaddleDType::FLOAT32;
- 
-            std::vector<float> image_infos;
-            for(int i = 0; i < batch_size; ++i) {
-                image_infos.push_back(resize_heights[i]);
-                image_infos.push_back(resize_widths[i]);
-                image_infos.push_back(scale_ratios[i]);
-            }
+
             im_info_tensor.name = "info";
             im_info_tensor.shape = std::vector<int>({batch_size, 3});
-            im_info_tensor.data.Reset(image_infos.data(), batch_size * 3 * sizeof(float));
+            im_info_tensor.data.Reset(arena.image_infos.data(), batch_size * 3 * sizeof(float));
             im_info_tensor.dtype = paddle::PaddleDType::FLOAT32;
-            
-            std::vector<int> image_size;
-            for(int i = 0; i < batch_size; ++i) {
-                image_size.push_back(ori_heights[i]);
-                image_size.push_back(ori_widths[i]);
-            }
 
-           std::vector<float> image_size_f;
-           for(int i = 0; i < batch_size; ++i) {
-               image_size_f.push_back(ori_heights[i]);
-               image_size_f.push_back(ori_widths[i]);
-               image_size_f.push_back(1.0);
-           }
-           
            int feeds_size = _model_config._feeds_size;
            im_size_tensor.name = "im_size";
            if(feeds_size == 2) {
                 im_size_tensor.shape = std::vector<int>({ batch_size, 2});
-                im_size_tensor.data.Reset(image_size.data(), batch_size * 2 * sizeof(int));
+                im_size_tensor.data.Reset(arena.image_size.data(), batch_size * 2 * sizeof(int));
                 im_size_tensor.dtype = paddle::PaddleDType::INT32;
            }
            else if(feeds_size == 3) {
                 im_size_tensor.shape = std::vector<int>({ batch_size, 3});
-                im_size_tensor.data.Reset(image_size_f.data(), batch_size * 3 * sizeof(float));
+                im_size_tensor.data.Reset(arena.image_size_f.data(), batch_size * 3 * sizeof(float));
                 im_size_tensor.dtype = paddle::PaddleDType::FLOAT32;
            }
            std::cout << "Feed size = " << feeds_size << std::endl;
+           auto& feeds = arena.feeds;
+           feeds.clear();
            feeds.push_back(im_tensor);
            if(_model_config._feeds_size > 2) {
                 feeds.push_back(im_info_tensor);
@@ -219,13 +518,26 @@ namespace PaddleSolution {
            _outputs.clear();
 
             auto t1 = std::chrono::high_resolution_clock::now();
-            if (!_main_predictor->Run(feeds, &_outputs, batch_size)) {
+            bool ran = false;
+            {
+                PADDLESEG_TRACE_SPAN("run");
+                ran = _main_predictor->Run(feeds, &_outputs, batch_size);
+            }
+            if (!ran) {
                 LOG(ERROR) << "Failed: NativePredictor->Run() return false at batch: " << u;
+                if (results != nullptr) {
+                    // the results would no longer line up with the inputs
+                    return -1;
+                }
+                source.failed(batch_size);
                 continue;
             }
             auto t2 = std::chrono::high_resolution_clock::now();
             auto duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
             std::cout << "runtime = " << duration << std::endl;
+            _op_profiler.add_run_time(duration);
+            _batch_controller.observe(batch_size, duration);
+            batch_metrics.print();
             std::cout << "Number of outputs:"  << _outputs.size() << std::endl;
             int out_num = 1;
             // print shape of first output tensor for debugging
@@ -242,111 +554,89 @@ namespace PaddleSolution {
         //        return -1;
         //    }
             float* out_addr = (float *)(_outputs[0].data.data());
-            output_detection_result(out_addr, _outputs[0].lod, imgs_batch);
+            _memory_planner.observe(batch_size, input_buffer.size() * sizeof(float), _outputs[0].data.length());
+            output_detection_result(out_addr, _outputs[0].lod, imgs_batch, _failed_images, results);
+            // the outputs of the batch are written, but for the images that failed to preprocess
+            source.done(batch_size, _failed_images);
+            _op_profiler.after_batch(&_main_predictor);
         }
-        return 0;
+        // predict_uncached() goes on with the rest of the source under the new config
+        return reloaded ? kReloaded : 0;
     }
 
-    int DetectionPredictor::analysis_predict(const std::vector<std::string>& imgs) {
+    int DetectionPredictor::analysis_predict(ImageSource& source, std::vector<DetectionResult>* results) {
 
         int config_batch_size = _model_config._batch_size;
         int channels = _model_config._channels;
         int eval_width = _model_config._resize[0];
         int eval_height = _model_config._resize[1];
-        auto total_size = imgs.size();
-        int default_batch_size = std::min(config_batch_size, (int)total_size);
-        int batch = total_size / default_batch_size + ((total_size % default_batch_size) != 0);
-        int batch_buffer_size = default_batch_size * channels * eval_width * eval_height;
+        int batch_buffer_size = config_batch_size * channels * eval_width * eval_height;
 
         auto& input_buffer = _buffer;
         auto& imgs_batch = _imgs_batch;
         //DetectionResultsContainer result_container;
-        for (int u = 0; u < batch; ++u) {
-            int batch_size = default_batch_size;
-            if (u == (batch - 1) && (total_size % default_batch_size)) {
-                batch_size = total_size % default_batch_size;
-            }
-
-            int real_buffer_size = batch_size * channels * eval_width * eval_height;
-            std::vector<paddle::PaddleTensor> feeds;
-            //input_buffer.resize(real_buffer_size);
-            input_buffer.clear();
-            imgs_batch.clear();
-            for (int i = 0; i < batch_size; ++i) {
-                int idx = u * default_batch_size + i;
-                imgs_batch.push_back(imgs[idx]);
-            }
-        
-            std::vector<int> ori_widths;
-            std::vector<int> ori_heights;
-            std::vector<int> resize_widths;
-            std::vector<int> resize_heights;
-            std::vector<float> scale_ratios;
-            ori_widths.resize(batch_size);
-            ori_heights.resize(batch_size);
-            resize_widths.resize(batch_size);
-            resize_heights.resize(batch_size);
-            scale_ratios.resize(batch_size);
-        
-            std::vector<std::vector<float>> lod_buffer(batch_size);
-            if (!_preprocessor->batch_process(imgs_batch, lod_buffer, ori_widths.data(), ori_heights.data(),
-                          resize_widths.data(), resize_heights.data(), scale_ratios.data())){
+        int batch_size = 0;
+        // a reloaded model is switched in between batches, the in-flight batch
+        // finishes on the old one
+        bool reloaded = false;
+        for (int u = 0; !(reloaded = swap_reloaded_model())
+            && (batch_size = source.next_batch(imgs_batch, _batch_controller.batch_size(_memory_planner.batch_size(config_batch_size)))) > 0; ++u) {
+            // allocations are counted only in WITH_ALLOC_COUNTER builds
+            utils::BatchMetrics batch_metrics;
+            _batch_controller.start();
+            PADDLESEG_TRACE_BATCH(u);
+            _op_profiler.before_batch(&_main_predictor, [this]() { return create_paddle_predictor(true); });
+            if (!prepare_batch(batch_size)) {
                 std::cout << "Failed to preprocess!" << std::endl;
                 return -1;
             }
-
-            //flatten tensor
-            padding_minibatch(lod_buffer, input_buffer, resize_heights, resize_widths, channels, _model_config._coarsest_stride);
-
-            std::vector<std::string> input_names = _main_predictor->GetInputNames();
-            auto im_tensor = _main_predictor->GetInputTensor(input_names.front());
-            im_tensor->Reshape({ batch_size, channels, resize_heights[0], resize_widths[0] });
-            im_tensor->copy_from_cpu(input_buffer.data());
- 
-            if(input_names.size() > 2){
-                std::vector<float> image_infos;
-                for(int i = 0; i < batch_size; ++i) {
-                    image_infos.push_back(resize_heights[i]);
-                    image_infos.push_back(resize_widths[i]);
-                    image_infos.push_back(scale_ratios[i]);
-                }        
-                auto im_info_tensor = _main_predictor->GetInputTensor(input_names[1]);
-                im_info_tensor->Reshape({batch_size, 3});
-                im_info_tensor->copy_from_cpu(image_infos.data());
+            if (_failed_images.size() == batch_size) {
+                output_failed_batch(imgs_batch, batch_size, results);
+                source.failed(batch_size);
+                continue;
             }
+            auto& arena = _arena;
 
-            std::vector<int> image_size;
-            for(int i = 0; i < batch_size; ++i) {
-                image_size.push_back(ori_heights[i]);
-                image_size.push_back(ori_widths[i]);
-            }
-            std::vector<float> image_size_f;
-            for(int i = 0; i < batch_size; ++i) {
-                image_size_f.push_back(static_cast<float>(ori_heights[i]));
-                image_size_f.push_back(static_cast<float>(ori_widths[i]));
-                image_size_f.push_back(1.0);
-            }
-             
-            auto im_size_tensor = _main_predictor->GetInputTensor(input_names.back());
-            if(input_names.size() > 2) {
-                im_size_tensor->Reshape({batch_size, 3});
-                im_size_tensor->copy_from_cpu(image_size_f.data());
-            }
-            else{
-                im_size_tensor->Reshape({batch_size, 2});
-                im_size_tensor->copy_from_cpu(image_size.data());
+            {
+                PADDLESEG_TRACE_SPAN("copy_in");
+                std::vector<std::string> input_names = _main_predictor->GetInputNames();
+                auto im_tensor = _main_predictor->GetInputTensor(input_names.front());
+                im_tensor->Reshape({ batch_size, channels, arena.resize_heights[0], arena.resize_widths[0] });
+                im_tensor->copy_from_cpu(input_buffer.data());
+
+                if(input_names.size() > 2){
+                    auto im_info_tensor = _main_predictor->GetInputTensor(input_names[1]);
+                    im_info_tensor->Reshape({batch_size, 3});
+                    im_info_tensor->copy_from_cpu(arena.image_infos.data());
+                }
+
+                auto im_size_tensor = _main_predictor->GetInputTensor(input_names.back());
+                if(input_names.size() > 2) {
+                    im_size_tensor->Reshape({batch_size, 3});
+                    im_size_tensor->copy_from_cpu(arena.image_size_f.data());
+                }
+                else{
+                    im_size_tensor->Reshape({batch_size, 2});
+                    im_size_tensor->copy_from_cpu(arena.image_size.data());
+                }
             }
         
 
             auto t1 = std::chrono::high_resolution_clock::now();
-            _main_predictor->ZeroCopyRun();
+            {
+                PADDLESEG_TRACE_SPAN("run");
+                _main_predictor->ZeroCopyRun();
+            }
             auto t2 = std::chrono::high_resolution_clock::now();
             auto duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
             std::cout << "runtime = " << duration << std::endl;
+            _op_profiler.add_run_time(duration);
+            _batch_controller.observe(batch_size, duration);
+            batch_metrics.print();
 
             auto output_names = _main_predictor->GetOutputNames();
             auto output_t = _main_predictor->GetOutputTensor(output_names[0]);
-            std::vector<float> out_data;
+            auto& out_data = arena.out_data;
             std::vector<int> output_shape = output_t->shape();
 
             int out_num = 1;
@@ -358,12 +648,20 @@ namespace PaddleSolution {
             std::cout << ")" << std::endl;
 
             out_data.resize(out_num);
-            output_t->copy_to_cpu(out_data.data());
+            _memory_planner.observe(batch_size, input_buffer.size() * sizeof(float), out_num * sizeof(float));
+            {
+                PADDLESEG_TRACE_SPAN("copy_out");
+                output_t->copy_to_cpu(out_data.data());
+            }
 
             float* out_addr = (float *)(out_data.data());
             auto lod_vector = output_t->lod();
-            output_detection_result(out_addr, lod_vector, imgs_batch);            
+            output_detection_result(out_addr, lod_vector, imgs_batch, _failed_images, results);
+            // the outputs of the batch are written, but for the images that failed to preprocess
+            source.done(batch_size, _failed_images);
+            _op_profiler.after_batch(&_main_predictor);
         }
-        return 0;
+        // predict_uncached() goes on with the rest of the source under the new config
+        return reloaded ? kReloaded : 0;
     }
 }
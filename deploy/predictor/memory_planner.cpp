@@ -0,0 +1,75 @@
+#include "memory_planner.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include <glog/logging.h>
+
+namespace PaddleSolution {
+
+    namespace {
+        double to_mb(std::size_t bytes) {
+            return bytes / (1024.0 * 1024.0);
+        }
+    }
+
+    MemoryPlanner::MemoryPlanner()
+        : _enabled(false), _budget(0), _input_bytes(0), _output_bytes(0), _input_copies(2), _logged_cap(0) {
+    }
+
+    void MemoryPlanner::init(const PaddleSegModelConfigPaser& config) {
+        _enabled = config._memory_budget_mb > 0;
+        _budget = static_cast<std::size_t>(std::max(0, config._memory_budget_mb)) * 1024 * 1024;
+        _logged_cap = 0;
+        std::size_t value_bytes = config._input_dtype == "UINT8" ? 1 : sizeof(float);
+        std::size_t pixels = static_cast<std::size_t>(config._resize[0]) * config._resize[1];
+        std::size_t classes = std::max(1, config._class_num);
+        if (config._pre_processor == "DetectionPreProcessor") {
+            // padded to the longest side the resize allows, the unpadded image
+            // is kept by the preprocessor too
+            std::size_t side = std::max(config._resize_max_size, std::max(config._resize[0], config._resize[1]));
+            pixels = side * side;
+            _input_copies = 3;
+            // boxes of (class, score, 4 coordinates)
+            _output_bytes = kDetectionBoxes * 6 * sizeof(float);
+        } else if (config._pre_processor == "ClassifyPreProcessor") {
+            _input_copies = 2;
+            _output_bytes = classes * sizeof(float);
+        } else {
+            _input_copies = 2;
+            _output_bytes = classes * pixels * sizeof(float);
+        }
+        _input_bytes = pixels * config._channels * value_bytes;
+        if (_enabled) {
+            std::cout << "memory budget: " << config._memory_budget_mb << " MB, "
+                << to_mb(image_bytes()) << " MB per image estimated" << std::endl;
+        }
+    }
+
+    int MemoryPlanner::batch_size(int batch_size) {
+        if (!_enabled || batch_size <= 1) {
+            return batch_size;
+        }
+        std::size_t per_image = std::max<std::size_t>(1, image_bytes());
+        int cap = static_cast<int>(std::min<std::size_t>(batch_size, std::max<std::size_t>(1, _budget / per_image)));
+        if (cap != _logged_cap && (cap < batch_size || _logged_cap != 0)) {
+            LOG(WARNING) << "DEPLOY.MEMORY_BUDGET_MB " << to_mb(_budget) << ": batch size " << batch_size
+                << " capped to " << cap << " (" << to_mb(per_image) << " MB per image)";
+            _logged_cap = cap;
+        }
+        return cap;
+    }
+
+    void MemoryPlanner::observe(int images, std::size_t input_bytes, std::size_t output_bytes) {
+        if (!_enabled || images <= 0) {
+            return;
+        }
+        std::size_t used = input_bytes * _input_copies + output_bytes * kOutputCopies;
+        if (used > _budget) {
+            LOG(WARNING) << "DEPLOY.MEMORY_BUDGET_MB " << to_mb(_budget) << ": a batch of " << images
+                << " images used " << to_mb(used) << " MB";
+        }
+        _input_bytes = std::max(_input_bytes, input_bytes / images);
+        _output_bytes = std::max(_output_bytes, output_bytes / images);
+    }
+}
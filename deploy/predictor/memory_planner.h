@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+
+#include <utils/seg_conf_parser.h>
+
+namespace PaddleSolution {
+    /* DEPLOY.MEMORY_BUDGET_MB: keeps the buffers of a batch under a budget by
+     * capping the number of images the predict loops pull for it, so a large
+     * BATCH_SIZE is split into smaller batches instead of running out of memory.
+     *
+     * The bytes of one image are estimated at init from the config: the input
+     * (EVAL_CROP_SIZE, or RESIZE_MAX_SIZE squared for detection, times CHANNELS)
+     * held by the batch buffer and the Paddle input tensor, plus the detection
+     * images before padding, and the output (NUM_CLASSES score maps for
+     * segmentation, NUM_CLASSES scores for classification) held by Paddle and
+     * copied out. After every batch the sizes actually seen replace the
+     * estimate when they are larger, so detection batches padded to large
+     * images or outputs larger than assumed lower the cap from the next batch
+     * on. The model and the Paddle activations are not counted, leave room for
+     * them.
+     */
+    class MemoryPlanner {
+    public:
+        // boxes assumed per detection image before an output has been seen
+        static const int kDetectionBoxes = 100;
+
+        MemoryPlanner();
+
+        void init(const PaddleSegModelConfigPaser& config);
+
+        // images to pull for the next batch, `batch_size` when it fits the budget;
+        // logs when the cap changes
+        int batch_size(int batch_size);
+
+        // the input and output bytes of a batch of `images` that just ran
+        void observe(int images, std::size_t input_bytes, std::size_t output_bytes);
+
+        // estimated bytes of one image
+        std::size_t image_bytes() const {
+            return _input_bytes * _input_copies + _output_bytes * kOutputCopies;
+        }
+
+    private:
+        // the output of Paddle and its copy
+        static const int kOutputCopies = 2;
+
+        bool _enabled;
+        std::size_t _budget;
+        // per image, as fed to Paddle
+        std::size_t _input_bytes;
+        std::size_t _output_bytes;
+        int _input_copies;
+        // last cap logged, 0 before the first
+        int _logged_cap;
+    };
+}
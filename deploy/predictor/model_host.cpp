@@ -0,0 +1,325 @@
+#include "model_host.h"
+
+#include <algorithm>
+#include <atomic>
+#include <future>
+
+#include <glog/logging.h>
+#include <yaml-cpp/yaml.h>
+
+#include <utils/seg_conf_parser.h>
+#include <preprocessor/preprocessor.h>
+#include <predictor/seg_predictor.h>
+#include <predictor/classify_predictor.h>
+#include <predictor/detection_predictor.h>
+
+namespace PaddleSolution {
+
+    bool HostConfig::load(const std::string& file) {
+        YAML::Node config = YAML::LoadFile(file);
+        auto host = config["HOST"];
+        if (!host.IsDefined() || !host["MODELS"].IsDefined()) {
+            LOG(ERROR) << "HOST.MODELS is not set in: " << file;
+            return false;
+        }
+        if (host["THREADS"].IsDefined()) {
+            threads = host["THREADS"].as<int>();
+        }
+        if (host["DECODE_CACHE_MB"].IsDefined()) {
+            decode_cache_mb = host["DECODE_CACHE_MB"].as<int>();
+        }
+        if (host["BATCH_SIZE"].IsDefined()) {
+            batch_size = host["BATCH_SIZE"].as<int>();
+        }
+        models.clear();
+        for (const auto& item : host["MODELS"]) {
+            HostedModelConfig model;
+            model.name = item["NAME"].as<std::string>();
+            model.type = item["TYPE"].as<std::string>();
+            model.conf = item["CONF"].as<std::string>();
+            if (item["WEIGHT"].IsDefined()) {
+                model.weight = item["WEIGHT"].as<int>();
+            }
+            models.push_back(model);
+        }
+        return !models.empty();
+    }
+
+    static void store_result(const std::string& model, SegResult* result, HostedResult* hosted) {
+        hosted->seg[model] = std::move(*result);
+    }
+
+    static void store_result(const std::string& model, ClassifyResult* result, HostedResult* hosted) {
+        hosted->classify[model] = std::move(*result);
+    }
+
+    static void store_result(const std::string& model, DetectionResult* result, HostedResult* hosted) {
+        hosted->detection[model].Swap(result);
+    }
+
+    // a predictor of any of the three types
+    class HostedModel {
+    public:
+        virtual ~HostedModel() {}
+        virtual int init(const std::string& conf, int threads) = 0;
+        // keep_results: keep the results for collect() instead of writing them
+        virtual int predict(const std::vector<ImageBlob>& imgs, bool keep_results) = 0;
+        // move the kept results into `hosted`, one per image
+        virtual void collect(const std::string& model, HostedResult* hosted) = 0;
+    };
+
+    template <typename PredictorT, typename ResultT>
+    class HostedModelImpl : public HostedModel {
+    public:
+        int init(const std::string& conf, int threads) {
+            _predictor.set_cpu_math_threads(threads);
+            return _predictor.init(conf);
+        }
+
+        int predict(const std::vector<ImageBlob>& imgs, bool keep_results) {
+            _results.clear();
+            if (!keep_results) {
+                BlobImageSource source(imgs);
+                return _predictor.predict(source);
+            }
+            return _predictor.predict(imgs, &_results);
+        }
+
+        void collect(const std::string& model, HostedResult* hosted) {
+            for (int i = 0; i < _results.size(); ++i) {
+                store_result(model, &_results[i], &hosted[i]);
+            }
+            _results.clear();
+        }
+
+    private:
+        PredictorT _predictor;
+        std::vector<ResultT> _results;
+    };
+
+    struct MultiModelHost::Slot {
+        Slot() : threads(1), decode_flags(cv::IMREAD_COLOR), job(nullptr),
+            keep_results(false), busy(false), ret(0), stop(false) {
+        }
+
+        HostedModelConfig config;
+        int threads;
+        // flags the model's preprocessor decodes with
+        int decode_flags;
+        std::unique_ptr<HostedModel> model;
+        std::thread thread;
+        std::promise<int> inited;
+        std::mutex mutex;
+        std::condition_variable cv;
+        // batch being predicted, guarded by `mutex`
+        const std::vector<ImageBlob>* job;
+        bool keep_results;
+        bool busy;
+        int ret;
+        bool stop;
+    };
+
+    MultiModelHost::MultiModelHost() {
+    }
+
+    MultiModelHost::~MultiModelHost() {
+        stop();
+    }
+
+    int MultiModelHost::init(const std::string& host_conf) {
+        if (!_config.load(host_conf)) {
+            LOG(ERROR) << "Fail to load host config: [" << host_conf << "]";
+            return -1;
+        }
+        int budget = _config.threads > 0 ? _config.threads : std::max(1u, std::thread::hardware_concurrency());
+        int total_weight = 0;
+        for (const auto& model : _config.models) {
+            total_weight += std::max(1, model.weight);
+        }
+        _cache.reset(new utils::DecodeCache(static_cast<uint64_t>(std::max(0, _config.decode_cache_mb)) << 20));
+
+        for (const auto& model : _config.models) {
+            std::unique_ptr<Slot> slot(new Slot());
+            slot->config = model;
+            slot->threads = std::max(1, budget * std::max(1, model.weight) / total_weight);
+            PaddleSegModelConfigPaser model_config;
+            if (!model_config.load_config(model.conf)) {
+                LOG(ERROR) << "Fail to load config file: [" << model.conf << "]";
+                return -1;
+            }
+            // same flags as the preprocessors: classification always decodes
+            // 3 channels, the others keep rgba images as they are
+            if (model.type != "classify" && model_config._img_type == "rgba") {
+                slot->decode_flags = cv::IMREAD_UNCHANGED;
+            }
+            if (model.type == "seg") {
+                slot->model.reset(new HostedModelImpl<Predictor, SegResult>());
+            } else if (model.type == "classify") {
+                slot->model.reset(new HostedModelImpl<ClassifyPredictor, ClassifyResult>());
+            } else if (model.type == "detection") {
+                slot->model.reset(new HostedModelImpl<DetectionPredictor, DetectionResult>());
+            } else {
+                LOG(ERROR) << "Unknown type of model " << model.name << ": " << model.type;
+                return -1;
+            }
+            auto init_result = slot->inited.get_future();
+            Slot* s = slot.get();
+            slot->thread = std::thread([this, s] { run_slot(s); });
+            _slots.push_back(std::move(slot));
+            if (init_result.get() != 0) {
+                LOG(ERROR) << "Fail to init model " << model.name << " with config: [" << model.conf << "]";
+                stop();
+                return -1;
+            }
+            std::cout << "model " << model.name << ": " << s->threads << " threads" << std::endl;
+        }
+        return 0;
+    }
+
+    void MultiModelHost::run_slot(Slot* slot) {
+        // the model's own preprocessing workers, the slot thread is one of them
+        utils::ThreadPool pool(slot->threads - 1);
+        utils::ThreadPool::set_current(&pool);
+        int ret = -1;
+        try {
+            ret = slot->model->init(slot->config.conf, slot->threads);
+        } catch (const std::exception& e) {
+            LOG(ERROR) << "Fail to init model " << slot->config.name << ": " << e.what();
+        }
+        slot->inited.set_value(ret);
+
+        std::unique_lock<std::mutex> lock(slot->mutex);
+        while (true) {
+            slot->cv.wait(lock, [slot] { return slot->stop || slot->job != nullptr; });
+            if (slot->job == nullptr) {
+                break;
+            }
+            const std::vector<ImageBlob>* job = slot->job;
+            bool keep_results = slot->keep_results;
+            lock.unlock();
+            int predicted = slot->model->predict(*job, keep_results);
+            lock.lock();
+            slot->ret = predicted;
+            slot->job = nullptr;
+            slot->busy = false;
+            slot->cv.notify_all();
+        }
+        utils::ThreadPool::set_current(nullptr);
+    }
+
+    void MultiModelHost::stop() {
+        for (auto& slot : _slots) {
+            {
+                std::lock_guard<std::mutex> lock(slot->mutex);
+                slot->stop = true;
+            }
+            slot->cv.notify_all();
+        }
+        for (auto& slot : _slots) {
+            if (slot->thread.joinable()) {
+                slot->thread.join();
+            }
+        }
+        _slots.clear();
+    }
+
+    int MultiModelHost::predict(const std::vector<ImageBlob>& imgs, const std::vector<std::string>& models,
+                                std::vector<HostedResult>* results) {
+        std::vector<Slot*> slots;
+        for (auto& slot : _slots) {
+            if (models.empty() || std::find(models.begin(), models.end(), slot->config.name) != models.end()) {
+                slots.push_back(slot.get());
+            }
+        }
+        if (slots.size() != (models.empty() ? _slots.size() : models.size())) {
+            LOG(ERROR) << "Unknown model requested";
+            return -1;
+        }
+
+        // 1. decode every image once per distinct decode flags of the models;
+        // files are cached across calls, in-memory images only within the call
+        std::vector<int> flags;
+        for (auto slot : slots) {
+            if (std::find(flags.begin(), flags.end(), slot->decode_flags) == flags.end()) {
+                flags.push_back(slot->decode_flags);
+            }
+        }
+        _decoded.resize(flags.size());
+        std::atomic<bool> decoded(true);
+        for (int f = 0; f < flags.size(); ++f) {
+            auto& blobs = _decoded[f];
+            blobs.resize(imgs.size());
+            int flag = flags[f];
+            utils::ThreadPool::current().parallel_for(imgs.size(), [&](int i) {
+                const ImageBlob& img = imgs[i];
+                cv::Mat im;
+                if (!img.mat.empty()) {
+                    im = img.mat;
+                } else if (img.in_memory()) {
+                    im = ImagePreProcessor::read_image(img, flag);
+                } else {
+                    im = _cache->get(img.name + (flag == cv::IMREAD_COLOR ? "#color" : "#unchanged"),
+                        [&img, flag] { return ImagePreProcessor::read_image(img, flag); });
+                }
+                if (im.empty()) {
+                    LOG(ERROR) << "Failed to open image: " << img.name;
+                    decoded = false;
+                }
+                blobs[i] = ImageBlob::from_mat(img.name, im);
+            });
+        }
+        if (!decoded) {
+            return -1;
+        }
+
+        // 2. run the models concurrently on the decoded images
+        for (auto slot : slots) {
+            int f = std::find(flags.begin(), flags.end(), slot->decode_flags) - flags.begin();
+            std::lock_guard<std::mutex> lock(slot->mutex);
+            slot->job = &_decoded[f];
+            slot->keep_results = results != nullptr;
+            slot->busy = true;
+            slot->cv.notify_all();
+        }
+        int ret = 0;
+        for (auto slot : slots) {
+            std::unique_lock<std::mutex> lock(slot->mutex);
+            slot->cv.wait(lock, [slot] { return !slot->busy; });
+            if (slot->ret != 0) {
+                LOG(ERROR) << "Fail to run model " << slot->config.name;
+                ret = -1;
+            }
+        }
+
+        // 3. gather the results by image
+        if (results != nullptr && ret == 0) {
+            int first = results->size();
+            results->resize(first + imgs.size());
+            for (int i = 0; i < imgs.size(); ++i) {
+                (*results)[first + i].name = imgs[i].name;
+            }
+            for (auto slot : slots) {
+                slot->model->collect(slot->config.name, &(*results)[first]);
+            }
+        }
+        for (auto& blobs : _decoded) {
+            blobs.clear();
+        }
+        return ret;
+    }
+
+    int MultiModelHost::predict(ImageSource& source, const std::vector<std::string>& models,
+                                std::vector<HostedResult>* results) {
+        int ret = 0;
+        while (source.next_batch(_imgs_batch, std::max(1, _config.batch_size)) > 0) {
+            if (predict(_imgs_batch, models, results) != 0) {
+                ret = -1;
+                source.failed(_imgs_batch.size());
+                continue;
+            }
+            source.done(_imgs_batch.size(), std::vector<int>());
+        }
+        std::cout << "decode cache: " << _cache->hits() << " hits, " << _cache->misses() << " misses" << std::endl;
+        return ret;
+    }
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <utils/image_source.h>
+#include <utils/prediction_result.h>
+#include <utils/decode_cache.h>
+#include <utils/thread_pool.h>
+
+namespace PaddleSolution {
+    // one model of a host config
+    struct HostedModelConfig {
+        HostedModelConfig() : weight(1) {
+        }
+
+        std::string name;
+        // seg, classify or detection
+        std::string type;
+        // DEPLOY config of the model
+        std::string conf;
+        // share of HOST.THREADS
+        int weight;
+    };
+
+    /* Host config, a yaml file listing the DEPLOY configs served together:
+     *
+     *     HOST:
+     *         THREADS: 16           # cpu threads split across the models, default: all cores
+     *         DECODE_CACHE_MB: 512  # decoded images kept for the models, default 256
+     *         BATCH_SIZE: 4         # images read per batch, default 1
+     *         MODELS:
+     *             - {NAME: "humanseg", TYPE: "seg", CONF: "conf/humanseg.yaml", WEIGHT: 2}
+     *             - {NAME: "classify", TYPE: "classify", CONF: "conf/classify.yaml", WEIGHT: 1}
+     */
+    struct HostConfig {
+        HostConfig() : threads(0), decode_cache_mb(256), batch_size(1) {
+        }
+
+        bool load(const std::string& file);
+
+        int threads;
+        int decode_cache_mb;
+        int batch_size;
+        std::vector<HostedModelConfig> models;
+    };
+
+    class HostedModel;
+
+    /* Several models in one process. Each input image is decoded once into a
+     * DecodeCache and handed to the requested models as a borrowed cv::Mat; the
+     * models run concurrently, each in its own thread with its own preprocessing
+     * ThreadPool, and HOST.THREADS is split across them by WEIGHT (that share is
+     * both the preprocessing threads and the Paddle math threads of the model).
+     */
+    class MultiModelHost {
+    public:
+        MultiModelHost();
+        ~MultiModelHost();
+
+        // load the host config and init all its models
+        int init(const std::string& host_conf);
+
+        // run the models named in `models` (all of them when empty) on `imgs`.
+        // With `results` null each model writes its outputs as its own demo does,
+        // otherwise one HostedResult per image is appended to `results`
+        int predict(const std::vector<ImageBlob>& imgs, const std::vector<std::string>& models,
+                    std::vector<HostedResult>* results = nullptr);
+        // same, for all the images of `source` in batches of HOST.BATCH_SIZE
+        int predict(ImageSource& source, const std::vector<std::string>& models,
+                    std::vector<HostedResult>* results = nullptr);
+
+        const utils::DecodeCache& decode_cache() const {
+            return *_cache;
+        }
+
+    private:
+        struct Slot;
+
+        void run_slot(Slot* slot);
+        void stop();
+
+        HostConfig _config;
+        std::unique_ptr<utils::DecodeCache> _cache;
+        std::vector<std::unique_ptr<Slot>> _slots;
+        std::vector<ImageBlob> _imgs_batch;
+        std::vector<std::vector<ImageBlob>> _decoded;
+    };
+}
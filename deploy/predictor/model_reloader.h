@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <glog/logging.h>
+
+#include <utils/seg_conf_parser.h>
+#include <utils/utils.h>
+
+namespace PaddleSolution {
+
+    namespace reload_internal {
+        // set by the SIGHUP handler, consumed by the reloader threads
+        inline std::atomic<int>& signal_count() {
+            static std::atomic<int> count(0);
+            return count;
+        }
+
+        inline void on_signal(int) {
+            ++signal_count();
+        }
+
+        // modification time of a file, 0 when it does not exist
+        inline time_t file_mtime(const std::string& path) {
+            struct stat st;
+            if (stat(path.c_str(), &st) != 0) {
+                return 0;
+            }
+            return st.st_mtime;
+        }
+    }
+
+    /* Watch a config file and the model it points to, and call `reload(conf)` on
+     * the predictor in a background thread when
+     *   - the process receives SIGHUP (not on Windows), or
+     *   - the config file, or the model or params file under its MODEL_PATH,
+     *     gets a new modification time.
+     * Works with Predictor, ClassifyPredictor and DetectionPredictor.
+     */
+    template <typename PredictorT>
+    class ModelReloader {
+    public:
+        ModelReloader(PredictorT& predictor, const std::string& conf)
+            : _predictor(predictor), _conf(conf), _stop(false), _signals(0), _stamp(0) {
+        }
+
+        ~ModelReloader() {
+            stop();
+        }
+
+        // `watch_signal`: reload on SIGHUP; `watch_model`: poll the files every `interval_ms`
+        void start(bool watch_signal, bool watch_model, int interval_ms = 1000) {
+#ifndef _WIN32
+            if (watch_signal) {
+                std::signal(SIGHUP, reload_internal::on_signal);
+            }
+#endif
+            _signals = reload_internal::signal_count();
+            _stamp = model_stamp();
+            _stop = false;
+            _thread = std::thread([this, watch_signal, watch_model, interval_ms] {
+                std::unique_lock<std::mutex> lock(_mutex);
+                while (!_cv.wait_for(lock, std::chrono::milliseconds(interval_ms), [this] { return _stop; })) {
+                    bool triggered = false;
+                    int signals = reload_internal::signal_count();
+                    if (watch_signal && signals != _signals) {
+                        triggered = true;
+                    }
+                    _signals = signals;
+                    time_t stamp = watch_model ? model_stamp() : 0;
+                    if (watch_model && stamp != _stamp) {
+                        triggered = true;
+                        _stamp = stamp;
+                    }
+                    if (triggered) {
+                        std::cout << "reload model with config [" << _conf << "]" << std::endl;
+                        _predictor.reload(_conf);
+                    }
+                }
+            });
+        }
+
+        void stop() {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _stop = true;
+            }
+            _cv.notify_all();
+            if (_thread.joinable()) {
+                _thread.join();
+            }
+        }
+
+    private:
+        // latest modification time of the config, model and params files
+        time_t model_stamp() {
+            time_t stamp = reload_internal::file_mtime(_conf);
+            PaddleSegModelConfigPaser config;
+            try {
+                config.load_config(_conf);
+            } catch (const std::exception& e) {
+                // a config being rewritten is picked up on the next poll
+                return _stamp;
+            }
+            const auto& model_dir = config._model_path;
+            stamp = std::max(stamp, reload_internal::file_mtime(utils::path_join(model_dir, config._model_file_name)));
+            stamp = std::max(stamp, reload_internal::file_mtime(utils::path_join(model_dir, config._param_file_name)));
+            return stamp;
+        }
+
+        PredictorT& _predictor;
+        std::string _conf;
+        std::thread _thread;
+        std::mutex _mutex;
+        std::condition_variable _cv;
+        bool _stop;
+        int _signals;
+        time_t _stamp;
+    };
+}
@@ -0,0 +1,275 @@
+#include "op_profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+namespace PaddleSolution {
+
+    namespace {
+#ifdef _WIN32
+        int dup_fd(int fd) { return _dup(fd); }
+        int dup2_fd(int from, int to) { return _dup2(from, to); }
+        int close_fd(int fd) { return _close(fd); }
+        int file_fd(std::FILE* file) { return _fileno(file); }
+#else
+        int dup_fd(int fd) { return dup(fd); }
+        int dup2_fd(int from, int to) { return dup2(from, to); }
+        int close_fd(int fd) { return close(fd); }
+        int file_fd(std::FILE* file) { return fileno(file); }
+#endif
+
+        // run `fn` and return what it printed to stdout, Paddle prints the
+        // profile summary there
+        std::string capture_stdout(const std::function<void()>& fn) {
+            std::cout.flush();
+            fflush(stdout);
+            std::FILE* tmp = tmpfile();
+            int saved = tmp != nullptr ? dup_fd(file_fd(stdout)) : -1;
+            if (saved < 0) {
+                if (tmp != nullptr) {
+                    fclose(tmp);
+                }
+                fn();
+                return "";
+            }
+            dup2_fd(file_fd(tmp), file_fd(stdout));
+            fn();
+            std::cout.flush();
+            fflush(stdout);
+            dup2_fd(saved, file_fd(stdout));
+            close_fd(saved);
+
+            std::string text;
+            rewind(tmp);
+            char buffer[4096];
+            size_t n = 0;
+            while ((n = fread(buffer, 1, sizeof(buffer), tmp)) > 0) {
+                text.append(buffer, n);
+            }
+            fclose(tmp);
+            return text;
+        }
+
+        // NativePaddlePredictor profiles when the gflag `profile` of Paddle is
+        // set, at creation and at destruction
+        bool set_native_profile(bool on) {
+            return !google::SetCommandLineOption("profile", on ? "true" : "false").empty();
+        }
+
+        std::string json_escape(const std::string& text) {
+            std::string escaped;
+            for (char c : text) {
+                if (c == '"' || c == '\\') {
+                    escaped += '\\';
+                }
+                escaped += c;
+            }
+            return escaped;
+        }
+    }
+
+    std::vector<OpTime> parse_op_profile(const std::string& report) {
+        // Event  Calls  Total  [CPU Time (Ratio)  GPU Time (Ratio)]  Min.  Max.  Ave.  Ratio.
+        // thread0::conv2d  40  123.4  ...
+        std::map<std::string, OpTime> ops;
+        std::istringstream in(report);
+        std::string line;
+        bool table = false;
+        while (std::getline(in, line)) {
+            std::istringstream fields(line);
+            std::string name;
+            if (!(fields >> name)) {
+                table = false;
+                continue;
+            }
+            if (name == "Event") {
+                table = true;
+                continue;
+            }
+            if (!table || name[0] == '-' || name[0] == '=') {
+                continue;
+            }
+            long long calls = 0;
+            double total = 0;
+            if (!(fields >> calls >> total)) {
+                table = false;
+                continue;
+            }
+            size_t pos = name.find("::");
+            if (pos != std::string::npos) {
+                name = name.substr(pos + 2);
+            }
+            // nested events (conv2d/compute) are counted in their parent
+            if (name.find('/') != std::string::npos) {
+                continue;
+            }
+            OpTime& op = ops[name];
+            op.name = name;
+            op.calls += calls;
+            op.total_ms += total;
+        }
+        std::vector<OpTime> sorted;
+        for (const auto& op : ops) {
+            sorted.push_back(op.second);
+        }
+        std::sort(sorted.begin(), sorted.end(), [](const OpTime& a, const OpTime& b) {
+            return a.total_ms > b.total_ms;
+        });
+        return sorted;
+    }
+
+    OpProfiler::OpProfiler()
+        : _enabled(false), _native(false), _start_batch(0), _batches(0), _batch(0),
+          _profiling(false), _in_batch(false), _done(false), _profiled_batches(0), _batch_us(0), _run_us(0) {
+    }
+
+    void OpProfiler::init(const PaddleSegModelConfigPaser& config) {
+        _enabled = config._profile != 0 && config._profile_batches > 0;
+        _native = config._predictor_mode == "NATIVE";
+        _start_batch = config._profile_start_batch;
+        _batches = config._profile_batches;
+        _output = config._profile_output;
+        _batch = 0;
+        _done = false;
+        _profiled_batches = 0;
+        _batch_us = 0;
+        _run_us = 0;
+    }
+
+    void OpProfiler::before_batch(std::unique_ptr<paddle::PaddlePredictor>* predictor, const Factory& create_profiled) {
+        if (!_enabled || _done) {
+            return;
+        }
+        // a batch without after_batch() failed, it is not counted
+        _in_batch = false;
+        if (!_profiling && _batch++ >= _start_batch && !begin(predictor, create_profiled)) {
+            _done = true;
+            return;
+        }
+        if (_profiling) {
+            _in_batch = true;
+            _batch_start = std::chrono::steady_clock::now();
+        }
+    }
+
+    void OpProfiler::add_run_time(int64_t run_us) {
+        if (_in_batch) {
+            _run_us += run_us;
+        }
+    }
+
+    void OpProfiler::after_batch(std::unique_ptr<paddle::PaddlePredictor>* predictor) {
+        if (!_in_batch) {
+            return;
+        }
+        _in_batch = false;
+        _batch_us += std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - _batch_start).count();
+        if (++_profiled_batches >= _batches) {
+            finish(predictor);
+        }
+    }
+
+    bool OpProfiler::begin(std::unique_ptr<paddle::PaddlePredictor>* predictor, const Factory& create_profiled) {
+        if (_native && !set_native_profile(true)) {
+            LOG(WARNING) << "DEPLOY.PROFILE: this Paddle library has no profile flag for NATIVE predictors";
+            return false;
+        }
+        std::unique_ptr<paddle::PaddlePredictor> profiled = create_profiled();
+        if (_native) {
+            set_native_profile(false);
+        }
+        if (profiled == nullptr) {
+            LOG(WARNING) << "DEPLOY.PROFILE: fail to create the profiled predictor";
+            return false;
+        }
+        std::cout << "profile operators of batches [" << _start_batch << ", "
+            << _start_batch + _batches << ")" << std::endl;
+        _plain = std::move(*predictor);
+        *predictor = std::move(profiled);
+        _profiling = true;
+        return true;
+    }
+
+    void OpProfiler::finish(std::unique_ptr<paddle::PaddlePredictor>* predictor) {
+        if (!_profiling) {
+            return;
+        }
+        _profiling = false;
+        _in_batch = false;
+        _done = true;
+        std::unique_ptr<paddle::PaddlePredictor> profiled = std::move(*predictor);
+        *predictor = std::move(_plain);
+        // the summary is printed when the profiled predictor is destroyed
+        std::string summary = capture_stdout([&]() {
+            if (_native) {
+                set_native_profile(true);
+            }
+            profiled.reset();
+            if (_native) {
+                set_native_profile(false);
+            }
+        });
+        report(summary);
+    }
+
+    void OpProfiler::report(const std::string& summary) const {
+        std::vector<OpTime> ops = parse_op_profile(summary);
+        if (ops.empty()) {
+            LOG(WARNING) << "DEPLOY.PROFILE: no operator summary in the Paddle output";
+            std::cout << summary;
+            return;
+        }
+        double ops_ms = 0;
+        for (const auto& op : ops) {
+            ops_ms += op.total_ms;
+        }
+        double batch_ms = _batch_us / 1000.0;
+        double run_ms = _run_us / 1000.0;
+        std::cout << "op profile of " << _profiled_batches << " batches: batches " << batch_ms
+            << " ms, Run " << run_ms << " ms, outside Run " << batch_ms - run_ms
+            << " ms, operators " << ops_ms << " ms" << std::endl;
+        printf("%-40s %10s %12s %10s %8s\n", "operator", "calls", "total(ms)", "avg(ms)", "ratio");
+        for (const auto& op : ops) {
+            printf("%-40s %10lld %12.3f %10.3f %7.2f%%\n", op.name.c_str(), static_cast<long long>(op.calls),
+                   op.total_ms, op.calls > 0 ? op.total_ms / op.calls : 0.0,
+                   ops_ms > 0 ? op.total_ms * 100 / ops_ms : 0.0);
+        }
+        fflush(stdout);
+
+        if (_output.empty()) {
+            return;
+        }
+        std::FILE* fp = fopen(_output.c_str(), "w");
+        if (fp == nullptr) {
+            LOG(ERROR) << "Fail to write the op profile: " << _output;
+            return;
+        }
+        fprintf(fp, "{\n  \"start_batch\": %lld,\n  \"batches\": %lld,\n",
+                static_cast<long long>(_start_batch), static_cast<long long>(_profiled_batches));
+        fprintf(fp, "  \"stages_ms\": {\"batches\": %.3f, \"run\": %.3f, \"outside_run\": %.3f, \"operators\": %.3f},\n",
+                batch_ms, run_ms, batch_ms - run_ms, ops_ms);
+        fprintf(fp, "  \"ops\": [");
+        for (size_t i = 0; i < ops.size(); ++i) {
+            const OpTime& op = ops[i];
+            fprintf(fp, "%s\n    {\"name\": \"%s\", \"calls\": %lld, \"total_ms\": %.3f, \"avg_ms\": %.3f, \"ratio\": %.4f}",
+                    i == 0 ? "" : ",", json_escape(op.name).c_str(), static_cast<long long>(op.calls), op.total_ms,
+                    op.calls > 0 ? op.total_ms / op.calls : 0.0, ops_ms > 0 ? op.total_ms / ops_ms : 0.0);
+        }
+        fprintf(fp, "\n  ]\n}\n");
+        fclose(fp);
+        std::cout << "op profile written to " << _output << std::endl;
+    }
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <paddle_inference_api.h>
+
+#include <utils/seg_conf_parser.h>
+
+namespace PaddleSolution {
+    // time of one operator type over the profiled batches
+    struct OpTime {
+        std::string name;
+        int64_t calls;
+        double total_ms;
+    };
+
+    // parse the per operator summary Paddle prints when a profiled predictor is
+    // destroyed, summed over the threads and sorted by total time
+    std::vector<OpTime> parse_op_profile(const std::string& report);
+
+    /* DEPLOY.PROFILE: the Paddle operator profiler over a window of batches.
+     *
+     * Paddle profiles a predictor from its creation to its destruction, so at
+     * the first batch of the window the predict loop switches to a predictor
+     * created with profiling on and at the end of the window back to the
+     * plain one. Destroying the profiled predictor prints the operator
+     * summary, which is captured, printed as a table next to the time of the
+     * batches and of Run(), and written to DEPLOY.PROFILE.OUTPUT as JSON.
+     * The Paddle profiler is global to the process, only one predictor at a
+     * time may profile.
+     */
+    class OpProfiler {
+    public:
+        typedef std::function<std::unique_ptr<paddle::PaddlePredictor>()> Factory;
+
+        OpProfiler();
+
+        // also starts the window over, call it when no window is open
+        void init(const PaddleSegModelConfigPaser& config);
+        // no window at all, for a model that is only warmed up before a reload
+        void disable() {
+            _enabled = false;
+        }
+
+        // call before and after each batch of the predict loops, `create_profiled`
+        // builds the predictor of the window
+        void before_batch(std::unique_ptr<paddle::PaddlePredictor>* predictor, const Factory& create_profiled);
+        void after_batch(std::unique_ptr<paddle::PaddlePredictor>* predictor);
+        // time of the Run() of the current batch
+        void add_run_time(int64_t run_us);
+        // close the window early, before `predictor` is released or replaced
+        void finish(std::unique_ptr<paddle::PaddlePredictor>* predictor);
+
+    private:
+        OpProfiler(const OpProfiler&);
+        OpProfiler& operator=(const OpProfiler&);
+
+        bool begin(std::unique_ptr<paddle::PaddlePredictor>* predictor, const Factory& create_profiled);
+        void report(const std::string& summary) const;
+
+        bool _enabled;
+        bool _native;
+        int64_t _start_batch;
+        int64_t _batches;
+        std::string _output;
+
+        // batches seen by before_batch()
+        int64_t _batch;
+        bool _profiling;
+        bool _in_batch;
+        bool _done;
+        // the plain predictor while the profiled one runs
+        std::unique_ptr<paddle::PaddlePredictor> _plain;
+        std::chrono::steady_clock::time_point _batch_start;
+        int64_t _profiled_batches;
+        int64_t _batch_us;
+        int64_t _run_us;
+    };
+}
@@ -0,0 +1,125 @@
+#include "quantizer.h"
+
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <unordered_set>
+
+#include <glog/logging.h>
+
+namespace PaddleSolution {
+
+    // file layout, native byte order:
+    //     magic | uint32 count | count x (uint32 name_len | name | int32 dtype |
+    //     uint32 ndims | int32 dims[ndims] | uint64 byte_len | data)
+    static const char kWarmupMagic[8] = {'P', 'S', 'W', 'A', 'R', 'M', 'U', 'P'};
+
+    template <typename T>
+    static void write_pod(std::ofstream& out, const T& value) {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template <typename T>
+    static bool read_pod(std::ifstream& in, T* value) {
+        return static_cast<bool>(in.read(reinterpret_cast<char*>(value), sizeof(*value)));
+    }
+
+    bool write_warmup_data(const std::string& file, const std::vector<paddle::PaddleTensor>& tensors) {
+        std::ofstream out(file, std::ios::out | std::ios::trunc | std::ios::binary);
+        if (!out) {
+            LOG(ERROR) << "Fail to create warmup data: " << file;
+            return false;
+        }
+        out.write(kWarmupMagic, sizeof(kWarmupMagic));
+        write_pod(out, static_cast<uint32_t>(tensors.size()));
+        for (const auto& tensor : tensors) {
+            write_pod(out, static_cast<uint32_t>(tensor.name.size()));
+            out.write(tensor.name.data(), tensor.name.size());
+            write_pod(out, static_cast<int32_t>(tensor.dtype));
+            write_pod(out, static_cast<uint32_t>(tensor.shape.size()));
+            for (auto dim : tensor.shape) {
+                write_pod(out, static_cast<int32_t>(dim));
+            }
+            write_pod(out, static_cast<uint64_t>(tensor.data.length()));
+            out.write(static_cast<const char*>(tensor.data.data()), tensor.data.length());
+        }
+        out.close();
+        return !out.fail();
+    }
+
+    bool read_warmup_data(const std::string& file, std::vector<paddle::PaddleTensor>* tensors) {
+        std::ifstream in(file, std::ios::in | std::ios::binary);
+        char magic[sizeof(kWarmupMagic)];
+        uint32_t count = 0;
+        if (!in || !in.read(magic, sizeof(magic)) || memcmp(magic, kWarmupMagic, sizeof(magic)) != 0
+            || !read_pod(in, &count)) {
+            LOG(ERROR) << "Invalid warmup data: " << file;
+            return false;
+        }
+        tensors->resize(count);
+        for (auto& tensor : *tensors) {
+            uint32_t name_len = 0;
+            int32_t dtype = 0;
+            uint32_t ndims = 0;
+            uint64_t byte_len = 0;
+            if (!read_pod(in, &name_len)) {
+                return false;
+            }
+            tensor.name.resize(name_len);
+            if (name_len > 0 && !in.read(&tensor.name[0], name_len)) {
+                return false;
+            }
+            if (!read_pod(in, &dtype) || !read_pod(in, &ndims)) {
+                return false;
+            }
+            tensor.dtype = static_cast<paddle::PaddleDType>(dtype);
+            tensor.shape.resize(ndims);
+            for (auto& dim : tensor.shape) {
+                int32_t value = 0;
+                if (!read_pod(in, &value)) {
+                    return false;
+                }
+                dim = value;
+            }
+            if (!read_pod(in, &byte_len)) {
+                return false;
+            }
+            tensor.data.Resize(byte_len);
+            if (!in.read(static_cast<char*>(tensor.data.data()), byte_len)) {
+                LOG(ERROR) << "Truncated warmup data: " << file;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool enable_quantizer(const PaddleSegModelConfigPaser& model_config, paddle::AnalysisConfig* config) {
+        if (!model_config._quantize) {
+            return true;
+        }
+        if (model_config._use_gpu) {
+            LOG(ERROR) << "DEPLOY.QUANTIZE only supports CPU inference, set USE_GPU to 0";
+            return false;
+        }
+        auto warmup_data = std::make_shared<std::vector<paddle::PaddleTensor>>();
+        if (!read_warmup_data(model_config._quantize_warmup_data, warmup_data.get())
+            || warmup_data->empty()) {
+            LOG(ERROR) << "Fail to load DEPLOY.QUANTIZE.WARMUP_DATA, run quantize_tool to create it";
+            return false;
+        }
+        int warmup_batch_size = model_config._quantize_warmup_batch_size;
+        if (warmup_batch_size <= 0) {
+            warmup_batch_size = warmup_data->front().shape.empty() ? 1 : warmup_data->front().shape[0];
+        }
+        config->EnableMKLDNN();
+        config->EnableMkldnnQuantizer();
+        config->mkldnn_quantizer_config()->SetWarmupData(warmup_data);
+        config->mkldnn_quantizer_config()->SetWarmupBatchSize(warmup_batch_size);
+        if (!model_config._quantize_op_types.empty()) {
+            std::unordered_set<std::string> op_types(model_config._quantize_op_types.begin(),
+                model_config._quantize_op_types.end());
+            config->mkldnn_quantizer_config()->SetEnabledOpTypes(op_types);
+        }
+        return true;
+    }
+}
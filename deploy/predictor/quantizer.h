@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <paddle_inference_api.h>
+
+#include <utils/seg_conf_parser.h>
+
+namespace PaddleSolution {
+    /* INT8 inference on CPU through the MKL-DNN quantizer of AnalysisConfig.
+     *
+     * The quantizer computes the INT8 scales when the predictor is created, by
+     * running the FP32 model over a warmup batch. quantize_tool preprocesses a
+     * local calibration image set once and caches that batch in
+     * DEPLOY.QUANTIZE.WARMUP_DATA, so later inits skip decoding and preprocessing
+     * and only pay for the scale computation.
+     */
+
+    // save the input tensors of a warmup batch
+    bool write_warmup_data(const std::string& file, const std::vector<paddle::PaddleTensor>& tensors);
+
+    // load the input tensors saved by write_warmup_data
+    bool read_warmup_data(const std::string& file, std::vector<paddle::PaddleTensor>* tensors);
+
+    // turn on the INT8 quantizer if DEPLOY.QUANTIZE.ENABLE is set, return false if
+    // it is requested but cannot be used (GPU predictor, missing warmup data)
+    bool enable_quantizer(const PaddleSegModelConfigPaser& model_config, paddle::AnalysisConfig* config);
+}
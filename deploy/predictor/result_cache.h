@@ -0,0 +1,377 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <xxhash.h>
+#include <glog/logging.h>
+#include <opencv2/core/core.hpp>
+
+#include <utils/seg_conf_parser.h>
+#include <utils/utils.h>
+#include <utils/thread_pool.h>
+#include <utils/image_source.h>
+#include <utils/content_hash.h>
+#include <utils/prediction_result.h>
+
+namespace PaddleSolution {
+
+    namespace result_cache_internal {
+        template <typename T>
+        void write_pod(std::string* out, const T& value) {
+            out->append(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        template <typename T>
+        bool read_pod(const std::string& in, size_t* pos, T* value) {
+            if (*pos + sizeof(T) > in.size()) {
+                return false;
+            }
+            memcpy(value, in.data() + *pos, sizeof(T));
+            *pos += sizeof(T);
+            return true;
+        }
+
+        inline void write_mat(std::string* out, const cv::Mat& mat) {
+            cv::Mat continuous = mat.isContinuous() ? mat : mat.clone();
+            write_pod(out, static_cast<int32_t>(continuous.rows));
+            write_pod(out, static_cast<int32_t>(continuous.cols));
+            write_pod(out, static_cast<int32_t>(continuous.type()));
+            out->append(reinterpret_cast<const char*>(continuous.data), continuous.total() * continuous.elemSize());
+        }
+
+        inline bool read_mat(const std::string& in, size_t* pos, cv::Mat* mat) {
+            int32_t rows = 0;
+            int32_t cols = 0;
+            int32_t type = 0;
+            if (!read_pod(in, pos, &rows) || !read_pod(in, pos, &cols) || !read_pod(in, pos, &type)) {
+                return false;
+            }
+            cv::Mat result(rows, cols, type);
+            size_t bytes = result.total() * result.elemSize();
+            if (*pos + bytes > in.size()) {
+                return false;
+            }
+            memcpy(result.data, in.data() + *pos, bytes);
+            *pos += bytes;
+            *mat = result;
+            return true;
+        }
+
+        // `seed` combined with the size and modification time of a file, `seed`
+        // itself when the file does not exist
+        inline uint64_t file_stamp(const std::string& path, uint64_t seed) {
+            struct stat st;
+            if (stat(path.c_str(), &st) != 0) {
+                return seed;
+            }
+            uint64_t stamp[2] = { static_cast<uint64_t>(st.st_size), static_cast<uint64_t>(st.st_mtime) };
+            return XXH64(stamp, sizeof(stamp), seed);
+        }
+    }
+
+    // on-disk form of the cached results, the image name is not stored
+    inline void serialize_result(const SegResult& result, std::string* out) {
+        result_cache_internal::write_pod(out, static_cast<int32_t>(result.ori_width));
+        result_cache_internal::write_pod(out, static_cast<int32_t>(result.ori_height));
+        result_cache_internal::write_mat(out, result.mask);
+        result_cache_internal::write_mat(out, result.scoremap);
+    }
+
+    inline bool parse_result(const std::string& in, SegResult* result) {
+        size_t pos = 0;
+        int32_t width = 0;
+        int32_t height = 0;
+        if (!result_cache_internal::read_pod(in, &pos, &width) || !result_cache_internal::read_pod(in, &pos, &height)) {
+            return false;
+        }
+        result->ori_width = width;
+        result->ori_height = height;
+        return result_cache_internal::read_mat(in, &pos, &result->mask)
+            && result_cache_internal::read_mat(in, &pos, &result->scoremap);
+    }
+
+    inline void serialize_result(const ClassifyResult& result, std::string* out) {
+        result_cache_internal::write_pod(out, static_cast<int32_t>(result.label));
+        result_cache_internal::write_pod(out, result.score);
+        out->append(reinterpret_cast<const char*>(result.scores.data()), result.scores.size() * sizeof(float));
+    }
+
+    inline bool parse_result(const std::string& in, ClassifyResult* result) {
+        size_t pos = 0;
+        int32_t label = 0;
+        if (!result_cache_internal::read_pod(in, &pos, &label) || !result_cache_internal::read_pod(in, &pos, &result->score)) {
+            return false;
+        }
+        result->label = label;
+        result->scores.resize((in.size() - pos) / sizeof(float));
+        memcpy(result->scores.data(), in.data() + pos, result->scores.size() * sizeof(float));
+        set_top_k(result);
+        return true;
+    }
+
+    inline void serialize_result(const DetectionResult& result, std::string* out) {
+        DetectionResult boxes(result);
+        boxes.clear_filename();
+        boxes.AppendToString(out);
+    }
+
+    inline bool parse_result(const std::string& in, DetectionResult* result) {
+        return result->ParseFromString(in);
+    }
+
+    inline void set_result_name(const std::string& name, SegResult* result) {
+        result->name = name;
+    }
+
+    inline void set_result_name(const std::string& name, ClassifyResult* result) {
+        result->name = name;
+    }
+
+    inline void set_result_name(const std::string& name, DetectionResult* result) {
+        result->set_filename(name);
+    }
+
+    // hash of everything the results of a model depend on besides the image: the
+    // config file contents and the size and mtime of the model and params files
+    inline uint64_t model_fingerprint(const std::string& conf, const PaddleSegModelConfigPaser& config) {
+        std::ifstream in(conf, std::ios::in | std::ios::binary);
+        std::stringstream contents;
+        contents << in.rdbuf();
+        std::string text = contents.str();
+        uint64_t fingerprint = XXH64(text.data(), text.size(), 0);
+        const auto& model_dir = config._model_path;
+        fingerprint = result_cache_internal::file_stamp(utils::path_join(model_dir, config._model_file_name), fingerprint);
+        fingerprint = result_cache_internal::file_stamp(utils::path_join(model_dir, config._param_file_name), fingerprint);
+        return fingerprint;
+    }
+
+    struct ResultCacheStats {
+        ResultCacheStats() : hits(0), disk_hits(0), misses(0) {
+        }
+
+        // found in memory
+        uint64_t hits;
+        // found on disk only
+        uint64_t disk_hits;
+        uint64_t misses;
+    };
+
+    /* Results by image content (DEPLOY.RESULT_CACHE): the key is the xxhash64 of
+     * the encoded bytes (or of the pixels of a decoded image) seeded with the
+     * model fingerprint, so a new model or config never returns stale results.
+     * The last `capacity` results are kept in memory; with a `disk_dir` every
+     * result is also written there as `<key>.res` and read back on a memory miss.
+     * Files in `disk_dir` are never removed by the cache.
+     */
+    template <typename ResultT>
+    class ResultCache {
+    public:
+        ResultCache(uint64_t fingerprint, int capacity, const std::string& disk_dir)
+            : _fingerprint(fingerprint), _capacity(std::max(1, capacity)), _disk_dir(disk_dir),
+            _retired(false), _hits(0), _disk_hits(0), _misses(0) {
+        }
+
+        // called when the predictor switches to a reloaded model: results predicted
+        // from now on may come from the new model, put() drops them
+        void retire() {
+            _retired = true;
+        }
+
+        // key of an image, see utils::content_hash; returns false when the
+        // file cannot be read
+        bool key(ImageBlob* blob, uint64_t* key) const {
+            return utils::content_hash(blob, _fingerprint, key);
+        }
+
+        bool get(uint64_t key, ResultT* result) {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                auto it = _index.find(key);
+                if (it != _index.end()) {
+                    _lru.splice(_lru.begin(), _lru, it->second);
+                    *result = it->second->second;
+                    ++_hits;
+                    return true;
+                }
+            }
+            if (!_disk_dir.empty()) {
+                std::ifstream in(disk_path(key), std::ios::in | std::ios::binary);
+                std::stringstream contents;
+                if (in && (contents << in.rdbuf()) && parse_result(contents.str(), result)) {
+                    insert(key, *result);
+                    ++_disk_hits;
+                    return true;
+                }
+            }
+            ++_misses;
+            return false;
+        }
+
+        void put(uint64_t key, const ResultT& result) {
+            if (_retired) {
+                return;
+            }
+            insert(key, result);
+            if (_disk_dir.empty()) {
+                return;
+            }
+            std::string data;
+            serialize_result(result, &data);
+            // write then rename, so readers never see a partial file
+            std::string path = disk_path(key);
+            std::string tmp = path + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+            {
+                std::ofstream out(tmp, std::ios::out | std::ios::trunc | std::ios::binary);
+                out.write(data.data(), data.size());
+                if (!out) {
+                    LOG(WARNING) << "Fail to write the result cache file: " << tmp;
+                    return;
+                }
+            }
+            std::rename(tmp.c_str(), path.c_str());
+        }
+
+        ResultCacheStats stats() const {
+            ResultCacheStats stats;
+            stats.hits = _hits;
+            stats.disk_hits = _disk_hits;
+            stats.misses = _misses;
+            return stats;
+        }
+
+    private:
+        void insert(uint64_t key, const ResultT& result) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto it = _index.find(key);
+            if (it != _index.end()) {
+                _lru.splice(_lru.begin(), _lru, it->second);
+                return;
+            }
+            _lru.push_front(std::make_pair(key, result));
+            _index[key] = _lru.begin();
+            if (_lru.size() > _capacity) {
+                _index.erase(_lru.back().first);
+                _lru.pop_back();
+            }
+        }
+
+        std::string disk_path(uint64_t key) const {
+            char name[32];
+            snprintf(name, sizeof(name), "%016llx.res", static_cast<unsigned long long>(key));
+            return utils::path_join(_disk_dir, name);
+        }
+
+        typedef std::list<std::pair<uint64_t, ResultT>> LruList;
+
+        uint64_t _fingerprint;
+        size_t _capacity;
+        std::string _disk_dir;
+        std::mutex _mutex;
+        LruList _lru;
+        std::unordered_map<uint64_t, typename LruList::iterator> _index;
+        std::atomic<bool> _retired;
+        std::atomic<uint64_t> _hits;
+        std::atomic<uint64_t> _disk_hits;
+        std::atomic<uint64_t> _misses;
+    };
+
+    /* Predict the images of `source` through `cache`, batch by batch: cached
+     * images skip decoding and inference, the others go through
+     * `predict_misses(imgs, results, failed)` and are added to the cache, but
+     * the ones it reports in `failed` (positions in `imgs`). All the results
+     * are appended to `results` in input order, or passed to `write` when
+     * `results` is null. An image that cannot be read or that `predict_misses`
+     * failed gets an empty result, only named, and is not written; `source`
+     * is told through done().
+     */
+    template <typename ResultT, typename PredictFn, typename WriteFn>
+    int cached_predict(ResultCache<ResultT>& cache, ImageSource& source, int batch_size,
+                       std::vector<ResultT>* results, PredictFn predict_misses, WriteFn write) {
+        std::vector<ImageBlob> batch;
+        std::vector<uint64_t> keys;
+        std::vector<ResultT> batch_results;
+        std::vector<ImageBlob> misses;
+        std::vector<int> miss_index;
+        std::vector<ResultT> miss_results;
+        std::vector<int> miss_failed;
+        // 1 at the positions in the batch of the images that failed
+        std::vector<char> failed_at;
+        std::vector<int> failed;
+        while (source.next_batch(batch, std::max(1, batch_size)) > 0) {
+            // 1. hash the images, reading the files in parallel
+            keys.resize(batch.size());
+            failed_at.assign(batch.size(), 0);
+            utils::ThreadPool::current().parallel_for(batch.size(), [&](int i) {
+                if (!cache.key(&batch[i], &keys[i])) {
+                    LOG(ERROR) << "Failed to open image: " << batch[i].name;
+                    failed_at[i] = 1;
+                }
+            });
+
+            // 2. look them up
+            batch_results.assign(batch.size(), ResultT());
+            misses.clear();
+            miss_index.clear();
+            for (int i = 0; i < batch.size(); ++i) {
+                if (!failed_at[i] && !cache.get(keys[i], &batch_results[i])) {
+                    misses.push_back(batch[i]);
+                    miss_index.push_back(i);
+                }
+            }
+
+            // 3. predict the others, the failed ones are not cached
+            if (!misses.empty()) {
+                miss_results.clear();
+                miss_failed.clear();
+                if (predict_misses(misses, &miss_results, &miss_failed) != 0
+                    || miss_results.size() != misses.size()) {
+                    return -1;
+                }
+                size_t f = 0;
+                for (int k = 0; k < misses.size(); ++k) {
+                    if (f < miss_failed.size() && miss_failed[f] == k) {
+                        failed_at[miss_index[k]] = 1;
+                        ++f;
+                        continue;
+                    }
+                    cache.put(keys[miss_index[k]], miss_results[k]);
+                    batch_results[miss_index[k]] = miss_results[k];
+                }
+            }
+
+            auto stats = cache.stats();
+            std::cout << "result cache: hits = " << stats.hits << ", disk hits = " << stats.disk_hits
+                << ", misses = " << stats.misses << std::endl;
+            failed.clear();
+            for (int i = 0; i < batch.size(); ++i) {
+                if (failed_at[i]) {
+                    failed.push_back(i);
+                }
+                set_result_name(batch[i].name, &batch_results[i]);
+                if (results != nullptr) {
+                    results->push_back(batch_results[i]);
+                } else if (!failed_at[i]) {
+                    write(batch_results[i]);
+                }
+            }
+            source.done(batch.size(), failed);
+        }
+        return 0;
+    }
+}
@@ -1,21 +1,75 @@
 #include "seg_predictor.h"
 
+#include <cstring>
+
 namespace PaddleSolution {
 
+        Predictor::~Predictor() {
+            // report a profile window cut short by the end of the input
+            _op_profiler.finish(&_main_predictor);
+        }
+
         int Predictor::init(const std::string& conf) {
             if (!_model_config.load_config(conf)) {
-                LOG(FATAL) << "Fail to load config file: [" << conf << "]";
+                LOG(ERROR) << "Fail to load config file: [" << conf << "]";
                 return -1;
             }
             _preprocessor = PaddleSolution::create_processor(conf);
             if (_preprocessor == nullptr) {
-                LOG(FATAL) << "Failed to create_processor";
+                LOG(ERROR) << "Failed to create_processor";
+                return -1;
+            }
+            const auto& input_dtype = _model_config._input_dtype;
+            const auto& input_layout = _model_config._input_layout;
+            if ((input_dtype != "FLOAT32" && input_dtype != "UINT8")
+                || (input_layout != "NCHW" && input_layout != "NHWC")
+                || (input_layout == "NHWC" && input_dtype != "UINT8")) {
+                LOG(ERROR) << "Unsupported input: INPUT_DTYPE " << input_dtype << ", INPUT_LAYOUT " << input_layout;
                 return -1;
             }
 
             _mask.resize(_model_config._resize[0] * _model_config._resize[1]);
             _scoremap.resize(_model_config._resize[0] * _model_config._resize[1]);
+            if (_model_config._result_cache) {
+                _result_cache = std::make_shared<ResultCache<SegResult>>(model_fingerprint(conf, _model_config),
+                    _model_config._result_cache_capacity, _model_config._result_cache_dir);
+            }
 
+            // DEPLOY.MEMORY: place the batch buffers and, with PREFAULT, fault them in
+            // now rather than in the first batches
+            utils::MemoryResidency residency;
+            if (!utils::memory_residency(_model_config, &residency)) {
+                return -1;
+            }
+            std::size_t input_size = 0;
+            std::size_t output_size = 0;
+            if (_model_config._memory_prefault) {
+                std::size_t pixels = static_cast<std::size_t>(_model_config._batch_size)
+                    * _model_config._resize[0] * _model_config._resize[1];
+                input_size = pixels * _model_config._channels;
+                // the score maps copied out in ANALYSIS mode
+                output_size = _model_config._predictor_mode == "ANALYSIS" ? pixels * _model_config._class_num : 0;
+            }
+            bool u8_input = input_dtype == "UINT8";
+            utils::place_buffer(&_buffer, residency, u8_input ? 0 : input_size);
+            utils::place_buffer(&_u8_buffer, residency, u8_input ? input_size : 0);
+            utils::place_buffer(&_arena.out_data, residency, output_size);
+
+            _op_profiler.init(_model_config);
+            _memory_planner.init(_model_config);
+            _batch_controller.init(_model_config);
+            utils::MappingSnapshot mappings;
+            _main_predictor = create_paddle_predictor(false);
+            if (_main_predictor == nullptr) {
+                return -1;
+            }
+            if (_model_config._memory_lock > 1) {
+                mappings.lock_new();
+            }
+            return 0;
+        }
+
+        std::unique_ptr<paddle::PaddlePredictor> Predictor::create_paddle_predictor(bool profile) {
             bool use_gpu = _model_config._use_gpu;
             const auto& model_dir = _model_config._model_path;
             const auto& model_filename = _model_config._model_file_name;
@@ -31,7 +85,10 @@ namespace PaddleSolution {
                 config.fraction_of_gpu_memory = 0;
                 config.use_gpu = use_gpu;
                 config.device = 0;
-                _main_predictor = paddle::CreatePaddlePredictor(config);
+                if (_cpu_math_threads > 0) {
+                    config.SetCpuMathLibraryNumThreads(_cpu_math_threads);
+                }
+                return paddle::CreatePaddlePredictor(config);
             }
             else if (_model_config._predictor_mode == "ANALYSIS") {
                 paddle::AnalysisConfig config;
@@ -41,27 +98,173 @@ namespace PaddleSolution {
                 auto prog_file = utils::path_join(model_dir, model_filename);
                 auto param_file = utils::path_join(model_dir, params_filename);
                 config.SetModel(prog_file, param_file);
+                if (_cpu_math_threads > 0) {
+                    config.SetCpuMathLibraryNumThreads(_cpu_math_threads);
+                }
                 config.SwitchUseFeedFetchOps(false);
-                _main_predictor = paddle::CreatePaddlePredictor(config);
+                if (profile) {
+                    config.EnableProfile();
+                }
+                if (!enable_quantizer(_model_config, &config)) {
+                    return nullptr;
+                }
+                return paddle::CreatePaddlePredictor(config);
+            }
+            return nullptr;
+        }
+
+        int Predictor::reload(const std::string& conf) {
+            std::unique_ptr<Predictor> fresh(new Predictor());
+            fresh->_cpu_math_threads = _cpu_math_threads;
+            // a broken config or model must not take the running service down
+            try {
+                if (fresh->init(conf) != 0) {
+                    LOG(ERROR) << "Fail to reload model with config: [" << conf << "]";
+                    return -1;
+                }
+            } catch (const std::exception& e) {
+                LOG(ERROR) << "Fail to reload model with config: [" << conf << "]: " << e.what();
+                return -1;
             }
-            else {
+            // warm up with a blank image so the first real batch does not pay for it,
+            // past the result cache and the operator profiler so neither records it
+            fresh->_op_profiler.disable();
+            const auto& crop_size = fresh->_model_config._crop_size;
+            std::vector<ImageBlob> warmup_imgs(1, ImageBlob::from_mat("warmup.jpg",
+                cv::Mat(crop_size[1], crop_size[0], CV_8UC3, cv::Scalar(0, 0, 0))));
+            BlobImageSource warmup_source(warmup_imgs);
+            std::vector<SegResult> warmup_results;
+            if (fresh->predict_uncached(warmup_source, &warmup_results) != 0) {
+                LOG(ERROR) << "Fail to warm up the reloaded model: [" << conf << "]";
                 return -1;
             }
+            std::lock_guard<std::mutex> lock(_reload_mutex);
+            _reloaded = std::move(fresh);
+            _has_reloaded = true;
             return 0;
+        }
 
+        bool Predictor::swap_reloaded_model() {
+            if (!_has_reloaded) {
+                return false;
+            }
+            std::unique_ptr<Predictor> fresh;
+            {
+                std::lock_guard<std::mutex> lock(_reload_mutex);
+                fresh = std::move(_reloaded);
+                _has_reloaded = false;
+            }
+            _model_config = fresh->_model_config;
+            _preprocessor = fresh->_preprocessor;
+            // end a profile window before its predictor is replaced
+            _op_profiler.finish(&_main_predictor);
+            // the old paddle predictor is released here
+            _main_predictor = std::move(fresh->_main_predictor);
+            // the batch buffers as the new DEPLOY.MEMORY placed them, and the
+            // batch size, memory budget and profile window of the new config
+            _buffer = std::move(fresh->_buffer);
+            _u8_buffer = std::move(fresh->_u8_buffer);
+            _arena.out_data = std::move(fresh->_arena.out_data);
+            _op_profiler.init(_model_config);
+            _memory_planner.init(_model_config);
+            _batch_controller.init(_model_config);
+            if (_result_cache != nullptr) {
+                _result_cache->retire();
+            }
+            _result_cache = fresh->_result_cache;
+            _mask.resize(_model_config._resize[0] * _model_config._resize[1]);
+            _scoremap.resize(_model_config._resize[0] * _model_config._resize[1]);
+            std::cout << "switch to the reloaded model: " << _model_config._model_path << std::endl;
+            return true;
         }
 
         int Predictor::predict(const std::vector<std::string>& imgs) {
-            if (_model_config._predictor_mode == "NATIVE") {
-                return native_predict(imgs);
+            VectorImageSource source(imgs);
+            return predict(source);
+        }
+
+        int Predictor::predict(ImageSource& source) {
+            return predict(source, nullptr);
+        }
+
+        int Predictor::predict(const std::vector<ImageBlob>& imgs, std::vector<SegResult>* results,
+                               std::vector<int>* failed) {
+            BlobImageSource source(imgs);
+            int ret = predict(source, results);
+            if (failed != nullptr) {
+                *failed = source.failed_positions();
             }
-            else if (_model_config._predictor_mode == "ANALYSIS") {
-                return analysis_predict(imgs);
+            return ret;
+        }
+
+        int Predictor::predict(const std::vector<cv::Mat>& imgs, std::vector<SegResult>* results,
+                               std::vector<int>* failed) {
+            std::vector<ImageBlob> blobs(imgs.size());
+            for (int i = 0; i < imgs.size(); ++i) {
+                blobs[i] = ImageBlob::from_mat("image_" + std::to_string(i) + ".jpg", imgs[i]);
+            }
+            return predict(blobs, results, failed);
+        }
+
+        int Predictor::predict(ImageSource& source, std::vector<SegResult>* results) {
+            // a reload may replace _result_cache during the call, keep this one alive
+            auto cache = _result_cache;
+            if (cache != nullptr) {
+                return cached_predict(*cache, source, _model_config._batch_size, results,
+                    [this](const std::vector<ImageBlob>& imgs, std::vector<SegResult>* miss_results,
+                           std::vector<int>* failed) {
+                        BlobImageSource misses(imgs);
+                        int ret = predict_uncached(misses, miss_results);
+                        *failed = misses.failed_positions();
+                        return ret;
+                    },
+                    [](const SegResult& result) {
+                        save_seg_result(result.name, result.mask, result.scoremap, result.ori_height, result.ori_width);
+                    });
             }
-            return -1;
+            return predict_uncached(source, results);
         }
 
-        int Predictor::output_mask(const std::string& fname, float* p_out, int length, int* height, int* width) {
+        int Predictor::predict_uncached(ImageSource& source, std::vector<SegResult>* results) {
+            // the loops stop at a reloaded model, the rest of the source runs in the
+            // mode of its config (a RESULT_CACHE it turns on applies from the next call)
+            int ret = kReloaded;
+            while (ret == kReloaded) {
+                if (_model_config._predictor_mode == "NATIVE") {
+                    ret = native_predict(source, results);
+                }
+                else if (_model_config._predictor_mode == "ANALYSIS") {
+                    ret = analysis_predict(source, results);
+                }
+                else {
+                    return -1;
+                }
+            }
+            return ret;
+        }
+
+        void save_seg_result(const std::string& fname, const cv::Mat& mask, const cv::Mat& scoremap,
+                             int ori_height, int ori_width) {
+            PADDLESEG_TRACE_SPAN("write");
+            std::string nname(fname);
+            auto pos = fname.find(".");
+            nname[pos] = '_';
+            std::string mask_save_name = nname + ".png";
+            cv::imwrite(mask_save_name, mask);
+            std::string scoremap_save_name = nname + std::string("_scoremap.png");
+            cv::imwrite(scoremap_save_name, scoremap);
+            std::cout << "save mask of [" << fname << "] done" << std::endl;
+
+            if (ori_height > 0 && ori_width > 0) {
+                cv::Mat recover_png = cv::Mat(ori_height, ori_width, CV_8UC1);
+                cv::resize(scoremap, recover_png, cv::Size(ori_width, ori_height),
+                    0, 0, cv::INTER_CUBIC);
+                std::string recover_name = nname + std::string("_recover.png");
+                cv::imwrite(recover_name, recover_png);
+            }
+        }
+
+        int Predictor::output_mask(const std::string& fname, float* p_out, int length, int* height, int* width, SegResult* result) {
             int eval_width = _model_config._resize[0];
             int eval_height = _model_config._resize[1];
             int eval_num_class = _model_config._class_num;
@@ -76,6 +279,7 @@ namespace PaddleSolution {
             }
 
             //post process
+            PADDLESEG_TRACE_SPAN("postprocess");
             _mask.clear();
             _scoremap.clear();
             int out_img_len = eval_height * eval_width;
@@ -98,87 +302,121 @@ namespace PaddleSolution {
                 _scoremap[i] = uchar(max_value * 255);
             }
 
-            cv::Mat mask_png = cv::Mat(eval_height, eval_width, CV_8UC1);
-            mask_png.data = _mask.data();
-            std::string nname(fname);
-            auto pos = fname.find(".");
-            nname[pos] = '_';
-            std::string mask_save_name = nname + ".png";
-            cv::imwrite(mask_save_name, mask_png);
-            cv::Mat scoremap_png = cv::Mat(eval_height, eval_width, CV_8UC1);
-            scoremap_png.data = _scoremap.data();
-            std::string scoremap_save_name = nname + std::string("_scoremap.png");
-            cv::imwrite(scoremap_save_name, scoremap_png);
-            std::cout << "save mask of [" << fname << "] done" << std::endl;
-
-            if (height && width) {
-                int recover_height = *height;
-                int recover_width = *width;
-                cv::Mat recover_png = cv::Mat(recover_height, recover_width, CV_8UC1);
-                cv::resize(scoremap_png, recover_png, cv::Size(recover_width, recover_height),
-                    0, 0, cv::INTER_CUBIC);
-                std::string recover_name = nname + std::string("_recover.png");
-                cv::imwrite(recover_name, recover_png);
+            // return the maps to the caller instead of writing them to files
+            if (result != NULL) {
+                result->name = fname;
+                result->mask = cv::Mat(eval_height, eval_width, CV_8UC1, _mask.data()).clone();
+                result->scoremap = cv::Mat(eval_height, eval_width, CV_8UC1, _scoremap.data()).clone();
+                result->ori_height = height ? *height : eval_height;
+                result->ori_width = width ? *width : eval_width;
+                return 0;
             }
+
+            cv::Mat mask_png(eval_height, eval_width, CV_8UC1, _mask.data());
+            cv::Mat scoremap_png(eval_height, eval_width, CV_8UC1, _scoremap.data());
+            save_seg_result(fname, mask_png, scoremap_png, height ? *height : 0, width ? *width : 0);
             return 0;
         }
 
-        int Predictor::native_predict(const std::vector<std::string>& imgs)
-        {
-            int config_batch_size = _model_config._batch_size;
-
+        bool Predictor::fill_input(const std::vector<ImageBlob>& imgs, int* ori_w, int* ori_h, paddle::PaddleTensor* tensor) {
+            PADDLESEG_TRACE_SPAN("preprocess");
+            int batch_size = imgs.size();
             int channels = _model_config._channels;
             int eval_width = _model_config._resize[0];
             int eval_height = _model_config._resize[1];
-            std::size_t total_size = imgs.size();
-            int default_batch_size = std::min(config_batch_size, (int)total_size);
-            int batch = total_size / default_batch_size + ((total_size % default_batch_size) != 0);
-            int batch_buffer_size = default_batch_size * channels * eval_width * eval_height;
+            int size = batch_size * channels * eval_width * eval_height;
+            if (_model_config._input_layout == "NHWC") {
+                tensor->shape = std::vector<int>({ batch_size, eval_height, eval_width, channels });
+            } else {
+                tensor->shape = std::vector<int>({ batch_size, channels, eval_height, eval_width });
+            }
+            if (_model_config._input_dtype == "UINT8") {
+                _u8_buffer.resize(size);
+                tensor->data.Reset(_u8_buffer.data(), size);
+                tensor->dtype = paddle::PaddleDType::UINT8;
+                return _preprocessor->batch_process(imgs, _u8_buffer.data(), ori_w, ori_h);
+            }
+            _buffer.resize(size);
+            tensor->data.Reset(_buffer.data(), size * sizeof(float));
+            tensor->dtype = paddle::PaddleDType::FLOAT32;
+            return _preprocessor->batch_process(imgs, _buffer.data(), ori_w, ori_h);
+        }
+
+        int Predictor::make_warmup_data(const std::vector<ImageBlob>& imgs, std::vector<paddle::PaddleTensor>* feeds) {
+            std::vector<int> org_width(imgs.size(), 0);
+            std::vector<int> org_height(imgs.size(), 0);
+            paddle::PaddleTensor im_tensor;
+            if (!fill_input(imgs, org_width.data(), org_height.data(), &im_tensor)) {
+                return -1;
+            }
+            // copy out of the input buffer, the tensors outlive the next batch
+            paddle::PaddleBuf data(im_tensor.data.length());
+            memcpy(data.data(), im_tensor.data.data(), data.length());
+            im_tensor.data = data;
+            auto input_names = _main_predictor->GetInputNames();
+            im_tensor.name = input_names.empty() ? "image" : input_names.front();
+            feeds->clear();
+            feeds->push_back(im_tensor);
+            return 0;
+        }
+
+        int Predictor::native_predict(ImageSource& source, std::vector<SegResult>* results)
+        {
+            int config_batch_size = _model_config._batch_size;
 
-            auto& input_buffer = _buffer;
             auto& org_width = _org_width;
             auto& org_height = _org_height;
             auto& imgs_batch = _imgs_batch;
 
-            input_buffer.resize(batch_buffer_size);
-            org_width.resize(default_batch_size);
-            org_height.resize(default_batch_size);
-            for (int u = 0; u < batch; ++u) {
-                int batch_size = default_batch_size;
-                if (u == (batch - 1) && (total_size % default_batch_size)) {
-                    batch_size = total_size % default_batch_size;
-                }
-                int real_buffer_size = batch_size * channels * eval_width * eval_height;
-                std::vector<paddle::PaddleTensor> feeds;
-                input_buffer.resize(real_buffer_size);
+            org_width.resize(config_batch_size);
+            org_height.resize(config_batch_size);
+            int batch_size = 0;
+            // a reloaded model is switched in between batches, the in-flight batch
+            // finishes on the old one
+            bool reloaded = false;
+            for (int u = 0; !(reloaded = swap_reloaded_model())
+                && (batch_size = source.next_batch(imgs_batch, _batch_controller.batch_size(_memory_planner.batch_size(config_batch_size)))) > 0; ++u) {
+                // allocations are counted only in WITH_ALLOC_COUNTER builds
+                utils::BatchMetrics batch_metrics;
+                _batch_controller.start();
+                PADDLESEG_TRACE_BATCH(u);
+                _op_profiler.before_batch(&_main_predictor, [this]() { return create_paddle_predictor(true); });
+                auto& feeds = _arena.feeds;
+                feeds.clear();
                 org_height.resize(batch_size);
                 org_width.resize(batch_size);
                 for (int i = 0; i < batch_size; ++i) {
                     org_width[i] = org_height[i] = 0;
                 }
-                imgs_batch.clear();
-                for (int i = 0; i < batch_size; ++i) {
-                    int idx = u * default_batch_size + i;
-                    imgs_batch.push_back(imgs[idx]);
-                }
-                if (!_preprocessor->batch_process(imgs_batch, input_buffer.data(), org_width.data(), org_height.data())) {
+                paddle::PaddleTensor im_tensor;
+                if (!fill_input(imgs_batch, org_width.data(), org_height.data(), &im_tensor)) {
                     return -1;
                 }
-                paddle::PaddleTensor im_tensor;
+                _preprocessor->failed_positions(&_failed_images);
                 im_tensor.name = "image";
-                im_tensor.shape = std::vector<int>({ batch_size, channels, eval_height, eval_width });
-                im_tensor.data.Reset(input_buffer.data(), real_buffer_size * sizeof(float));
-                im_tensor.dtype = paddle::PaddleDType::FLOAT32;
                 feeds.push_back(im_tensor);
                 _outputs.clear();
                 auto t1 = std::chrono::high_resolution_clock::now();
-                if (!_main_predictor->Run(feeds, &_outputs, batch_size)) {
+                bool ran = false;
+                {
+                    PADDLESEG_TRACE_SPAN("run");
+                    ran = _main_predictor->Run(feeds, &_outputs, batch_size);
+                }
+                if (!ran) {
                     LOG(ERROR) << "Failed: NativePredictor->Run() return false at batch: " << u;
+                    if (results != nullptr) {
+                        // the results would no longer line up with the inputs
+                        return -1;
+                    }
+                    source.failed(batch_size);
                     continue;
                 }
                 auto t2 = std::chrono::high_resolution_clock::now();
                 auto duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
                 std::cout << "runtime = " << duration << std::endl;
+                _op_profiler.add_run_time(duration);
+                _batch_controller.observe(batch_size, duration);
+                batch_metrics.print();
                 int out_num = 1;
                 // print shape of first output tensor for debugging
                 std::cout << "size of outputs[" << 0 << "]: (";
@@ -192,71 +430,93 @@ namespace PaddleSolution {
                     LOG(ERROR) << "outputs data size mismatch with shape size.";
                     return -1;
                 }
+                _memory_planner.observe(batch_size, im_tensor.data.length(), _outputs[0].data.length());
 
+                size_t f = 0;
                 for (int i = 0; i < batch_size; ++i) {
+                    PADDLESEG_TRACE_IMAGE(i);
                     float* output_addr = (float*)(_outputs[0].data.data()) + i * (out_num / batch_size);
-                    output_mask(imgs_batch[i], output_addr, out_num / batch_size, &org_height[i], &org_width[i]);
+                    SegResult* result = NULL;
+                    if (results != nullptr) {
+                        results->push_back(SegResult());
+                        result = &results->back();
+                    }
+                    // the input slot of an image that failed holds stale pixels
+                    if (f < _failed_images.size() && _failed_images[f] == i) {
+                        ++f;
+                        if (result != NULL) {
+                            result->name = imgs_batch[i].name;
+                        }
+                        continue;
+                    }
+                    output_mask(imgs_batch[i].name, output_addr, out_num / batch_size, &org_height[i], &org_width[i], result);
                 }
+                // the outputs of the batch are written, but for the images that failed to preprocess
+                source.done(batch_size, _failed_images);
+                _op_profiler.after_batch(&_main_predictor);
             }
-
-            return 0;
+            // predict_uncached() goes on with the rest of the source under the new config
+            return reloaded ? kReloaded : 0;
         }
 
-        int Predictor::analysis_predict(const std::vector<std::string>& imgs) {
+        int Predictor::analysis_predict(ImageSource& source, std::vector<SegResult>* results) {
 
             int config_batch_size = _model_config._batch_size;
-            int channels = _model_config._channels;
-            int eval_width = _model_config._resize[0];
-            int eval_height = _model_config._resize[1];
-            auto total_size = imgs.size();
-            int default_batch_size = std::min(config_batch_size, (int)total_size);
-            int batch = total_size / default_batch_size + ((total_size % default_batch_size) != 0);
-            int batch_buffer_size = default_batch_size * channels * eval_width * eval_height;
-
-            auto& input_buffer = _buffer;
             auto& org_width = _org_width;
             auto& org_height = _org_height;
             auto& imgs_batch = _imgs_batch;
 
-            input_buffer.resize(batch_buffer_size);
-            org_width.resize(default_batch_size);
-            org_height.resize(default_batch_size);
+            org_width.resize(config_batch_size);
+            org_height.resize(config_batch_size);
 
-            for (int u = 0; u < batch; ++u) {
-                int batch_size = default_batch_size;
-                if (u == (batch - 1) && (total_size % default_batch_size)) {
-                    batch_size = total_size % default_batch_size;
-                }
+            int batch_size = 0;
+            // a reloaded model is switched in between batches, the in-flight batch
+            // finishes on the old one
+            bool reloaded = false;
+            for (int u = 0; !(reloaded = swap_reloaded_model())
+                && (batch_size = source.next_batch(imgs_batch, _batch_controller.batch_size(_memory_planner.batch_size(config_batch_size)))) > 0; ++u) {
+                // allocations are counted only in WITH_ALLOC_COUNTER builds
+                utils::BatchMetrics batch_metrics;
+                _batch_controller.start();
+                PADDLESEG_TRACE_BATCH(u);
+                _op_profiler.before_batch(&_main_predictor, [this]() { return create_paddle_predictor(true); });
 
-                int real_buffer_size = batch_size * channels * eval_width * eval_height;
-                std::vector<paddle::PaddleTensor> feeds;
-                input_buffer.resize(real_buffer_size);
                 org_height.resize(batch_size);
                 org_width.resize(batch_size);
                 for (int i = 0; i < batch_size; ++i) {
                     org_width[i] = org_height[i] = 0;
                 }
-                imgs_batch.clear();
-                for (int i = 0; i < batch_size; ++i) {
-                    int idx = u * default_batch_size + i;
-                    imgs_batch.push_back(imgs[idx]);
-                }
-                if (!_preprocessor->batch_process(imgs_batch, input_buffer.data(), org_height.data(), org_width.data())) {
+                paddle::PaddleTensor input;
+                if (!fill_input(imgs_batch, org_width.data(), org_height.data(), &input)) {
                     return -1;
                 }
+                _preprocessor->failed_positions(&_failed_images);
                 auto im_tensor = _main_predictor->GetInputTensor("image");
-                im_tensor->Reshape({ batch_size, channels, eval_height, eval_width });
-                im_tensor->copy_from_cpu(input_buffer.data());
+                im_tensor->Reshape(input.shape);
+                {
+                    PADDLESEG_TRACE_SPAN("copy_in");
+                    if (input.dtype == paddle::PaddleDType::UINT8) {
+                        im_tensor->copy_from_cpu(static_cast<uint8_t*>(input.data.data()));
+                    } else {
+                        im_tensor->copy_from_cpu(static_cast<float*>(input.data.data()));
+                    }
+                }
 
                 auto t1 = std::chrono::high_resolution_clock::now();
-                _main_predictor->ZeroCopyRun();
+                {
+                    PADDLESEG_TRACE_SPAN("run");
+                    _main_predictor->ZeroCopyRun();
+                }
                 auto t2 = std::chrono::high_resolution_clock::now();
                 auto duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
                 std::cout << "runtime = " << duration << std::endl;
+                _op_profiler.add_run_time(duration);
+                _batch_controller.observe(batch_size, duration);
+                batch_metrics.print();
 
                 auto output_names = _main_predictor->GetOutputNames();
                 auto output_t = _main_predictor->GetOutputTensor(output_names[0]);
-                std::vector<float> out_data;
+                auto& out_data = _arena.out_data;
                 std::vector<int> output_shape = output_t->shape();
 
                 int out_num = 1;
@@ -268,12 +528,35 @@ namespace PaddleSolution {
                 std::cout << ")" << std::endl;
 
                 out_data.resize(out_num);
-                output_t->copy_to_cpu(out_data.data());
+                _memory_planner.observe(batch_size, input.data.length(), out_num * sizeof(float));
+                {
+                    PADDLESEG_TRACE_SPAN("copy_out");
+                    output_t->copy_to_cpu(out_data.data());
+                }
+                size_t f = 0;
                 for (int i = 0; i < batch_size; ++i) {
+                    PADDLESEG_TRACE_IMAGE(i);
                     float* out_addr = out_data.data() + (out_num / batch_size) * i;
-                    output_mask(imgs_batch[i], out_addr, out_num / batch_size, &org_height[i], &org_width[i]);
+                    SegResult* result = NULL;
+                    if (results != nullptr) {
+                        results->push_back(SegResult());
+                        result = &results->back();
+                    }
+                    // the input slot of an image that failed holds stale pixels
+                    if (f < _failed_images.size() && _failed_images[f] == i) {
+                        ++f;
+                        if (result != NULL) {
+                            result->name = imgs_batch[i].name;
+                        }
+                        continue;
+                    }
+                    output_mask(imgs_batch[i].name, out_addr, out_num / batch_size, &org_height[i], &org_width[i], result);
                 }
+                // the outputs of the batch are written, but for the images that failed to preprocess
+                source.done(batch_size, _failed_images);
+                _op_profiler.after_batch(&_main_predictor);
             }
-            return 0;
+            // predict_uncached() goes on with the rest of the source under the new config
+            return reloaded ? kReloaded : 0;
         }
 }
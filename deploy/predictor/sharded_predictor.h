@@ -0,0 +1,254 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <utils/seg_conf_parser.h>
+#include <utils/cpu_topology.h>
+#include <utils/thread_pool.h>
+#include <utils/image_source.h>
+
+namespace PaddleSolution {
+
+    /* One PredictorT per cpu group (NUMA node or core group, DEPLOY.SHARDING).
+     * Each shard runs in its own thread pinned to its cpus; that thread creates
+     * the shard's preprocessing ThreadPool and the Paddle predictor, so their
+     * threads inherit the pinning and the buffers they first touch are placed on
+     * the local node. The calling thread reads the input source and hands the
+     * batches to the shards round-robin or to the least loaded one.
+     * Works with Predictor, ClassifyPredictor and DetectionPredictor.
+     */
+    template <typename PredictorT>
+    class ShardedPredictor {
+    public:
+        // batches waiting in a shard besides the running one
+        static const int kMaxQueuedBatches = 2;
+
+        ShardedPredictor() : _batch_size(1), _least_load(false), _next_shard(0) {
+        }
+
+        ~ShardedPredictor() {
+            stop();
+        }
+
+        // start a shard per cpu group and init their predictors with `conf`
+        int init(const std::string& conf) {
+            PaddleSegModelConfigPaser config;
+            if (!config.load_config(conf)) {
+                LOG(ERROR) << "Fail to load config file: [" << conf << "]";
+                return -1;
+            }
+            if (config._sharding_dispatch != "ROUND_ROBIN" && config._sharding_dispatch != "LEAST_LOAD") {
+                LOG(ERROR) << "Unknown DEPLOY.SHARDING.DISPATCH: " << config._sharding_dispatch;
+                return -1;
+            }
+            auto groups = utils::cpu_groups(config._sharding_mode, config._sharding_cores_per_shard);
+            if (groups.empty()) {
+                LOG(ERROR) << "Unsupported DEPLOY.SHARDING: MODE " << config._sharding_mode
+                    << ", CORES_PER_SHARD " << config._sharding_cores_per_shard;
+                return -1;
+            }
+            _batch_size = std::max(1, config._batch_size);
+            _least_load = config._sharding_dispatch == "LEAST_LOAD";
+
+            for (const auto& cpus : groups) {
+                std::unique_ptr<Shard> shard(new Shard(cpus));
+                auto inited = std::make_shared<std::promise<int>>();
+                auto init_result = inited->get_future();
+                Shard* s = shard.get();
+                shard->thread = std::thread([this, s, conf, inited] { run_shard(s, conf, inited.get()); });
+                _shards.push_back(std::move(shard));
+                if (init_result.get() != 0) {
+                    LOG(ERROR) << "Fail to init the predictor shard " << _shards.size() - 1;
+                    stop();
+                    return -1;
+                }
+            }
+            std::cout << "start " << _shards.size() << " predictor shards:";
+            for (const auto& shard : _shards) {
+                std::cout << " [" << shard->cpus.front() << "-" << shard->cpus.back() << "]";
+            }
+            std::cout << std::endl;
+            return 0;
+        }
+
+        // reload every shard (see PredictorT::reload), each new model is built on
+        // the cpus of its shard so its memory stays node-local
+        int reload(const std::string& conf) {
+            auto cpus = utils::current_thread_cpus();
+            int ret = 0;
+            for (auto& shard : _shards) {
+                utils::pin_current_thread(shard->cpus);
+                if (shard->predictor->reload(conf) != 0) {
+                    ret = -1;
+                }
+            }
+            if (!cpus.empty()) {
+                utils::pin_current_thread(cpus);
+            }
+            return ret;
+        }
+
+        // predict all the images of `source`, return when every shard is done
+        int predict(ImageSource& source) {
+            if (_shards.empty()) {
+                return -1;
+            }
+            std::vector<ImageBlob> batch;
+            while (source.next_batch(batch, _batch_size) > 0) {
+                Shard* shard = wait_for_shard();
+                {
+                    std::lock_guard<std::mutex> lock(shard->mutex);
+                    shard->queue.push_back(std::move(batch));
+                    ++shard->load;
+                }
+                shard->cv.notify_all();
+                batch.clear();
+            }
+            // wait for the shards to drain their queues
+            int ret = 0;
+            for (auto& shard : _shards) {
+                std::unique_lock<std::mutex> lock(shard->mutex);
+                shard->cv.wait(lock, [&shard] { return shard->load == 0; });
+                if (shard->failed) {
+                    ret = -1;
+                    shard->failed = false;
+                }
+                std::cout << "shard [" << shard->cpus.front() << "-" << shard->cpus.back() << "]: "
+                    << shard->batches << " batches" << std::endl;
+            }
+            return ret;
+        }
+
+        void stop() {
+            for (auto& shard : _shards) {
+                {
+                    std::lock_guard<std::mutex> lock(shard->mutex);
+                    shard->stop = true;
+                }
+                shard->cv.notify_all();
+            }
+            for (auto& shard : _shards) {
+                if (shard->thread.joinable()) {
+                    shard->thread.join();
+                }
+            }
+            _shards.clear();
+        }
+
+    private:
+        struct Shard {
+            explicit Shard(const std::vector<int>& cpus_)
+                : cpus(cpus_), load(0), batches(0), failed(false), stop(false) {
+            }
+
+            std::vector<int> cpus;
+            std::unique_ptr<PredictorT> predictor;
+            std::thread thread;
+            std::mutex mutex;
+            std::condition_variable cv;
+            std::deque<std::vector<ImageBlob>> queue;
+            // queued batches plus the running one, guarded by `mutex`
+            int load;
+            int batches;
+            bool failed;
+            bool stop;
+        };
+
+        void run_shard(Shard* shard, const std::string& conf, std::promise<int>* inited) {
+            if (!utils::pin_current_thread(shard->cpus)) {
+                LOG(WARNING) << "Fail to pin the predictor shard, it runs unpinned";
+            }
+            // created after pinning: the workers and the Paddle math threads
+            // inherit the cpus of the shard
+            utils::ThreadPool pool(shard->cpus.size() - 1);
+            utils::ThreadPool::set_current(&pool);
+            shard->predictor.reset(new PredictorT());
+            shard->predictor->set_cpu_math_threads(shard->cpus.size());
+            int ret = -1;
+            try {
+                ret = shard->predictor->init(conf);
+            } catch (const std::exception& e) {
+                LOG(ERROR) << "Fail to init the predictor shard: " << e.what();
+            }
+            inited->set_value(ret);
+
+            while (true) {
+                std::vector<ImageBlob> batch;
+                {
+                    std::unique_lock<std::mutex> lock(shard->mutex);
+                    shard->cv.wait(lock, [shard] { return shard->stop || !shard->queue.empty(); });
+                    if (shard->queue.empty()) {
+                        break;
+                    }
+                    batch = std::move(shard->queue.front());
+                    shard->queue.pop_front();
+                }
+                BlobImageSource source(batch);
+                int predicted = shard->predictor->predict(source);
+                {
+                    std::lock_guard<std::mutex> lock(shard->mutex);
+                    --shard->load;
+                    ++shard->batches;
+                    shard->failed = shard->failed || predicted != 0;
+                }
+                shard->cv.notify_all();
+                // the dispatcher checks the loads holding _dispatch_mutex, take it
+                // so the notification cannot fall between its check and its wait
+                {
+                    std::lock_guard<std::mutex> lock(_dispatch_mutex);
+                }
+                _dispatch_cv.notify_all();
+            }
+            utils::ThreadPool::set_current(nullptr);
+        }
+
+        // the shard of the next batch, blocks while it already has
+        // kMaxQueuedBatches waiting so the reader does not run ahead
+        Shard* wait_for_shard() {
+            std::unique_lock<std::mutex> lock(_dispatch_mutex);
+            Shard* chosen = nullptr;
+            _dispatch_cv.wait(lock, [this, &chosen] {
+                if (_least_load) {
+                    int min_load = 0;
+                    for (auto& shard : _shards) {
+                        int load = shard_load(shard.get());
+                        if (chosen == nullptr || load < min_load) {
+                            chosen = shard.get();
+                            min_load = load;
+                        }
+                    }
+                } else {
+                    chosen = _shards[_next_shard].get();
+                }
+                return shard_load(chosen) <= kMaxQueuedBatches;
+            });
+            if (!_least_load) {
+                _next_shard = (_next_shard + 1) % _shards.size();
+            }
+            return chosen;
+        }
+
+        int shard_load(Shard* shard) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            return shard->load;
+        }
+
+        std::vector<std::unique_ptr<Shard>> _shards;
+        int _batch_size;
+        bool _least_load;
+        int _next_shard;
+        std::mutex _dispatch_mutex;
+        std::condition_variable _dispatch_cv;
+    };
+}
@@ -0,0 +1,307 @@
+#include "fused_resize.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PADDLESEG_FUSED_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define PADDLESEG_FUSED_NEON
+#endif
+
+#include <glog/logging.h>
+
+namespace PaddleSolution {
+
+    namespace {
+        // source pixels and weights of each output pixel along one axis,
+        // `count` taps per pixel, padded with zero weights
+        struct Taps {
+            int count;
+            std::vector<int> index;
+            std::vector<float> weight;
+        };
+
+        // cv::INTER_LINEAR, and cv::INTER_AREA when the image is enlarged
+        // along either axis (OpenCV then blends two pixels as well)
+        void linear_taps(int src_size, int begin, int n, double scale, bool area, Taps* taps) {
+            double inv_scale = 1 / scale;
+            taps->count = 2;
+            taps->index.resize(n * 2);
+            taps->weight.resize(n * 2);
+            for (int i = 0; i < n; ++i) {
+                int d = begin + i;
+                int s = 0;
+                float f = 0;
+                if (!area) {
+                    double pos = (d + 0.5) * scale - 0.5;
+                    s = static_cast<int>(std::floor(pos));
+                    f = static_cast<float>(pos - s);
+                } else {
+                    s = static_cast<int>(std::floor(d * scale));
+                    f = static_cast<float>((d + 1) - (s + 1) * inv_scale);
+                    f = f <= 0 ? 0.f : f - std::floor(f);
+                }
+                if (s < 0) {
+                    s = 0;
+                    f = 0;
+                }
+                if (s >= src_size - 1) {
+                    s = src_size - 1;
+                    f = 0;
+                }
+                taps->index[i * 2] = s;
+                taps->index[i * 2 + 1] = std::min(s + 1, src_size - 1);
+                taps->weight[i * 2] = 1 - f;
+                taps->weight[i * 2 + 1] = f;
+            }
+        }
+
+        // cv::INTER_AREA when shrinking: the average of the covered source
+        // pixels, the partially covered ones weighted by their coverage
+        void area_taps(int src_size, int begin, int n, double scale, Taps* taps) {
+            static thread_local std::vector<std::vector<std::pair<int, float>>> cells;
+            cells.resize(n);
+            int count = 1;
+            for (int i = 0; i < n; ++i) {
+                auto& cell = cells[i];
+                cell.clear();
+                double fs1 = (begin + i) * scale;
+                double fs2 = fs1 + scale;
+                double width = std::min(scale, src_size - fs1);
+                int s1 = static_cast<int>(std::ceil(fs1));
+                int s2 = std::min(static_cast<int>(std::floor(fs2)), src_size - 1);
+                s1 = std::min(s1, s2);
+                if (s1 - fs1 > 1e-3) {
+                    cell.push_back(std::make_pair(s1 - 1, static_cast<float>((s1 - fs1) / width)));
+                }
+                for (int s = s1; s < s2; ++s) {
+                    cell.push_back(std::make_pair(s, static_cast<float>(1 / width)));
+                }
+                if (fs2 - s2 > 1e-3) {
+                    cell.push_back(std::make_pair(s2, static_cast<float>(std::min(std::min(fs2 - s2, 1.0), width) / width)));
+                }
+                count = std::max(count, static_cast<int>(cell.size()));
+            }
+            taps->count = count;
+            taps->index.resize(n * count);
+            taps->weight.resize(n * count);
+            for (int i = 0; i < n; ++i) {
+                const auto& cell = cells[i];
+                int last = cell.empty() ? 0 : cell.back().first;
+                for (int k = 0; k < count; ++k) {
+                    bool tap = k < static_cast<int>(cell.size());
+                    taps->index[i * count + k] = tap ? cell[k].first : last;
+                    taps->weight[i * count + k] = tap ? cell[k].second : 0.f;
+                }
+            }
+        }
+
+        // resample one BGR source row horizontally into three float planes,
+        // plane c from source channel `channel[c]`
+        void resample_row(const uchar* row, const Taps& taps, const int* channel, int n, float* const* planes) {
+            const int* index = taps.index.data();
+            const float* weight = taps.weight.data();
+            float* p0 = planes[0];
+            float* p1 = planes[1];
+            float* p2 = planes[2];
+            int c0 = channel[0];
+            int c1 = channel[1];
+            int c2 = channel[2];
+            if (taps.count == 2) {
+                for (int i = 0; i < n; ++i) {
+                    const uchar* a = row + index[i * 2] * 3;
+                    const uchar* b = row + index[i * 2 + 1] * 3;
+                    float wa = weight[i * 2];
+                    float wb = weight[i * 2 + 1];
+                    p0[i] = a[c0] * wa + b[c0] * wb;
+                    p1[i] = a[c1] * wa + b[c1] * wb;
+                    p2[i] = a[c2] * wa + b[c2] * wb;
+                }
+                return;
+            }
+            int count = taps.count;
+            for (int i = 0; i < n; ++i) {
+                float s0 = 0;
+                float s1 = 0;
+                float s2 = 0;
+                for (int k = 0; k < count; ++k) {
+                    const uchar* a = row + index[i * count + k] * 3;
+                    float w = weight[i * count + k];
+                    s0 += a[c0] * w;
+                    s1 += a[c1] * w;
+                    s2 += a[c2] * w;
+                }
+                p0[i] = s0;
+                p1[i] = s1;
+                p2[i] = s2;
+            }
+        }
+
+        // dst = sum(weight[k] * rows[k]) + beta over `n` floats
+        void blend_rows(const float* const* rows, const float* weight, int count, float beta, float* dst, int n) {
+            int i = 0;
+#if defined(PADDLESEG_FUSED_SSE2)
+            __m128 vbeta = _mm_set1_ps(beta);
+            if (count == 2) {
+                __m128 w0 = _mm_set1_ps(weight[0]);
+                __m128 w1 = _mm_set1_ps(weight[1]);
+                for (; i + 4 <= n; i += 4) {
+                    __m128 a = _mm_mul_ps(_mm_loadu_ps(rows[0] + i), w0);
+                    __m128 b = _mm_mul_ps(_mm_loadu_ps(rows[1] + i), w1);
+                    _mm_storeu_ps(dst + i, _mm_add_ps(_mm_add_ps(a, b), vbeta));
+                }
+            } else {
+                for (; i + 4 <= n; i += 4) {
+                    __m128 sum = vbeta;
+                    for (int k = 0; k < count; ++k) {
+                        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(rows[k] + i), _mm_set1_ps(weight[k])));
+                    }
+                    _mm_storeu_ps(dst + i, sum);
+                }
+            }
+#elif defined(PADDLESEG_FUSED_NEON)
+            float32x4_t vbeta = vdupq_n_f32(beta);
+            for (; i + 4 <= n; i += 4) {
+                float32x4_t sum = vbeta;
+                for (int k = 0; k < count; ++k) {
+                    sum = vmlaq_n_f32(sum, vld1q_f32(rows[k] + i), weight[k]);
+                }
+                vst1q_f32(dst + i, sum);
+            }
+#endif
+            for (; i < n; ++i) {
+                float sum = beta;
+                for (int k = 0; k < count; ++k) {
+                    sum += rows[k][i] * weight[k];
+                }
+                dst[i] = sum;
+            }
+        }
+    }
+
+    void fused_resize_normalize(const cv::Mat& src, cv::Size dsize, const cv::Rect& roi,
+                                const float* mean, const float* std, bool swap_rb, float* dst,
+                                int interpolation, double fx, double fy) {
+        CV_Assert(src.type() == CV_8UC3 && dsize.width > 0 && dsize.height > 0);
+        CV_Assert(roi.x >= 0 && roi.y >= 0 && roi.x + roi.width <= dsize.width && roi.y + roi.height <= dsize.height);
+        double scale_x = fx > 0 ? 1 / fx : static_cast<double>(src.cols) / dsize.width;
+        double scale_y = fy > 0 ? 1 / fy : static_cast<double>(src.rows) / dsize.height;
+        int ow = roi.width;
+        int oh = roi.height;
+
+        // the tables and rows are kept by the thread, like the MatPool buffers
+        static thread_local Taps xtaps;
+        static thread_local Taps ytaps;
+        static thread_local std::vector<float> buffer;
+        static thread_local std::vector<int> slot_row;
+        static thread_local std::vector<const float*> rows;
+        static thread_local std::vector<float> weight;
+        bool area = interpolation == cv::INTER_AREA;
+        if (area && scale_x >= 1 && scale_y >= 1) {
+            area_taps(src.cols, roi.x, ow, scale_x, &xtaps);
+            area_taps(src.rows, roi.y, oh, scale_y, &ytaps);
+        } else {
+            linear_taps(src.cols, roi.x, ow, scale_x, area, &xtaps);
+            linear_taps(src.rows, roi.y, oh, scale_y, area, &ytaps);
+        }
+
+        // the source rows of an output row are consecutive, a ring of
+        // ytaps.count resampled rows holds them, source row r in slot r % slots
+        int slots = ytaps.count;
+        buffer.resize(static_cast<size_t>(slots) * 3 * ow);
+        slot_row.assign(slots, -1);
+        int channel[3];
+        float alpha[3];
+        float beta[3];
+        for (int c = 0; c < 3; ++c) {
+            channel[c] = swap_rb ? 2 - c : c;
+            alpha[c] = 1.f / (255.f * std[c]);
+            beta[c] = -mean[c] / std[c];
+        }
+
+        rows.resize(3 * slots);
+        weight.resize(slots);
+        size_t plane = static_cast<size_t>(ow) * oh;
+        for (int y = 0; y < oh; ++y) {
+            const int* index = &ytaps.index[y * slots];
+            for (int k = 0; k < slots; ++k) {
+                int r = index[k];
+                float* resampled = &buffer[static_cast<size_t>(r % slots) * 3 * ow];
+                if (slot_row[r % slots] != r) {
+                    float* planes[3] = { resampled, resampled + ow, resampled + 2 * ow };
+                    resample_row(src.ptr<uchar>(r), xtaps, channel, ow, planes);
+                    slot_row[r % slots] = r;
+                }
+                for (int c = 0; c < 3; ++c) {
+                    rows[c * slots + k] = resampled + c * ow;
+                }
+            }
+            for (int c = 0; c < 3; ++c) {
+                for (int k = 0; k < slots; ++k) {
+                    weight[k] = ytaps.weight[y * slots + k] * alpha[c];
+                }
+                blend_rows(&rows[c * slots], weight.data(), slots, beta[c], dst + c * plane + static_cast<size_t>(y) * ow, ow);
+            }
+        }
+    }
+
+    double fused_resize_error(const cv::Mat& src, cv::Size dsize, int interpolation) {
+        // mean 0 and std 1 / 255 leave the resized pixels unchanged
+        const float mean[3] = { 0, 0, 0 };
+        const float std[3] = { 1 / 255.f, 1 / 255.f, 1 / 255.f };
+        std::vector<float> fused(3 * dsize.area());
+        fused_resize_normalize(src, dsize, cv::Rect(0, 0, dsize.width, dsize.height), mean, std, false,
+                               fused.data(), interpolation);
+        cv::Mat expected;
+        cv::resize(src, expected, dsize, 0, 0, interpolation);
+        double error = 0;
+        for (int y = 0; y < dsize.height; ++y) {
+            const uchar* ptr = expected.ptr<uchar>(y);
+            for (int x = 0; x < dsize.width; ++x) {
+                for (int c = 0; c < 3; ++c) {
+                    float value = fused[(c * dsize.height + y) * dsize.width + x];
+                    error = std::max(error, static_cast<double>(std::fabs(value - ptr[x * 3 + c])));
+                }
+            }
+        }
+        return error;
+    }
+
+    bool fused_resize_validated() {
+        static const bool validated = []() {
+            struct Case {
+                int src_w;
+                int src_h;
+                int dst_w;
+                int dst_h;
+                int interpolation;
+            };
+            const Case cases[] = {
+                { 640, 480, 513, 513, cv::INTER_LINEAR },
+                { 1280, 720, 224, 224, cv::INTER_LINEAR },
+                { 100, 75, 333, 250, cv::INTER_LINEAR },
+                { 1280, 720, 320, 180, cv::INTER_AREA },
+                { 1000, 700, 333, 250, cv::INTER_AREA },
+                { 100, 75, 333, 250, cv::INTER_AREA },
+            };
+            cv::RNG rng(0);
+            double error = 0;
+            for (const auto& c : cases) {
+                cv::Mat src(c.src_h, c.src_w, CV_8UC3);
+                rng.fill(src, cv::RNG::UNIFORM, cv::Scalar::all(0), cv::Scalar::all(256));
+                error = std::max(error, fused_resize_error(src, cv::Size(c.dst_w, c.dst_h), c.interpolation));
+            }
+            if (error > kFusedResizeTolerance) {
+                LOG(WARNING) << "DEPLOY.FUSED_RESIZE: differs from cv::resize by " << error
+                    << " (tolerance " << kFusedResizeTolerance << "), not used";
+                return false;
+            }
+            return true;
+        }();
+        return validated;
+    }
+}
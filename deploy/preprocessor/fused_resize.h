@@ -0,0 +1,39 @@
+#pragma once
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+namespace PaddleSolution {
+    // largest difference to cv::resize accepted from fused_resize_normalize(),
+    // in pixel levels of the resized 8-bit image
+    const double kFusedResizeTolerance = 1.0;
+
+    /* Resize, normalize and transpose an 8-bit 3 channel image in one pass.
+     *
+     * `src` (CV_8UC3, HWC) is resized to `dsize` with cv::INTER_LINEAR or
+     * cv::INTER_AREA as cv::resize would, the window `roi` of the resized
+     * image is kept (the whole image for the predictors without a crop) and
+     * written to `dst` as three float planes of roi.width * roi.height:
+     *     dst[c][y][x] = (resized[y][x][c'] / 255 - mean[c]) / std[c]
+     * where c' = 2 - c if `swap_rb` (RGB planes from a BGR image), c otherwise.
+     * `fx` and `fy` follow cv::resize: when positive, the coordinates are
+     * mapped with 1 / fx instead of src.cols / dsize.width.
+     *
+     * The image is resized separably: each source row is resampled
+     * horizontally once into a few float rows of roi.width, which stay in
+     * cache while the output rows are blended from them, so no full size
+     * intermediate image is allocated. The vertical blend, normalization and
+     * planar store are SIMD (SSE2 / NEON).
+     */
+    void fused_resize_normalize(const cv::Mat& src, cv::Size dsize, const cv::Rect& roi,
+                                const float* mean, const float* std, bool swap_rb, float* dst,
+                                int interpolation = cv::INTER_LINEAR, double fx = 0, double fy = 0);
+
+    // largest difference, in pixel levels, between fused_resize_normalize()
+    // and cv::resize on `src` resized to `dsize`
+    double fused_resize_error(const cv::Mat& src, cv::Size dsize, int interpolation);
+
+    // compare fused_resize_normalize() to cv::resize once on synthetic images,
+    // true when it stays within kFusedResizeTolerance
+    bool fused_resize_validated();
+}
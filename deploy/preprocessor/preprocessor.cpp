@@ -5,14 +5,35 @@
 #include "preprocessor_seg.h"
 #include "preprocessor_classify.h"
 #include "preprocessor_detection.h"
+#include "tensor_cache.h"
 
 namespace PaddleSolution {
 
+    // wrap `p` into a CachedPreProcessor when DEPLOY.TENSOR_CACHE is enabled
+    static std::shared_ptr<ImagePreProcessor> with_tensor_cache(
+        const std::shared_ptr<PaddleSolution::PaddleSegModelConfigPaser>& config, std::shared_ptr<ImagePreProcessor> p) {
+        if (!config->_tensor_cache) {
+            return p;
+        }
+        if (config->_tensor_cache_dir.empty()) {
+            LOG(ERROR) << "DEPLOY.TENSOR_CACHE.DIR is not set, the tensor cache is disabled";
+            return p;
+        }
+        size_t tensor_size = config->_channels * config->_resize[0] * config->_resize[1];
+        std::unique_ptr<TensorCache> cache(new TensorCache());
+        if (!cache->open(config->_tensor_cache_dir, preprocess_fingerprint(*config), tensor_size,
+                         static_cast<uint64_t>(config->_tensor_cache_max_mb) << 20)) {
+            LOG(ERROR) << "The tensor cache is disabled";
+            return p;
+        }
+        return std::make_shared<CachedPreProcessor>(p, std::move(cache));
+    }
+
     std::shared_ptr<ImagePreProcessor> create_processor(const std::string& conf_file) {
 
         auto config = std::make_shared<PaddleSolution::PaddleSegModelConfigPaser>();
         if (!config->load_config(conf_file)) {
-            LOG(FATAL) << "fail to laod conf file [" << conf_file << "]";
+            LOG(ERROR) << "fail to laod conf file [" << conf_file << "]";
             return nullptr;
         }
 
@@ -21,7 +42,7 @@ namespace PaddleSolution {
             if (!p->init(config)) {
                 return nullptr;
             }
-            return p;
+            return with_tensor_cache(config, p);
         }
         
         if (config->_pre_processor == "ClassifyPreProcessor") {
@@ -29,7 +50,7 @@ namespace PaddleSolution {
             if (!p->init(config)) {
                 return nullptr;
             }
-            return p;
+            return with_tensor_cache(config, p);
         }
 
         if (config->_pre_processor == "DetectionPreProcessor") {
@@ -37,11 +58,14 @@ namespace PaddleSolution {
             if (!p->init(config)) {
                 return nullptr;
             }
+            if (config->_tensor_cache) {
+                LOG(WARNING) << "DEPLOY.TENSOR_CACHE does not apply to the variable sized detection inputs";
+            }
             return p;
         }
 	
 
-        LOG(FATAL) << "unknown processor_name [" << config->_pre_processor << "]";
+        LOG(ERROR) << "unknown processor_name [" << config->_pre_processor << "]";
 
         return nullptr;
     }
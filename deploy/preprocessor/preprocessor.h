@@ -1,4 +1,6 @@
 #pragma once
+#include <cstdint>
+#include <cstring>
 #include <vector>
 #include <string>
 #include <memory>
@@ -8,6 +10,10 @@
 #include <opencv2/highgui/highgui.hpp>
 
 #include "utils/seg_conf_parser.h"
+#include "utils/image_source.h"
+#include "utils/mat_pool.h"
+#include "utils/thread_pool.h"
+#include "utils/trace.h"
 
 namespace  PaddleSolution {
 
@@ -42,6 +48,93 @@ public:
 	return true;
     }
 
+    // same as above, but images may also be encoded bytes held in memory
+    virtual bool batch_process(const std::vector<ImageBlob>& imgs, float* data, int* ori_w, int* ori_h) {
+        return true;
+    }
+
+    virtual bool batch_process(const std::vector<ImageBlob>& imgs, float* data) {
+        return true;
+    }
+
+    virtual bool batch_process(const std::vector<ImageBlob>& imgs, std::vector<std::vector<float>> &data, int* ori_w, int* ori_h, int* resize_w, int* resize_h, float* scale_ratio) {
+        return true;
+    }
+
+    // DEPLOY.INPUT_DTYPE UINT8: only resize (and crop), the pixels are written as
+    // uint8 in DEPLOY.INPUT_LAYOUT and the model does the normalization
+    virtual bool batch_process(const std::vector<ImageBlob>& imgs, uint8_t* data, int* ori_w, int* ori_h) {
+        return false;
+    }
+
+    virtual bool batch_process(const std::vector<ImageBlob>& imgs, uint8_t* data) {
+        return false;
+    }
+
+    // return the borrowed image or decode the blob bytes if any, read the file
+    // `blob.name` otherwise. A borrowed image is shared, never write into it.
+    static cv::Mat read_image(const ImageBlob& blob, int flags) {
+        if (!blob.mat.empty()) {
+            return blob.mat;
+        }
+        PADDLESEG_TRACE_SPAN("decode");
+        const unsigned char* bytes = blob.data.empty() ? blob.bytes : blob.data.data();
+        std::size_t size = blob.data.empty() ? blob.size : blob.data.size();
+        if (size == 0) {
+            return cv::imread(blob.name, flags);
+        }
+        cv::Mat buf(1, static_cast<int>(size), CV_8UC1, const_cast<unsigned char*>(bytes));
+        return utils::MatPool::decode(buf, flags);
+    }
+
+    // one flag per image of the last batch_process of ImageBlobs, set for the
+    // images that could not be read or decoded; their part of the batch is
+    // not filled
+    const std::vector<char>& failed() const {
+        return _failed;
+    }
+
+    // the positions of the failed() images, ascending
+    void failed_positions(std::vector<int>* positions) const {
+        positions->clear();
+        for (int i = 0; i < _failed.size(); ++i) {
+            if (_failed[i]) {
+                positions->push_back(i);
+            }
+        }
+    }
+
+protected:
+    std::vector<char> _failed;
+
+    // copy the pixels of an 8-bit HWC image to `data` as CHW, or as HWC if `nhwc`
+    static void copy_pixels(const cv::Mat& im, uint8_t* data, bool nhwc) {
+        int hh = im.rows;
+        int ww = im.cols;
+        int cc = im.channels();
+        for (int h = 0; h < hh; ++h) {
+            const uchar* ptr = im.ptr<uchar>(h);
+            if (nhwc) {
+                memcpy(data + h * ww * cc, ptr, ww * cc);
+                continue;
+            }
+            int im_index = 0;
+            for (int w = 0; w < ww; ++w) {
+                for (int c = 0; c < cc; ++c) {
+                    data[(c * hh + h) * ww + w] = ptr[im_index++];
+                }
+            }
+        }
+    }
+
+    static std::vector<ImageBlob> to_blobs(const std::vector<std::string>& imgs) {
+        std::vector<ImageBlob> blobs(imgs.size());
+        for (int i = 0; i < imgs.size(); ++i) {
+            blobs[i].name = imgs[i];
+        }
+        return blobs;
+    }
+
 }; // end of class ImagePreProcessor
 
 std::shared_ptr<ImagePreProcessor> create_processor(const std::string &config_file);
@@ -1,20 +1,29 @@
-#include <thread>
-
 #include <glog/logging.h>
  
 #include "preprocessor_classify.h"
+#include "fused_resize.h"
 #include "utils/utils.h"
 
 namespace PaddleSolution {
 
     bool ClassifyPreProcessor::single_process(const std::string& fname, float* data) {
+        ImageBlob img;
+        img.name = fname;
+        return single_process(img, data);
+    }
+
+    bool ClassifyPreProcessor::load_image(const ImageBlob& img, bool scale, cv::Mat* image) {
         // 1. read image
-        cv::Mat im = cv::imread(fname);
+        cv::Mat im = read_image(img, cv::IMREAD_COLOR);
         if (im.data == nullptr || im.empty()) {
-            LOG(ERROR) << "Failed to open image: " << fname;
+            LOG(ERROR) << "Failed to open image: " << img.name;
             return false;
         }
-        im.convertTo(im, CV_32FC3, 1/255.0);
+        if (scale) {
+            cv::Mat scaled = utils::MatPool::acquire(im.rows, im.cols, CV_32FC3);
+            im.convertTo(scaled, CV_32FC3, 1/255.0);
+            im = scaled;
+        }
         int channels = im.channels();
         auto ori_w = im.cols;
         auto ori_h = im.rows;
@@ -27,7 +36,10 @@ namespace PaddleSolution {
   //      std::cout << "w = " << rw << " h = " << rh << " scale_ratio = " << im_scale_ratio << std::endl;
         cv::Size resize_size(rw, rh);
         if (ori_h != rh || ori_w != rw) {
-            cv::resize(im, im, resize_size);
+            PADDLESEG_TRACE_SPAN("resize");
+            cv::Mat resized = utils::MatPool::acquire(rh, rw, im.type());
+            cv::resize(im, resized, resize_size);
+            im = resized;
         }
         // 3. crop from the center
         int edgey = _config->_crop_size[1];
@@ -35,8 +47,50 @@ namespace PaddleSolution {
         int yy = static_cast<int>((im.rows - edgey) / 2);
         int xx = static_cast<int>((im.cols - edgex) / 2);
 	im = cv::Mat(im, cv::Rect(xx, yy, edgex, edgey));
-        cvtColor(im, im, CV_BGR2RGB);
+        // the crop may still point into a borrowed image, convert out of place
+        PADDLESEG_TRACE_SPAN("color");
+        cv::Mat rgb = utils::MatPool::acquire(im.rows, im.cols, im.type());
+        cvtColor(im, rgb, CV_BGR2RGB);
+        *image = rgb;
+        return true;
+    }
+
+    bool ClassifyPreProcessor::fused_process(const cv::Mat& im, float* data) {
+        int rw = im.cols;
+        int rh = im.rows;
+        float im_scale_ratio = 1;
+        utils::scaling(_config->_resize_type, rw, rh, _config->_resize[0], _config->_resize[1], _config->_target_short_size, _config->_resize_max_size, im_scale_ratio);
+        int edgey = _config->_crop_size[1];
+        int edgex = _config->_crop_size[0];
+        int yy = static_cast<int>((rh - edgey) / 2);
+        int xx = static_cast<int>((rw - edgex) / 2);
+        if (xx < 0 || yy < 0) {
+            return false;
+        }
+        // the pixels are not scaled to [0, 1] before the resize, it is linear
+        PADDLESEG_TRACE_SPAN("resize");
+        fused_resize_normalize(im, cv::Size(rw, rh), cv::Rect(xx, yy, edgex, edgey),
+                               _config->_mean.data(), _config->_std.data(), true, data);
+        return true;
+    }
+
+    bool ClassifyPreProcessor::single_process(const ImageBlob& img, float* data) {
+        if (_fused) {
+            cv::Mat im = read_image(img, cv::IMREAD_COLOR);
+            if (im.data == nullptr || im.empty()) {
+                LOG(ERROR) << "Failed to open image: " << img.name;
+                return false;
+            }
+            if (fused_process(im, data)) {
+                return true;
+            }
+        }
+        cv::Mat im;
+        if (!load_image(img, true, &im)) {
+            return false;
+        }
         // 4. (img - mean) / std
+        PADDLESEG_TRACE_SPAN("normalize");
         int hh = im.rows;
         int ww = im.cols;
         int cc = im.channels();
@@ -69,28 +123,52 @@ namespace PaddleSolution {
         return true;
     }
 
+    bool ClassifyPreProcessor::single_process(const ImageBlob& img, uint8_t* data) {
+        cv::Mat im;
+        if (!load_image(img, false, &im)) {
+            return false;
+        }
+        copy_pixels(im, data, _config->_input_layout == "NHWC");
+        return true;
+    }
+
     bool ClassifyPreProcessor::batch_process(const std::vector<std::string>& imgs, float* data) {
+        return batch_process(to_blobs(imgs), data);
+    }
+
+    bool ClassifyPreProcessor::batch_process(const std::vector<ImageBlob>& imgs, float* data) {
         auto ic = _config->_channels;
         auto iw = _config->_resize[0];
         auto ih = _config->_resize[1];
-        std::vector<std::thread> threads;
-        for (int i = 0; i < imgs.size(); ++i) {
-            std::string path = imgs[i];
+        _failed.assign(imgs.size(), 0);
+        // on the long lived workers of the current pool, so their MatPool buffers are reused
+        utils::ThreadPool::current().parallel_for(imgs.size(), [&](int i) {
+            PADDLESEG_TRACE_IMAGE(i);
+            const ImageBlob* img = &imgs[i];
             float* buffer = data + i * ic * iw * ih;
-            threads.emplace_back([this, path, buffer] {
-                single_process(path, buffer);
-                });
-        }
-        for (auto& t : threads) {
-            if (t.joinable()) {
-                t.join();
-            }
-        }
+            _failed[i] = !single_process(*img, buffer);
+        });
+        return true;
+    }
+
+    bool ClassifyPreProcessor::batch_process(const std::vector<ImageBlob>& imgs, uint8_t* data) {
+        auto ic = _config->_channels;
+        auto iw = _config->_resize[0];
+        auto ih = _config->_resize[1];
+        _failed.assign(imgs.size(), 0);
+        // on the long lived workers of the current pool, so their MatPool buffers are reused
+        utils::ThreadPool::current().parallel_for(imgs.size(), [&](int i) {
+            PADDLESEG_TRACE_IMAGE(i);
+            const ImageBlob* img = &imgs[i];
+            uint8_t* buffer = data + i * ic * iw * ih;
+            _failed[i] = !single_process(*img, buffer);
+        });
         return true;
     }
 
     bool ClassifyPreProcessor::init(std::shared_ptr<PaddleSolution::PaddleSegModelConfigPaser> config) {
         _config = config;
+        _fused = config->_fused_resize != 0 && fused_resize_validated();
         return true;
     }
 }
@@ -7,7 +7,7 @@ namespace PaddleSolution {
     class ClassifyPreProcessor : public ImagePreProcessor {
 
     public:
-        ClassifyPreProcessor() : _config(nullptr) {
+        ClassifyPreProcessor() : _config(nullptr), _fused(false) {
         };
 
         bool init(std::shared_ptr<PaddleSolution::PaddleSegModelConfigPaser> config);
@@ -16,8 +16,25 @@ namespace PaddleSolution {
 
         bool batch_process(const std::vector<std::string>& imgs, float* data);
 
+        bool single_process(const ImageBlob& img, float* data);
+
+        bool batch_process(const std::vector<ImageBlob>& imgs, float* data);
+
+        bool single_process(const ImageBlob& img, uint8_t* data);
+
+        bool batch_process(const std::vector<ImageBlob>& imgs, uint8_t* data);
+
     private:
+        // decode, resize and center crop `img` into an RGB image, scaled to
+        // float in [0, 1] if `scale`, kept as uint8 otherwise
+        bool load_image(const ImageBlob& img, bool scale, cv::Mat* image);
+        // resize, crop and normalize the decoded BGR image `im` in one pass,
+        // false when the crop does not fit in the resized image
+        bool fused_process(const cv::Mat& im, float* data);
+
         std::shared_ptr<PaddleSolution::PaddleSegModelConfigPaser> _config;
+        // DEPLOY.FUSED_RESIZE, once checked against cv::resize
+        bool _fused;
     };
 
 }
@@ -1,29 +1,58 @@
-#include <thread>
 #include <mutex>
 
 #include <glog/logging.h>
 
 #include "preprocessor_detection.h"
+#include "fused_resize.h"
 #include "utils/utils.h"
 
 namespace PaddleSolution {
     bool DetectionPreProcessor::single_process(const std::string& fname, std::vector<float> &vec_data, int* ori_w, int* ori_h, int* resize_w, int* resize_h, float* scale_ratio) {
-        cv::Mat im1 = cv::imread(fname, -1);
+        ImageBlob img;
+        img.name = fname;
+        return single_process(img, vec_data, ori_w, ori_h, resize_w, resize_h, scale_ratio);
+    }
+
+    bool DetectionPreProcessor::single_process(const ImageBlob& img, std::vector<float> &vec_data, int* ori_w, int* ori_h, int* resize_w, int* resize_h, float* scale_ratio) {
+        cv::Mat im1 = read_image(img, -1);
+        if (_fused && im1.type() == CV_8UC3) {
+            // color conversion, resize and normalize in one pass, straight
+            // from the 8-bit image for both models
+            int rw = im1.cols;
+            int rh = im1.rows;
+            float im_scale_ratio;
+            utils::scaling(_config->_resize_type, rw, rh, _config->_resize[0], _config->_resize[1], _config->_target_short_size, _config->_resize_max_size, im_scale_ratio);
+            *ori_w = im1.cols;
+            *ori_h = im1.rows;
+            *resize_w = rw;
+            *resize_h = rh;
+            *scale_ratio = im_scale_ratio;
+            double fx = _config->_resize_type == utils::SCALE_TYPE::RANGE_SCALING ? im_scale_ratio : 0;
+            PADDLESEG_TRACE_SPAN("resize");
+            vec_data.resize(3 * rw * rh);
+            fused_resize_normalize(im1, cv::Size(rw, rh), cv::Rect(0, 0, rw, rh), _config->_mean.data(),
+                                   _config->_std.data(), true, vec_data.data(), cv::INTER_LINEAR, fx, fx);
+            return true;
+        }
         cv::Mat im;
         if(_config->_feeds_size == 3) { // faster rcnn
+            im = utils::MatPool::acquire(im1.rows, im1.cols, CV_MAKETYPE(CV_32F, im1.channels()));
             im1.convertTo(im, CV_32FC3, 1/255.0);
         }
         else if(_config->_feeds_size == 2){ //yolo v3
             im = im1;
         }
         if (im.data == nullptr || im.empty()) {
-            LOG(ERROR) << "Failed to open image: " << fname;
+            LOG(ERROR) << "Failed to open image: " << img.name;
             return false;
         }
         
         int channels = im.channels();
 		if (channels == 1) {
-            cv::cvtColor(im, im, cv::COLOR_GRAY2BGR);
+            PADDLESEG_TRACE_SPAN("color");
+            cv::Mat bgr = utils::MatPool::acquire(im.rows, im.cols, CV_MAKETYPE(im.depth(), 3));
+            cv::cvtColor(im, bgr, cv::COLOR_GRAY2BGR);
+            im = bgr;
         }
         channels = im.channels();
         if (channels != 3 && channels != 4) {
@@ -32,7 +61,13 @@ namespace PaddleSolution {
         }
         *ori_w = im.cols;
         *ori_h = im.rows;
-        cv::cvtColor(im, im, cv::COLOR_BGR2RGB);      
+        // not in place, `im` may be an image borrowed from the caller
+        cv::Mat rgb = utils::MatPool::acquire(im.rows, im.cols, im.type());
+        {
+            PADDLESEG_TRACE_SPAN("color");
+            cv::cvtColor(im, rgb, cv::COLOR_BGR2RGB);
+        }
+        im = rgb;
         //channels = im.channels();
 
         //resize
@@ -45,7 +80,8 @@ namespace PaddleSolution {
         *resize_h = rh;
         *scale_ratio = im_scale_ratio;
         if (*ori_h != rh || *ori_w != rw) {
-            cv::Mat im_temp;
+            PADDLESEG_TRACE_SPAN("resize");
+            cv::Mat im_temp = utils::MatPool::acquire(rh, rw, im.type());
             if(_config->_resize_type == utils::SCALE_TYPE::UNPADDING) {
                 cv::resize(im, im_temp, resize_size, 0, 0, cv::INTER_LINEAR);
             }
@@ -55,6 +91,7 @@ namespace PaddleSolution {
             im = im_temp;
         }
 
+        PADDLESEG_TRACE_SPAN("normalize");
         vec_data.resize(channels * rw * rh);
         float *data = vec_data.data();
 
@@ -83,33 +120,33 @@ namespace PaddleSolution {
     }
 
     bool DetectionPreProcessor::batch_process(const std::vector<std::string>& imgs, std::vector<std::vector<float>> &data, int* ori_w, int* ori_h, int* resize_w, int* resize_h, float* scale_ratio) {
+        return batch_process(to_blobs(imgs), data, ori_w, ori_h, resize_w, resize_h, scale_ratio);
+    }
+
+    bool DetectionPreProcessor::batch_process(const std::vector<ImageBlob>& imgs, std::vector<std::vector<float>> &data, int* ori_w, int* ori_h, int* resize_w, int* resize_h, float* scale_ratio) {
         auto ic = _config->_channels;
         auto iw = _config->_resize[0];
         auto ih = _config->_resize[1];
-        std::vector<std::thread> threads;
-        for (int i = 0; i < imgs.size(); ++i) {
-            std::string path = imgs[i];
+        _failed.assign(imgs.size(), 0);
+        // on the long lived workers of the current pool, so their MatPool buffers are reused
+        utils::ThreadPool::current().parallel_for(imgs.size(), [&](int i) {
+            PADDLESEG_TRACE_IMAGE(i);
+            const ImageBlob* img = &imgs[i];
             int* width = &ori_w[i];
             int* height = &ori_h[i];
             int* resize_width = &resize_w[i];
             int* resize_height = &resize_h[i];
             float* sr = &scale_ratio[i];
-            threads.emplace_back([this, &data, i, path, width, height, resize_width, resize_height, sr] {
-                std::vector<float> buffer;
-                single_process(path, buffer, width, height, resize_width, resize_height, sr);
-                data[i] = buffer;
-                });
-        }
-        for (auto& t : threads) {
-            if (t.joinable()) {
-                t.join();
-            }
-        }
+            // `data` may hold more buffers than images, each one keeps its capacity
+            std::vector<float>* buffer = &data[i];
+            _failed[i] = !single_process(*img, *buffer, width, height, resize_width, resize_height, sr);
+        });
         return true;
     }
 
     bool DetectionPreProcessor::init(std::shared_ptr<PaddleSolution::PaddleSegModelConfigPaser> config) {
         _config = config;
+        _fused = config->_fused_resize != 0 && fused_resize_validated();
         return true;
     }
 
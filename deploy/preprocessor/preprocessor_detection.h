@@ -7,7 +7,7 @@ namespace PaddleSolution {
     class DetectionPreProcessor : public ImagePreProcessor {
 
     public:
-        DetectionPreProcessor() : _config(nullptr) {
+        DetectionPreProcessor() : _config(nullptr), _fused(false) {
         };
 
         bool init(std::shared_ptr<PaddleSolution::PaddleSegModelConfigPaser> config);
@@ -15,8 +15,14 @@ namespace PaddleSolution {
         bool single_process(const std::string& fname, std::vector<float> &data, int* ori_w, int* ori_h, int* resize_w, int* resize_h, float* scale_ratio);
 
         bool batch_process(const std::vector<std::string>& imgs, std::vector<std::vector<float>> &data, int* ori_w, int* ori_h, int* resize_w, int* resize_h, float* scale_ratio);
+
+        bool single_process(const ImageBlob& img, std::vector<float> &data, int* ori_w, int* ori_h, int* resize_w, int* resize_h, float* scale_ratio);
+
+        bool batch_process(const std::vector<ImageBlob>& imgs, std::vector<std::vector<float>> &data, int* ori_w, int* ori_h, int* resize_w, int* resize_h, float* scale_ratio);
     private:
         std::shared_ptr<PaddleSolution::PaddleSegModelConfigPaser> _config;
+        // DEPLOY.FUSED_RESIZE, once checked against cv::resize
+        bool _fused;
     };
 
 }
@@ -1,15 +1,23 @@
-#include <thread>
-
 #include <glog/logging.h>
 
 #include "preprocessor_seg.h"
+#include "fused_resize.h"
 
 namespace PaddleSolution {
 
     bool SegPreProcessor::single_process(const std::string& fname, float* data, int* ori_w, int* ori_h) {
-        cv::Mat im = cv::imread(fname, -1);
+        ImageBlob img;
+        img.name = fname;
+        return single_process(img, data, ori_w, ori_h);
+    }
+
+    bool SegPreProcessor::load_image(const ImageBlob& img, cv::Mat* image, int* ori_w, int* ori_h) {
+        return load_image(img, read_image(img, -1), image, ori_w, ori_h);
+    }
+
+    bool SegPreProcessor::load_image(const ImageBlob& img, cv::Mat im, cv::Mat* image, int* ori_w, int* ori_h) {
         if (im.data == nullptr || im.empty()) {
-            LOG(ERROR) << "Failed to open image: " << fname;
+            LOG(ERROR) << "Failed to open image: " << img.name;
             return false;
         }
         
@@ -18,7 +26,10 @@ namespace PaddleSolution {
         *ori_h = im.rows;
 
         if (channels == 1) {
-            cv::cvtColor(im, im, cv::COLOR_GRAY2BGR);
+            PADDLESEG_TRACE_SPAN("color");
+            cv::Mat bgr = utils::MatPool::acquire(im.rows, im.cols, CV_8UC3);
+            cv::cvtColor(im, bgr, cv::COLOR_GRAY2BGR);
+            im = bgr;
         }
         channels = im.channels();
         if (channels != 3 && channels != 4) {
@@ -30,9 +41,35 @@ namespace PaddleSolution {
         int rw = resize_size.width;
         int rh = resize_size.height;
         if (*ori_h != rh || *ori_w != rw) {
-            cv::resize(im, im, resize_size, 0, 0, cv::INTER_LINEAR);
+            PADDLESEG_TRACE_SPAN("resize");
+            cv::Mat resized = utils::MatPool::acquire(rh, rw, im.type());
+            cv::resize(im, resized, resize_size, 0, 0, cv::INTER_LINEAR);
+            im = resized;
         }
+        *image = im;
+        return true;
+    }
 
+    bool SegPreProcessor::single_process(const ImageBlob& img, float* data, int* ori_w, int* ori_h) {
+        cv::Mat im = read_image(img, -1);
+        if (_fused && im.type() == CV_8UC3) {
+            *ori_w = im.cols;
+            *ori_h = im.rows;
+            // resize, normalize and transpose in one pass
+            PADDLESEG_TRACE_SPAN("resize");
+            cv::Size resize_size(_config->_resize[0], _config->_resize[1]);
+            fused_resize_normalize(im, resize_size, cv::Rect(0, 0, resize_size.width, resize_size.height),
+                                   _config->_mean.data(), _config->_std.data(), false, data);
+            return true;
+        }
+        if (!load_image(img, im, &im, ori_w, ori_h)) {
+            return false;
+        }
+        int rw = im.cols;
+        int rh = im.rows;
+        int channels = im.channels();
+
+        PADDLESEG_TRACE_SPAN("normalize");
         float* pmean = _config->_mean.data();
         float* pscale = _config->_std.data();
         for (int h = 0; h < rh; ++h) {
@@ -50,30 +87,56 @@ namespace PaddleSolution {
         return true;
     }
 
+    bool SegPreProcessor::single_process(const ImageBlob& img, uint8_t* data, int* ori_w, int* ori_h) {
+        cv::Mat im;
+        if (!load_image(img, &im, ori_w, ori_h)) {
+            return false;
+        }
+        copy_pixels(im, data, _config->_input_layout == "NHWC");
+        return true;
+    }
+
     bool SegPreProcessor::batch_process(const std::vector<std::string>& imgs, float* data, int* ori_w, int* ori_h) {
+        return batch_process(to_blobs(imgs), data, ori_w, ori_h);
+    }
+
+    bool SegPreProcessor::batch_process(const std::vector<ImageBlob>& imgs, float* data, int* ori_w, int* ori_h) {
         auto ic = _config->_channels;
         auto iw = _config->_resize[0];
         auto ih = _config->_resize[1];
-        std::vector<std::thread> threads;
-        for (int i = 0; i < imgs.size(); ++i) {
-            std::string path = imgs[i];
+        _failed.assign(imgs.size(), 0);
+        // on the long lived workers of the current pool, so their MatPool buffers are reused
+        utils::ThreadPool::current().parallel_for(imgs.size(), [&](int i) {
+            PADDLESEG_TRACE_IMAGE(i);
+            const ImageBlob* img = &imgs[i];
             float* buffer = data + i * ic * iw * ih;
             int* width = &ori_w[i];
             int* height = &ori_h[i];
-            threads.emplace_back([this, path, buffer, width, height] {
-                single_process(path, buffer, width, height);
-                });
-        }
-        for (auto& t : threads) {
-            if (t.joinable()) {
-                t.join();
-            }
-        }
+            _failed[i] = !single_process(*img, buffer, width, height);
+        });
+        return true;
+    }
+
+    bool SegPreProcessor::batch_process(const std::vector<ImageBlob>& imgs, uint8_t* data, int* ori_w, int* ori_h) {
+        auto ic = _config->_channels;
+        auto iw = _config->_resize[0];
+        auto ih = _config->_resize[1];
+        _failed.assign(imgs.size(), 0);
+        // on the long lived workers of the current pool, so their MatPool buffers are reused
+        utils::ThreadPool::current().parallel_for(imgs.size(), [&](int i) {
+            PADDLESEG_TRACE_IMAGE(i);
+            const ImageBlob* img = &imgs[i];
+            uint8_t* buffer = data + i * ic * iw * ih;
+            int* width = &ori_w[i];
+            int* height = &ori_h[i];
+            _failed[i] = !single_process(*img, buffer, width, height);
+        });
         return true;
     }
 
     bool SegPreProcessor::init(std::shared_ptr<PaddleSolution::PaddleSegModelConfigPaser> config) {
         _config = config;
+        _fused = config->_fused_resize != 0 && fused_resize_validated();
         return true;
     }
 
@@ -7,7 +7,7 @@ namespace PaddleSolution {
 class SegPreProcessor : public ImagePreProcessor {
 
 public:
-    SegPreProcessor() : _config(nullptr){
+    SegPreProcessor() : _config(nullptr), _fused(false) {
     };
 
     bool init(std::shared_ptr<PaddleSolution::PaddleSegModelConfigPaser> config);
@@ -16,8 +16,23 @@ public:
 
     bool batch_process(const std::vector<std::string>& imgs, float* data, int* ori_w, int* ori_h);
 
+    bool single_process(const ImageBlob& img, float* data, int* ori_w, int* ori_h);
+
+    bool batch_process(const std::vector<ImageBlob>& imgs, float* data, int* ori_w, int* ori_h);
+
+    bool single_process(const ImageBlob& img, uint8_t* data, int* ori_w, int* ori_h);
+
+    bool batch_process(const std::vector<ImageBlob>& imgs, uint8_t* data, int* ori_w, int* ori_h);
+
 private:
+    // decode `img` and resize it to EVAL_CROP_SIZE, the result has 3 or 4 channels
+    bool load_image(const ImageBlob& img, cv::Mat* image, int* ori_w, int* ori_h);
+    // same, from the image `im` already decoded from `img`
+    bool load_image(const ImageBlob& img, cv::Mat im, cv::Mat* image, int* ori_w, int* ori_h);
+
     std::shared_ptr<PaddleSolution::PaddleSegModelConfigPaser> _config;
+    // DEPLOY.FUSED_RESIZE, once checked against cv::resize
+    bool _fused;
 };
 
 }
@@ -0,0 +1,356 @@
+#include "tensor_cache.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include <glog/logging.h>
+#include <xxhash.h>
+
+#include "utils/content_hash.h"
+
+namespace PaddleSolution {
+
+    namespace {
+        const char kMagic[8] = { 'P', 'D', 'T', 'E', 'N', 'S', 'O', 'R' };
+        const uint32_t kVersion = 1;
+
+        // 64 bytes so the tensors of the records stay aligned
+        struct FileHeader {
+            char magic[8];
+            uint32_t version;
+            uint32_t reserved;
+            uint64_t fingerprint;
+            uint64_t tensor_size;
+            char padding[32];
+        };
+
+        struct RecordHeader {
+            uint64_t key;
+            int32_t ori_w;
+            int32_t ori_h;
+        };
+
+#ifndef _WIN32
+        // flock() for the lifetime of the object
+        class FileLock {
+        public:
+            explicit FileLock(int fd) : _fd(fd) {
+                flock(_fd, LOCK_EX);
+            }
+            ~FileLock() {
+                flock(_fd, LOCK_UN);
+            }
+        private:
+            int _fd;
+        };
+
+        bool write_all(int fd, const char* data, size_t size) {
+            while (size > 0) {
+                ssize_t written = write(fd, data, size);
+                if (written < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (written <= 0) {
+                    return false;
+                }
+                data += written;
+                size -= written;
+            }
+            return true;
+        }
+#endif
+    }
+
+    TensorCache::TensorCache()
+        : _fd(-1), _map(nullptr), _map_bytes(0), _tensor_size(0), _max_bytes(0), _file_bytes(0) {
+    }
+
+    TensorCache::~TensorCache() {
+#ifndef _WIN32
+        if (_map != nullptr) {
+            munmap(const_cast<char*>(_map), _map_bytes);
+        }
+        if (_fd >= 0) {
+            close(_fd);
+        }
+#endif
+    }
+
+    size_t TensorCache::record_bytes() const {
+        return sizeof(RecordHeader) + _tensor_size * sizeof(float);
+    }
+
+    bool TensorCache::open(const std::string& dir, uint64_t fingerprint, size_t tensor_size, uint64_t max_bytes) {
+#ifdef _WIN32
+        LOG(ERROR) << "DEPLOY.TENSOR_CACHE is not supported on Windows";
+        return false;
+#else
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.tensors", static_cast<unsigned long long>(fingerprint));
+        mkdir(dir.c_str(), 0755);
+        _path = utils::path_join(dir, name);
+        _tensor_size = tensor_size;
+        _max_bytes = max_bytes;
+        // appends are single O_APPEND writes of whole records, so several
+        // predictors and processes can share the file
+        _fd = ::open(_path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+        if (_fd < 0) {
+            LOG(ERROR) << "Fail to open the tensor cache: " << _path;
+            return false;
+        }
+        FileLock lock(_fd);
+        struct stat st;
+        if (fstat(_fd, &st) != 0) {
+            return false;
+        }
+        FileHeader header;
+        if (st.st_size == 0) {
+            memset(&header, 0, sizeof(header));
+            memcpy(header.magic, kMagic, sizeof(kMagic));
+            header.version = kVersion;
+            header.fingerprint = fingerprint;
+            header.tensor_size = tensor_size;
+            if (!write_all(_fd, reinterpret_cast<const char*>(&header), sizeof(header))) {
+                LOG(ERROR) << "Fail to write the tensor cache: " << _path;
+                return false;
+            }
+            _file_bytes = sizeof(header);
+            return true;
+        }
+        if (pread(_fd, &header, sizeof(header), 0) != sizeof(header)
+            || memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion
+            || header.fingerprint != fingerprint || header.tensor_size != tensor_size) {
+            LOG(ERROR) << "Not a tensor cache of this preprocessing config: " << _path;
+            return false;
+        }
+        // drop a record cut short by a crash, appending after it would shift
+        // all the following ones
+        size_t records = (st.st_size - sizeof(header)) / record_bytes();
+        size_t used = sizeof(header) + records * record_bytes();
+        if (used != static_cast<size_t>(st.st_size) && ftruncate(_fd, used) != 0) {
+            LOG(ERROR) << "Fail to truncate the tensor cache: " << _path;
+            return false;
+        }
+        _file_bytes = used;
+        if (records == 0) {
+            return true;
+        }
+        void* map = mmap(nullptr, used, PROT_READ, MAP_SHARED, _fd, 0);
+        if (map == MAP_FAILED) {
+            LOG(ERROR) << "Fail to map the tensor cache: " << _path;
+            return false;
+        }
+        _map = static_cast<const char*>(map);
+        _map_bytes = used;
+        _index.reserve(records);
+        for (size_t r = 0; r < records; ++r) {
+            const char* record = _map + sizeof(header) + r * record_bytes();
+            RecordHeader record_header;
+            memcpy(&record_header, record, sizeof(record_header));
+            _index.insert(std::make_pair(record_header.key, record));
+        }
+        std::cout << "tensor cache: " << records << " tensors in " << _path << std::endl;
+        return true;
+#endif
+    }
+
+    const float* TensorCache::find(uint64_t key, int* ori_w, int* ori_h) const {
+        auto it = _index.find(key);
+        if (it == _index.end()) {
+            return nullptr;
+        }
+        RecordHeader record_header;
+        memcpy(&record_header, it->second, sizeof(record_header));
+        *ori_w = record_header.ori_w;
+        *ori_h = record_header.ori_h;
+        return reinterpret_cast<const float*>(it->second + sizeof(RecordHeader));
+    }
+
+    void TensorCache::append(uint64_t key, const float* tensor, int ori_w, int ori_h) {
+#ifndef _WIN32
+        if (_fd < 0 || _index.count(key) > 0) {
+            return;
+        }
+        if (_max_bytes > 0 && _file_bytes + record_bytes() > _max_bytes) {
+            return;
+        }
+        std::vector<char> record(record_bytes());
+        RecordHeader record_header;
+        record_header.key = key;
+        record_header.ori_w = ori_w;
+        record_header.ori_h = ori_h;
+        memcpy(record.data(), &record_header, sizeof(record_header));
+        memcpy(record.data() + sizeof(record_header), tensor, _tensor_size * sizeof(float));
+
+        std::lock_guard<std::mutex> guard(_mutex);
+        if (!_appended.insert(key).second) {
+            return;
+        }
+        FileLock lock(_fd);
+        if (!write_all(_fd, record.data(), record.size())) {
+            LOG(WARNING) << "Fail to append to the tensor cache: " << _path;
+            return;
+        }
+        _file_bytes += record.size();
+#endif
+    }
+
+    uint64_t preprocess_fingerprint(const PaddleSegModelConfigPaser& config) {
+        uint64_t fingerprint = XXH64(&kVersion, sizeof(kVersion), 0);
+        auto mix = [&fingerprint](const void* data, size_t size) {
+            fingerprint = XXH64(&size, sizeof(size), fingerprint);
+            fingerprint = XXH64(data, size, fingerprint);
+        };
+        mix(config._pre_processor.data(), config._pre_processor.size());
+        mix(config._img_type.data(), config._img_type.size());
+        mix(&config._channels, sizeof(config._channels));
+        mix(config._resize.data(), config._resize.size() * sizeof(int));
+        mix(config._crop_size.data(), config._crop_size.size() * sizeof(int));
+        mix(config._mean.data(), config._mean.size() * sizeof(float));
+        mix(config._std.data(), config._std.size() * sizeof(float));
+        mix(&config._resize_type, sizeof(config._resize_type));
+        mix(&config._target_short_size, sizeof(config._target_short_size));
+        mix(&config._resize_max_size, sizeof(config._resize_max_size));
+        mix(&config._fused_resize, sizeof(config._fused_resize));
+        return fingerprint;
+    }
+
+    CachedPreProcessor::CachedPreProcessor(std::shared_ptr<ImagePreProcessor> processor, std::unique_ptr<TensorCache> cache)
+        : _processor(processor), _cache(std::move(cache)), _hits(0), _miss_count(0) {
+    }
+
+    bool CachedPreProcessor::cached_batch(const std::vector<ImageBlob>& imgs, float* data, int* ori_w, int* ori_h) {
+        int batch_size = imgs.size();
+        size_t size = _cache->tensor_size();
+        _imgs.assign(imgs.begin(), imgs.end());
+        _keys.resize(batch_size);
+        // 1. hash the images and copy the cached tensors out of the mapping
+        _hit.assign(batch_size, 0);
+        _failed.assign(batch_size, 0);
+        utils::ThreadPool::current().parallel_for(batch_size, [&](int i) {
+            if (!utils::content_hash(&_imgs[i], 0, &_keys[i])) {
+                LOG(ERROR) << "Failed to open image: " << _imgs[i].name;
+                _failed[i] = 1;
+                if (ori_w != nullptr) {
+                    ori_w[i] = 0;
+                    ori_h[i] = 0;
+                }
+                return;
+            }
+            int width = 0;
+            int height = 0;
+            const float* tensor = _cache->find(_keys[i], &width, &height);
+            if (tensor == nullptr) {
+                return;
+            }
+            memcpy(data + i * size, tensor, size * sizeof(float));
+            if (ori_w != nullptr) {
+                ori_w[i] = width;
+                ori_h[i] = height;
+            }
+            _hit[i] = 1;
+        });
+        _misses.clear();
+        _miss_index.clear();
+        for (int i = 0; i < batch_size; ++i) {
+            _hits += _hit[i];
+            if (!_hit[i] && !_failed[i]) {
+                _misses.push_back(std::move(_imgs[i]));
+                _miss_index.push_back(i);
+            }
+        }
+        int miss_size = _misses.size();
+        _miss_count += miss_size;
+        std::cout << "tensor cache: hits = " << _hits << ", misses = " << _miss_count << std::endl;
+        if (miss_size == 0) {
+            return true;
+        }
+
+        // 2. preprocess the others, the images already read from their files
+        // are decoded from memory. The ones that failed are not cached.
+        _miss_buffer.resize(miss_size * size);
+        _miss_w.assign(miss_size, 0);
+        _miss_h.assign(miss_size, 0);
+        bool processed = ori_w != nullptr
+            ? _processor->batch_process(_misses, _miss_buffer.data(), _miss_w.data(), _miss_h.data())
+            : _processor->batch_process(_misses, _miss_buffer.data());
+        if (!processed) {
+            return false;
+        }
+        const auto& failed = _processor->failed();
+        utils::ThreadPool::current().parallel_for(miss_size, [&](int k) {
+            int i = _miss_index[k];
+            _failed[i] = failed[k];
+            const float* tensor = _miss_buffer.data() + k * size;
+            memcpy(data + i * size, tensor, size * sizeof(float));
+            if (ori_w != nullptr) {
+                ori_w[i] = _miss_w[k];
+                ori_h[i] = _miss_h[k];
+            }
+            if (!failed[k]) {
+                _cache->append(_keys[i], tensor, _miss_w[k], _miss_h[k]);
+            }
+        });
+        return true;
+    }
+
+    bool CachedPreProcessor::single_process(const std::string& fname, float* data, int* ori_w, int* ori_h) {
+        return _processor->single_process(fname, data, ori_w, ori_h);
+    }
+
+    bool CachedPreProcessor::batch_process(const std::vector<std::string>& imgs, float* data, int* ori_w, int* ori_h) {
+        return batch_process(to_blobs(imgs), data, ori_w, ori_h);
+    }
+
+    bool CachedPreProcessor::single_process(const std::string& fname, float* data) {
+        return _processor->single_process(fname, data);
+    }
+
+    bool CachedPreProcessor::batch_process(const std::vector<std::string>& imgs, float* data) {
+        return batch_process(to_blobs(imgs), data);
+    }
+
+    bool CachedPreProcessor::single_process(const std::string& fname, std::vector<float> &data, int* ori_w, int* ori_h, int* resize_w, int* resize_h, float* scale_ratio) {
+        return _processor->single_process(fname, data, ori_w, ori_h, resize_w, resize_h, scale_ratio);
+    }
+
+    bool CachedPreProcessor::batch_process(const std::vector<std::string>& imgs, std::vector<std::vector<float>> &data, int* ori_w, int* ori_h, int* resize_w, int* resize_h, float* scale_ratio) {
+        return _processor->batch_process(imgs, data, ori_w, ori_h, resize_w, resize_h, scale_ratio);
+    }
+
+    bool CachedPreProcessor::batch_process(const std::vector<ImageBlob>& imgs, float* data, int* ori_w, int* ori_h) {
+        return cached_batch(imgs, data, ori_w, ori_h);
+    }
+
+    bool CachedPreProcessor::batch_process(const std::vector<ImageBlob>& imgs, float* data) {
+        return cached_batch(imgs, data, nullptr, nullptr);
+    }
+
+    bool CachedPreProcessor::batch_process(const std::vector<ImageBlob>& imgs, std::vector<std::vector<float>> &data, int* ori_w, int* ori_h, int* resize_w, int* resize_h, float* scale_ratio) {
+        bool processed = _processor->batch_process(imgs, data, ori_w, ori_h, resize_w, resize_h, scale_ratio);
+        _failed = _processor->failed();
+        return processed;
+    }
+
+    bool CachedPreProcessor::batch_process(const std::vector<ImageBlob>& imgs, uint8_t* data, int* ori_w, int* ori_h) {
+        bool processed = _processor->batch_process(imgs, data, ori_w, ori_h);
+        _failed = _processor->failed();
+        return processed;
+    }
+
+    bool CachedPreProcessor::batch_process(const std::vector<ImageBlob>& imgs, uint8_t* data) {
+        bool processed = _processor->batch_process(imgs, data);
+        _failed = _processor->failed();
+        return processed;
+    }
+
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "preprocessor.h"
+
+namespace PaddleSolution {
+
+    /* Preprocessed float tensors in a file, `<dir>/<fingerprint>.tensors`, which
+     * is memory-mapped when opened. The fingerprint covers the preprocessing
+     * config only, so a new model evaluated with the same preprocessing reuses
+     * the tensors of the previous runs. Records are fixed size and appended:
+     *
+     *     header: magic, version, fingerprint, floats per tensor
+     *     record: image hash, ori_w, ori_h, tensor
+     *
+     * Tensors appended by this run are found by the next runs, lookups only see
+     * the records mapped at open().
+     */
+    class TensorCache {
+    public:
+        TensorCache();
+        ~TensorCache();
+
+        // open or create the file, stop appending once it reaches `max_bytes`
+        // (0: no limit). Returns false when the file cannot be used.
+        bool open(const std::string& dir, uint64_t fingerprint, size_t tensor_size, uint64_t max_bytes);
+
+        // the tensor of image hash `key` inside the mapping, null if not cached
+        const float* find(uint64_t key, int* ori_w, int* ori_h) const;
+
+        // append a tensor of `tensor_size` floats, safe to call from several
+        // threads and processes
+        void append(uint64_t key, const float* tensor, int ori_w, int ori_h);
+
+        size_t tensor_size() const {
+            return _tensor_size;
+        }
+
+    private:
+        size_t record_bytes() const;
+
+        int _fd;
+        const char* _map;
+        size_t _map_bytes;
+        size_t _tensor_size;
+        uint64_t _max_bytes;
+        std::atomic<uint64_t> _file_bytes;
+        // mapped records by image hash
+        std::unordered_map<uint64_t, const char*> _index;
+        std::mutex _mutex;
+        // appended by this run, guarded by `_mutex`
+        std::unordered_set<uint64_t> _appended;
+        std::string _path;
+    };
+
+    // hash of the DEPLOY settings the preprocessed tensors depend on
+    uint64_t preprocess_fingerprint(const PaddleSegModelConfigPaser& config);
+
+    /* DEPLOY.TENSOR_CACHE: wraps the seg or classification preprocessor; the
+     * float batches are served from a TensorCache, only the images not found
+     * there are decoded, resized and normalized by the wrapped preprocessor and
+     * then appended. The other calls (uint8 input, single images) go straight
+     * to the wrapped preprocessor.
+     */
+    class CachedPreProcessor : public ImagePreProcessor {
+    public:
+        CachedPreProcessor(std::shared_ptr<ImagePreProcessor> processor, std::unique_ptr<TensorCache> cache);
+
+        bool single_process(const std::string& fname, float* data, int* ori_w, int* ori_h);
+        bool batch_process(const std::vector<std::string>& imgs, float* data, int* ori_w, int* ori_h);
+        bool single_process(const std::string& fname, float* data);
+        bool batch_process(const std::vector<std::string>& imgs, float* data);
+        bool single_process(const std::string& fname, std::vector<float> &data, int* ori_w, int* ori_h, int* resize_w, int* resize_h, float* scale_ratio);
+        bool batch_process(const std::vector<std::string>& imgs, std::vector<std::vector<float>> &data, int* ori_w, int* ori_h, int* resize_w, int* resize_h, float* scale_ratio);
+        bool batch_process(const std::vector<ImageBlob>& imgs, float* data, int* ori_w, int* ori_h);
+        bool batch_process(const std::vector<ImageBlob>& imgs, float* data);
+        bool batch_process(const std::vector<ImageBlob>& imgs, std::vector<std::vector<float>> &data, int* ori_w, int* ori_h, int* resize_w, int* resize_h, float* scale_ratio);
+        bool batch_process(const std::vector<ImageBlob>& imgs, uint8_t* data, int* ori_w, int* ori_h);
+        bool batch_process(const std::vector<ImageBlob>& imgs, uint8_t* data);
+
+    private:
+        // ori_w and ori_h are null for the classification preprocessor
+        bool cached_batch(const std::vector<ImageBlob>& imgs, float* data, int* ori_w, int* ori_h);
+
+        std::shared_ptr<ImagePreProcessor> _processor;
+        std::unique_ptr<TensorCache> _cache;
+        // per batch scratch, the predictor calls one batch at a time
+        std::vector<ImageBlob> _imgs;
+        std::vector<uint64_t> _keys;
+        std::vector<char> _hit;
+        std::vector<ImageBlob> _misses;
+        std::vector<int> _miss_index;
+        std::vector<float> _miss_buffer;
+        std::vector<int> _miss_w;
+        std::vector<int> _miss_h;
+        uint64_t _hits;
+        uint64_t _miss_count;
+    };
+
+}
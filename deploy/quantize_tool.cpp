@@ -0,0 +1,219 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+#include <glog/logging.h>
+#include <utils/utils.h>
+#include <utils/image_source.h>
+#include <predictor/seg_predictor.h>
+#include <predictor/classify_predictor.h>
+#include <predictor/detection_predictor.h>
+
+DEFINE_string(model_type, "classify", "Type of the model: classify, detection or seg");
+DEFINE_string(conf, "", "Configuration File Path of the FP32 model");
+DEFINE_string(quant_conf, "", "Configuration File Path of the same model with DEPLOY.QUANTIZE enabled");
+DEFINE_string(calibration_dir, "", "Directory of the calibration images");
+DEFINE_string(calibration_list, "", "File listing the calibration images, one path per line");
+DEFINE_string(eval_dir, "", "Directory of the images compared between FP32 and INT8");
+DEFINE_string(eval_list, "", "File listing the images compared between FP32 and INT8, one path per line");
+DEFINE_string(report, "", "Also write the comparison report to this file");
+
+namespace PaddleSolution {
+    // agreement of the INT8 results with the FP32 ones
+    struct Comparison {
+        Comparison() : images(0), matched(0), total_diff(0), max_diff(0) {
+        }
+
+        void add(bool match, double diff) {
+            ++images;
+            matched += match ? 1 : 0;
+            total_diff += diff;
+            max_diff = std::max(max_diff, diff);
+        }
+
+        int images;
+        int matched;
+        double total_diff;
+        double max_diff;
+    };
+
+    // match: same top-1 class; diff: change of the FP32 top-1 score
+    void compare(const ClassifyResult& fp32, const ClassifyResult& int8, Comparison* cmp) {
+        double diff = 0;
+        if (fp32.label < int8.scores.size()) {
+            diff = std::fabs(fp32.scores[fp32.label] - int8.scores[fp32.label]);
+        }
+        cmp->add(fp32.label == int8.label, diff);
+    }
+
+    static float box_iou(const DetectionBox& a, const DetectionBox& b) {
+        float w = std::min(a.right_bottom_x(), b.right_bottom_x()) - std::max(a.left_top_x(), b.left_top_x());
+        float h = std::min(a.right_bottom_y(), b.right_bottom_y()) - std::max(a.left_top_y(), b.left_top_y());
+        if (w <= 0 || h <= 0) {
+            return 0;
+        }
+        float area_a = (a.right_bottom_x() - a.left_top_x()) * (a.right_bottom_y() - a.left_top_y());
+        float area_b = (b.right_bottom_x() - b.left_top_x()) * (b.right_bottom_y() - b.left_top_y());
+        return w * h / (area_a + area_b - w * h);
+    }
+
+    // match: same number of boxes and every FP32 box has an INT8 box of its class
+    // with IoU >= 0.5; diff: 1 - mean best IoU of the FP32 boxes
+    void compare(const DetectionResult& fp32, const DetectionResult& int8, Comparison* cmp) {
+        bool match = fp32.detection_boxes_size() == int8.detection_boxes_size();
+        double total_iou = 0;
+        for (const auto& box : fp32.detection_boxes()) {
+            float best = 0;
+            for (const auto& other : int8.detection_boxes()) {
+                if (other.class_() == box.class_()) {
+                    best = std::max(best, box_iou(box, other));
+                }
+            }
+            match = match && best >= 0.5;
+            total_iou += best;
+        }
+        int num = fp32.detection_boxes_size();
+        cmp->add(match, num > 0 ? 1 - total_iou / num : 0);
+    }
+
+    // match: at least 99% of the pixels get the same label; diff: fraction of
+    // pixels whose label changed
+    void compare(const SegResult& fp32, const SegResult& int8, Comparison* cmp) {
+        double diff = 1;
+        if (fp32.mask.size() == int8.mask.size() && !fp32.mask.empty()) {
+            diff = static_cast<double>(cv::countNonZero(fp32.mask != int8.mask)) / fp32.mask.total();
+        }
+        cmp->add(diff <= 0.01, diff);
+    }
+
+    // collect all the images of a source, only their paths are kept
+    std::vector<ImageBlob> load_images(const std::string& input_dir, const std::string& input_list) {
+        std::vector<ImageBlob> imgs;
+        if (input_dir.empty() && input_list.empty()) {
+            return imgs;
+        }
+        auto source = create_image_source(input_dir, input_list, "path", ".jpeg|.jpg|.JPEG|.JPG|.png|.PNG");
+        if (source == nullptr) {
+            return imgs;
+        }
+        std::vector<ImageBlob> batch;
+        while (source->next_batch(batch, 64) > 0) {
+            imgs.insert(imgs.end(), batch.begin(), batch.end());
+        }
+        return imgs;
+    }
+
+    // predict `imgs` and return the elapsed seconds, -1 on failure
+    template <typename PredictorT, typename ResultT>
+    double timed_predict(PredictorT& predictor, const std::vector<ImageBlob>& imgs, std::vector<ResultT>* results) {
+        auto t1 = std::chrono::high_resolution_clock::now();
+        if (predictor.predict(imgs, results) != 0) {
+            return -1;
+        }
+        auto t2 = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count() / 1e6;
+    }
+
+    template <typename PredictorT, typename ResultT>
+    int quantize(const char* match_desc, const char* diff_desc) {
+        // 1. FP32 model, it also preprocesses the calibration images
+        PredictorT fp32_predictor;
+        if (fp32_predictor.init(FLAGS_conf) != 0) {
+            LOG(ERROR) << "Fail to init the FP32 predictor: " << FLAGS_conf;
+            return -1;
+        }
+
+        // 2. write the warmup data the INT8 predictor computes its scales on
+        PaddleSegModelConfigPaser quant_config;
+        quant_config.load_config(FLAGS_quant_conf);
+        if (!quant_config._quantize || quant_config._quantize_warmup_data.empty()) {
+            LOG(ERROR) << "DEPLOY.QUANTIZE.ENABLE and WARMUP_DATA must be set in: " << FLAGS_quant_conf;
+            return -1;
+        }
+        auto calibration_imgs = load_images(FLAGS_calibration_dir, FLAGS_calibration_list);
+        int warmup_batch_size = quant_config._quantize_warmup_batch_size;
+        if (warmup_batch_size <= 0 || warmup_batch_size > calibration_imgs.size()) {
+            warmup_batch_size = calibration_imgs.size();
+        }
+        if (warmup_batch_size == 0) {
+            LOG(ERROR) << "No calibration image found";
+            return -1;
+        }
+        calibration_imgs.resize(warmup_batch_size);
+        std::vector<paddle::PaddleTensor> warmup_data;
+        if (fp32_predictor.make_warmup_data(calibration_imgs, &warmup_data) != 0
+            || !write_warmup_data(quant_config._quantize_warmup_data, warmup_data)) {
+            LOG(ERROR) << "Fail to write the warmup data: " << quant_config._quantize_warmup_data;
+            return -1;
+        }
+        std::cout << "write " << warmup_batch_size << " calibration images to ["
+            << quant_config._quantize_warmup_data << "]" << std::endl;
+
+        // 3. INT8 model, the quantizer runs the warmup data during init
+        PredictorT int8_predictor;
+        if (int8_predictor.init(FLAGS_quant_conf) != 0) {
+            LOG(ERROR) << "Fail to init the INT8 predictor: " << FLAGS_quant_conf;
+            return -1;
+        }
+
+        // 4. compare them on the evaluation images
+        auto eval_imgs = load_images(FLAGS_eval_dir, FLAGS_eval_list);
+        if (eval_imgs.empty()) {
+            std::cout << "No evaluation image, skip the comparison" << std::endl;
+            return 0;
+        }
+        std::vector<ResultT> fp32_results;
+        std::vector<ResultT> int8_results;
+        double fp32_seconds = timed_predict(fp32_predictor, eval_imgs, &fp32_results);
+        double int8_seconds = timed_predict(int8_predictor, eval_imgs, &int8_results);
+        if (fp32_seconds < 0 || int8_seconds < 0 || fp32_results.size() != int8_results.size()) {
+            LOG(ERROR) << "Fail to predict the evaluation images";
+            return -1;
+        }
+        Comparison cmp;
+        for (int i = 0; i < fp32_results.size(); ++i) {
+            compare(fp32_results[i], int8_results[i], &cmp);
+        }
+
+        std::ostringstream report;
+        report << "images: " << cmp.images << std::endl;
+        report << "matched (" << match_desc << "): " << cmp.matched
+            << " (" << 100.0 * cmp.matched / cmp.images << "%)" << std::endl;
+        report << "diff (" << diff_desc << "): mean " << cmp.total_diff / cmp.images
+            << ", max " << cmp.max_diff << std::endl;
+        report << "FP32: " << fp32_seconds << " s, " << cmp.images / fp32_seconds << " images/s" << std::endl;
+        report << "INT8: " << int8_seconds << " s, " << cmp.images / int8_seconds << " images/s" << std::endl;
+        report << "speedup: " << fp32_seconds / int8_seconds << "x" << std::endl;
+        std::cout << report.str();
+        if (!FLAGS_report.empty()) {
+            std::ofstream out(FLAGS_report);
+            out << report.str();
+        }
+        return 0;
+    }
+}
+
+int main(int argc, char** argv) {
+    // 0. parse args
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    if (FLAGS_conf.empty() || FLAGS_quant_conf.empty()
+        || (FLAGS_calibration_dir.empty() && FLAGS_calibration_list.empty())) {
+        std::cout << "Usage: ./quantize_tool --model_type=classify|detection|seg --conf=/fp32/config --quant_conf=/int8/config "
+            << "--calibration_dir=/directory/of/calibration/images [--eval_dir=/directory/of/eval/images] [--report=report.txt]";
+        return -1;
+    }
+    if (FLAGS_model_type == "classify") {
+        return PaddleSolution::quantize<PaddleSolution::ClassifyPredictor, PaddleSolution::ClassifyResult>(
+            "same top-1 class", "change of the top-1 score");
+    } else if (FLAGS_model_type == "detection") {
+        return PaddleSolution::quantize<PaddleSolution::DetectionPredictor, PaddleSolution::DetectionResult>(
+            "same boxes at IoU 0.5", "1 - mean IoU");
+    } else if (FLAGS_model_type == "seg") {
+        return PaddleSolution::quantize<PaddleSolution::Predictor, PaddleSolution::SegResult>(
+            ">= 99% same pixels", "fraction of changed pixels");
+    }
+    std::cout << "Unknown model type: " << FLAGS_model_type << std::endl;
+    return -1;
+}
@@ -0,0 +1,48 @@
+#include <glog/logging.h>
+#include <utils/utils.h>
+#include <utils/image_source.h>
+#include <utils/image_shard.h>
+
+DEFINE_string(input_dir, "", "Directory of Input Images");
+DEFINE_string(input_list, "", "File (or - for stdin) listing the input images, one path per line");
+DEFINE_string(output_prefix, "", "Prefix of the output shards, written as <prefix>_00000.shard ...");
+DEFINE_int32(images_per_shard, 10000, "Number of images packed into each shard");
+
+int main(int argc, char** argv) {
+    // 0. parse args
+    google::ParseCommandLineFlags(&argc, &argv, true);
+    if (FLAGS_output_prefix.empty() || (FLAGS_input_dir.empty() && FLAGS_input_list.empty())
+        || FLAGS_images_per_shard <= 0) {
+        std::cout << "Usage: ./shard_packer --input_dir=/directory/of/your/input/images --output_prefix=/path/to/shards/prefix" << std::endl;
+        std::cout << "   or: ./shard_packer --input_list=/path/to/list/or/- --output_prefix=/path/to/shards/prefix [--images_per_shard=10000]";
+        return -1;
+    }
+    // 1. open the input images, only the paths are needed
+    auto source = PaddleSolution::create_image_source(FLAGS_input_dir, FLAGS_input_list, "path", ".jpeg|.jpg|.JPEG|.JPG|.png|.PNG");
+    if (source == nullptr) {
+        return -1;
+    }
+
+    // 2. pack them `images_per_shard` at a time
+    std::vector<PaddleSolution::ImageBlob> batch;
+    std::vector<std::string> imgs;
+    int shard_id = 0;
+    int total = 0;
+    while (source->next_batch(batch, FLAGS_images_per_shard) > 0) {
+        imgs.clear();
+        for (const auto& blob : batch) {
+            imgs.push_back(blob.name);
+        }
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), "_%05d.shard", shard_id++);
+        std::string shard_file = FLAGS_output_prefix + suffix;
+        if (!PaddleSolution::write_image_shard(shard_file, imgs)) {
+            LOG(ERROR) << "Fail to write shard: " << shard_file;
+            return -1;
+        }
+        total += imgs.size();
+        std::cout << "pack " << imgs.size() << " images into [" << shard_file << "] done" << std::endl;
+    }
+    std::cout << "pack " << total << " images into " << shard_id << " shards" << std::endl;
+    return 0;
+}
@@ -0,0 +1,93 @@
+#include "utils/alloc_counter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace PaddleSolution {
+    namespace utils {
+        static std::atomic<uint64_t>& counter() {
+            static std::atomic<uint64_t> count(0);
+            return count;
+        }
+
+        static thread_local int uncounted_depth = 0;
+
+        UncountedScope::UncountedScope() {
+            ++uncounted_depth;
+        }
+
+        UncountedScope::~UncountedScope() {
+            --uncounted_depth;
+        }
+
+        bool allocation_counter_enabled() {
+#ifdef PADDLESEG_ALLOC_COUNTER
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        uint64_t allocation_count() {
+            return counter().load(std::memory_order_relaxed);
+        }
+
+#ifdef PADDLESEG_ALLOC_COUNTER
+        static void* counted_alloc(std::size_t size) {
+            if (uncounted_depth == 0) {
+                counter().fetch_add(1, std::memory_order_relaxed);
+            }
+            void* ptr = std::malloc(size == 0 ? 1 : size);
+            if (ptr == nullptr) {
+                throw std::bad_alloc();
+            }
+            return ptr;
+        }
+#endif
+    }
+}
+
+#ifdef PADDLESEG_ALLOC_COUNTER
+// defined in the same object as allocation_count(), so linking the hook also
+// links the replacement
+void* operator new(std::size_t size) {
+    return PaddleSolution::utils::counted_alloc(size);
+}
+
+void* operator new[](std::size_t size) {
+    return PaddleSolution::utils::counted_alloc(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return PaddleSolution::utils::counted_alloc(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return PaddleSolution::utils::counted_alloc(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+#endif
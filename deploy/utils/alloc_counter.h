@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+
+namespace PaddleSolution {
+    namespace utils {
+        /* Heap allocation counter, a hook for checking that the predict loops do
+         * not allocate in steady state. Global operator new is replaced only when
+         * built with -DWITH_ALLOC_COUNTER=ON; otherwise the count stays 0.
+         */
+        bool allocation_counter_enabled();
+
+        // allocations made through operator new by all threads so far
+        uint64_t allocation_count();
+
+        // allocations made since construction
+        class AllocationScope {
+        public:
+            AllocationScope() : _start(allocation_count()) {
+            }
+            uint64_t count() const {
+                return allocation_count() - _start;
+            }
+        private:
+            uint64_t _start;
+        };
+
+        // allocations of the calling thread are not counted while one is alive,
+        // for code standing in for a library whose allocations are not the loop's
+        class UncountedScope {
+        public:
+            UncountedScope();
+            ~UncountedScope();
+        };
+    }
+}
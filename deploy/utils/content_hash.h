@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+
+#include <xxhash.h>
+#include <opencv2/core/core.hpp>
+
+#include "utils/image_source.h"
+
+namespace PaddleSolution {
+    namespace utils {
+        // xxhash64 of the encoded bytes of `blob`, or of the pixels of a decoded
+        // image, seeded with `seed`. Files are read into `blob->data` so they are
+        // decoded from memory afterwards instead of being read a second time.
+        // Returns false when the file cannot be read.
+        inline bool content_hash(ImageBlob* blob, uint64_t seed, uint64_t* hash) {
+            if (!blob->mat.empty()) {
+                const cv::Mat& mat = blob->mat;
+                seed = XXH64(&mat.rows, sizeof(mat.rows), seed);
+                seed = XXH64(&mat.cols, sizeof(mat.cols), seed);
+                for (int row = 0; row < mat.rows; ++row) {
+                    seed = XXH64(mat.ptr(row), mat.cols * mat.elemSize(), seed);
+                }
+                *hash = seed;
+                return true;
+            }
+            if (!blob->in_memory()) {
+                std::ifstream in(blob->name, std::ios::in | std::ios::binary);
+                if (!in) {
+                    return false;
+                }
+                blob->data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+            }
+            const unsigned char* bytes = blob->data.empty() ? blob->bytes : blob->data.data();
+            size_t size = blob->data.empty() ? blob->size : blob->data.size();
+            *hash = XXH64(bytes, size, seed);
+            return true;
+        }
+    }
+}
@@ -0,0 +1,124 @@
+#include "utils/cpu_topology.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+namespace PaddleSolution {
+    namespace utils {
+        std::vector<int> parse_cpu_list(const std::string& list) {
+            std::vector<int> cpus;
+            std::stringstream ss(list);
+            std::string range;
+            while (std::getline(ss, range, ',')) {
+                if (range.empty() || range == "\n") {
+                    continue;
+                }
+                int first = 0;
+                int last = 0;
+                auto dash = range.find('-');
+                try {
+                    first = std::stoi(range.substr(0, dash));
+                    last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+                } catch (const std::exception& e) {
+                    return std::vector<int>();
+                }
+                for (int cpu = first; cpu <= last; ++cpu) {
+                    cpus.push_back(cpu);
+                }
+            }
+            return cpus;
+        }
+
+        std::vector<std::vector<int>> numa_node_cpus() {
+            std::vector<std::vector<int>> nodes;
+            // leave out the cpus the process may not run on (taskset, cgroup cpusets)
+            auto allowed = current_thread_cpus();
+            // node ids are dense on the hosts we run on, stop at the first gap
+            for (int node = 0; ; ++node) {
+                std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+                if (!in) {
+                    break;
+                }
+                std::string list;
+                std::getline(in, list);
+                std::vector<int> cpus;
+                for (int cpu : parse_cpu_list(list)) {
+                    if (allowed.empty() || std::find(allowed.begin(), allowed.end(), cpu) != allowed.end()) {
+                        cpus.push_back(cpu);
+                    }
+                }
+                // memory-only nodes have no cpu
+                if (!cpus.empty()) {
+                    nodes.push_back(cpus);
+                }
+            }
+            if (nodes.empty()) {
+                auto cpus = allowed;
+                if (cpus.empty()) {
+                    int count = std::max(1u, std::thread::hardware_concurrency());
+                    for (int cpu = 0; cpu < count; ++cpu) {
+                        cpus.push_back(cpu);
+                    }
+                }
+                nodes.push_back(cpus);
+            }
+            return nodes;
+        }
+
+        std::vector<std::vector<int>> cpu_groups(const std::string& mode, int cores_per_group) {
+            std::vector<std::vector<int>> groups;
+            auto nodes = numa_node_cpus();
+            if (mode == "NUMA") {
+                return nodes;
+            }
+            if (mode != "CORES" || cores_per_group <= 0) {
+                return groups;
+            }
+            for (const auto& cpus : nodes) {
+                for (int i = 0; i < cpus.size(); i += cores_per_group) {
+                    int end = std::min<int>(i + cores_per_group, cpus.size());
+                    groups.push_back(std::vector<int>(cpus.begin() + i, cpus.begin() + end));
+                }
+            }
+            return groups;
+        }
+
+        bool pin_current_thread(const std::vector<int>& cpus) {
+#ifdef __linux__
+            cpu_set_t mask;
+            CPU_ZERO(&mask);
+            for (int cpu : cpus) {
+                if (cpu >= 0 && cpu < CPU_SETSIZE) {
+                    CPU_SET(cpu, &mask);
+                }
+            }
+            // pid 0 is the calling thread
+            return sched_setaffinity(0, sizeof(mask), &mask) == 0;
+#else
+            return false;
+#endif
+        }
+
+        std::vector<int> current_thread_cpus() {
+            std::vector<int> cpus;
+#ifdef __linux__
+            cpu_set_t mask;
+            CPU_ZERO(&mask);
+            if (sched_getaffinity(0, sizeof(mask), &mask) != 0) {
+                return cpus;
+            }
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if (CPU_ISSET(cpu, &mask)) {
+                    cpus.push_back(cpu);
+                }
+            }
+#endif
+            return cpus;
+        }
+    }
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace PaddleSolution {
+    namespace utils {
+        // cpu ids of a sysfs cpu list such as "0-3,8,10-11"
+        std::vector<int> parse_cpu_list(const std::string& list);
+
+        // cpus of each NUMA node as listed under /sys/devices/system/node, one
+        // group holding every online cpu when the host has no NUMA information
+        std::vector<std::vector<int>> numa_node_cpus();
+
+        /* Split the host into the cpu groups of the predictor shards:
+         *   mode "NUMA":  one group per NUMA node
+         *   mode "CORES": groups of `cores_per_group` cpus, never spanning two nodes
+         * An empty result means an unknown mode.
+         */
+        std::vector<std::vector<int>> cpu_groups(const std::string& mode, int cores_per_group);
+
+        // restrict the calling thread to `cpus`; threads it creates afterwards
+        // inherit the mask. Returns false where affinity is not supported.
+        bool pin_current_thread(const std::vector<int>& cpus);
+
+        // cpus the calling thread may currently run on, empty where unsupported
+        std::vector<int> current_thread_cpus();
+    }
+}
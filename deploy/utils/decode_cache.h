@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include <opencv2/core/core.hpp>
+
+namespace PaddleSolution {
+    namespace utils {
+        /* Decoded images by name, least recently used ones are dropped once the
+         * pixels exceed `capacity_bytes`. Several models fed from the same input
+         * share one decode; the cached images are read only.
+         */
+        class DecodeCache {
+        public:
+            explicit DecodeCache(uint64_t capacity_bytes)
+                : _capacity(capacity_bytes), _bytes(0), _hits(0), _misses(0) {
+            }
+
+            // the cached image of `name`, or the result of `decode()` which is
+            // then cached; decode runs outside the lock
+            template <typename DecodeFn>
+            cv::Mat get(const std::string& name, DecodeFn decode) {
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    auto it = _index.find(name);
+                    if (it != _index.end()) {
+                        _lru.splice(_lru.begin(), _lru, it->second);
+                        ++_hits;
+                        return it->second->second;
+                    }
+                }
+                ++_misses;
+                cv::Mat im = decode();
+                if (im.empty()) {
+                    return im;
+                }
+                put(name, im);
+                return im;
+            }
+
+            uint64_t hits() const {
+                return _hits;
+            }
+
+            uint64_t misses() const {
+                return _misses;
+            }
+
+        private:
+            void put(const std::string& name, const cv::Mat& im) {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (_index.count(name) > 0) {
+                    return;
+                }
+                _lru.push_front(std::make_pair(name, im));
+                _index[name] = _lru.begin();
+                _bytes += im.total() * im.elemSize();
+                // keep at least the image just added
+                while (_bytes > _capacity && _lru.size() > 1) {
+                    auto& last = _lru.back();
+                    _bytes -= last.second.total() * last.second.elemSize();
+                    _index.erase(last.first);
+                    _lru.pop_back();
+                }
+            }
+
+            typedef std::list<std::pair<std::string, cv::Mat>> LruList;
+
+            uint64_t _capacity;
+            uint64_t _bytes;
+            std::mutex _mutex;
+            LruList _lru;
+            std::unordered_map<std::string, LruList::iterator> _index;
+            std::atomic<uint64_t> _hits;
+            std::atomic<uint64_t> _misses;
+        };
+    }
+}
@@ -0,0 +1,217 @@
+#include "utils/image_shard.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace PaddleSolution {
+
+    static uint64_t align_up(uint64_t value, uint64_t align) {
+        return (value + align - 1) / align * align;
+    }
+
+    bool write_image_shard(const std::string& shard_file, const std::vector<std::string>& imgs) {
+        std::vector<ShardIndexEntry> index(imgs.size());
+        uint64_t name_offset = sizeof(ShardHeader) + imgs.size() * sizeof(ShardIndexEntry);
+        for (int i = 0; i < imgs.size(); ++i) {
+            index[i].name_offset = name_offset;
+            index[i].name_len = imgs[i].size();
+            name_offset += imgs[i].size();
+        }
+
+        std::ofstream out(shard_file, std::ios::out | std::ios::trunc | std::ios::binary);
+        if (!out) {
+            std::cout << "Fail to create shard: " << shard_file << std::endl;
+            return false;
+        }
+        // 1. the images, their offsets are known once the header and names are sized
+        uint64_t offset = align_up(name_offset, kShardAlign);
+        std::vector<char> buffer;
+        for (int i = 0; i < imgs.size(); ++i) {
+            std::ifstream in(imgs[i], std::ios::in | std::ios::binary | std::ios::ate);
+            if (!in) {
+                std::cout << "Fail to read image: " << imgs[i] << std::endl;
+                return false;
+            }
+            buffer.resize(static_cast<std::size_t>(in.tellg()));
+            in.seekg(0);
+            in.read(buffer.data(), buffer.size());
+            index[i].offset = offset;
+            index[i].size = buffer.size();
+            out.seekp(offset);
+            out.write(buffer.data(), buffer.size());
+            offset = align_up(offset + buffer.size(), kShardAlign);
+        }
+        // 2. header, index and names at the front
+        ShardHeader header;
+        memcpy(header.magic, kShardMagic, sizeof(header.magic));
+        header.version = kShardVersion;
+        header.count = static_cast<uint32_t>(imgs.size());
+        out.seekp(0);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(ShardIndexEntry));
+        for (const auto& img : imgs) {
+            out.write(img.data(), img.size());
+        }
+        out.close();
+        return !out.fail();
+    }
+
+    MappedShard::MappedShard() : _base(nullptr), _file_size(0) {
+    }
+
+    MappedShard::~MappedShard() {
+#ifndef _WIN32
+        if (_base != nullptr && _storage.empty()) {
+            munmap(const_cast<unsigned char*>(_base), _file_size);
+        }
+#endif
+    }
+
+    bool MappedShard::open(const std::string& shard_file) {
+#ifndef _WIN32
+        int fd = ::open(shard_file.c_str(), O_RDONLY);
+        if (fd < 0) {
+            std::cout << "Fail to open shard: " << shard_file << std::endl;
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < sizeof(ShardHeader)) {
+            std::cout << "Invalid shard: " << shard_file << std::endl;
+            close(fd);
+            return false;
+        }
+        _file_size = st.st_size;
+        void* addr = mmap(nullptr, _file_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED) {
+            std::cout << "Fail to mmap shard: " << shard_file << std::endl;
+            return false;
+        }
+        _base = static_cast<const unsigned char*>(addr);
+        madvise(addr, _file_size, MADV_SEQUENTIAL);
+#else
+        std::ifstream in(shard_file, std::ios::in | std::ios::binary | std::ios::ate);
+        if (!in) {
+            std::cout << "Fail to open shard: " << shard_file << std::endl;
+            return false;
+        }
+        _file_size = in.tellg();
+        _storage.resize(_file_size);
+        in.seekg(0);
+        in.read(reinterpret_cast<char*>(_storage.data()), _file_size);
+        _base = _storage.data();
+        if (_file_size < sizeof(ShardHeader)) {
+            std::cout << "Invalid shard: " << shard_file << std::endl;
+            return false;
+        }
+#endif
+        ShardHeader header;
+        memcpy(&header, _base, sizeof(header));
+        uint64_t index_end = sizeof(ShardHeader) + static_cast<uint64_t>(header.count) * sizeof(ShardIndexEntry);
+        if (memcmp(header.magic, kShardMagic, sizeof(header.magic)) != 0
+            || header.version != kShardVersion || index_end > _file_size) {
+            std::cout << "Invalid shard: " << shard_file << std::endl;
+            return false;
+        }
+        _index.resize(header.count);
+        memcpy(_index.data(), _base + sizeof(ShardHeader), _index.size() * sizeof(ShardIndexEntry));
+        for (const auto& entry : _index) {
+            if (entry.offset + entry.size > _file_size || entry.name_offset + entry.name_len > _file_size) {
+                std::cout << "Corrupted shard index: " << shard_file << std::endl;
+                _index.clear();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::string MappedShard::name(int i) const {
+        const char* ptr = reinterpret_cast<const char*>(_base + _index[i].name_offset);
+        return std::string(ptr, static_cast<std::size_t>(_index[i].name_len));
+    }
+
+    void MappedShard::prefetch(uint64_t offset, uint64_t len) const {
+#ifndef _WIN32
+        if (offset >= _file_size) {
+            return;
+        }
+        static const uint64_t page_size = sysconf(_SC_PAGESIZE);
+        uint64_t begin = offset / page_size * page_size;
+        uint64_t end = std::min(offset + len, _file_size);
+        madvise(const_cast<unsigned char*>(_base) + begin, end - begin, MADV_WILLNEED);
+#endif
+    }
+
+    ShardImageSource::ShardImageSource(const std::vector<std::string>& shards, uint64_t prefetch_bytes)
+        : _shards(shards),
+        _prefetch_bytes(prefetch_bytes),
+        _shard_index(-1),
+        _image_index(0),
+        _prefetched(0) {
+    }
+
+    bool ShardImageSource::open_shard(int shard_index) {
+        _shard_index = shard_index;
+        _image_index = 0;
+        _prefetched = 0;
+        _current.reset();
+        if (_next != nullptr) {
+            _current.swap(_next);
+        } else if (shard_index < static_cast<int>(_shards.size())) {
+            _current = std::make_shared<MappedShard>();
+            if (!_current->open(_shards[shard_index])) {
+                _current.reset();
+            }
+        }
+        return _current != nullptr;
+    }
+
+    void ShardImageSource::prefetch() {
+        // keep `_prefetch_bytes` read ahead of the current image, madvise is issued
+        // in steps of half the window rather than for every image
+        uint64_t offset = _current->offset(_image_index);
+        if (offset + _prefetch_bytes / 2 < _prefetched) {
+            return;
+        }
+        uint64_t begin = std::max(offset, _prefetched);
+        uint64_t end = offset + _prefetch_bytes;
+        _current->prefetch(begin, end - begin);
+        _prefetched = end;
+        // the window reached the end of the shard, start reading the next one
+        if (end >= _current->file_size() && _next == nullptr
+            && _shard_index + 1 < static_cast<int>(_shards.size())) {
+            _next = std::make_shared<MappedShard>();
+            if (_next->open(_shards[_shard_index + 1])) {
+                _next->prefetch(0, _prefetch_bytes);
+            } else {
+                _next.reset();
+            }
+        }
+    }
+
+    bool ShardImageSource::next(ImageBlob& blob) {
+        while (_current == nullptr || _image_index >= _current->count()) {
+            if (_shard_index + 1 >= static_cast<int>(_shards.size())) {
+                return false;
+            }
+            // a shard that fails to open is skipped
+            open_shard(_shard_index + 1);
+        }
+        prefetch();
+        blob = ImageBlob();
+        blob.name = _current->name(_image_index);
+        blob.bytes = _current->data(_image_index);
+        blob.size = _current->size(_image_index);
+        blob.holder = _current;
+        ++_image_index;
+        return true;
+    }
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "utils/image_source.h"
+
+namespace PaddleSolution {
+    /* A shard packs many small encoded images into one file so bulk jobs do one
+     * open/mmap per shard instead of one open/read per image. Layout, integers
+     * are little-endian:
+     *
+     *     ShardHeader
+     *     ShardIndexEntry x count
+     *     names            concatenated image names, not null terminated
+     *     data             concatenated encoded images, each aligned to kShardAlign
+     *
+     * Offsets in the index are relative to the start of the file.
+     */
+    const char kShardMagic[8] = {'P', 'S', 'S', 'H', 'A', 'R', 'D', '1'};
+    const uint32_t kShardVersion = 1;
+    const uint64_t kShardAlign = 64;
+
+    struct ShardHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t count;
+    };
+
+    struct ShardIndexEntry {
+        uint64_t offset;
+        uint64_t size;
+        uint64_t name_offset;
+        uint64_t name_len;
+    };
+
+    // pack the files `imgs` into the shard file `shard_file`, the image names
+    // stored in the shard are the paths as given
+    bool write_image_shard(const std::string& shard_file, const std::vector<std::string>& imgs);
+
+    // a shard mapped into memory, unmapped when the last blob borrowing from it is released
+    class MappedShard {
+    public:
+        MappedShard();
+        ~MappedShard();
+
+        bool open(const std::string& shard_file);
+
+        int count() const {
+            return static_cast<int>(_index.size());
+        }
+        // name and encoded bytes of the i-th image, the bytes point into the mapping
+        std::string name(int i) const;
+        const unsigned char* data(int i) const {
+            return _base + _index[i].offset;
+        }
+        std::size_t size(int i) const {
+            return static_cast<std::size_t>(_index[i].size);
+        }
+        // offset of the i-th image in the file
+        uint64_t offset(int i) const {
+            return _index[i].offset;
+        }
+        // ask the kernel to read the range [offset, offset + len) of the file ahead
+        void prefetch(uint64_t offset, uint64_t len) const;
+        uint64_t file_size() const {
+            return _file_size;
+        }
+
+    private:
+        MappedShard(const MappedShard&);
+        MappedShard& operator=(const MappedShard&);
+
+        const unsigned char* _base;
+        uint64_t _file_size;
+        std::vector<ShardIndexEntry> _index;
+        // the whole file, used where mmap is not available
+        std::vector<unsigned char> _storage;
+    };
+
+    // images of one or more shards handed out as zero-copy byte spans into the
+    // mapped files; the region after the current image is prefetched with
+    // madvise(MADV_WILLNEED), and so is the head of the next shard
+    class ShardImageSource : public ImageSource {
+    public:
+        // `prefetch_bytes`: size of the region read ahead of the current image
+        explicit ShardImageSource(const std::vector<std::string>& shards,
+            uint64_t prefetch_bytes = 16 << 20);
+
+        bool next(ImageBlob& blob);
+
+    private:
+        bool open_shard(int shard_index);
+        void prefetch();
+
+        std::vector<std::string> _shards;
+        uint64_t _prefetch_bytes;
+        int _shard_index;
+        int _image_index;
+        // end of the region already prefetched in the current shard
+        uint64_t _prefetched;
+        std::shared_ptr<MappedShard> _current;
+        std::shared_ptr<MappedShard> _next;
+    };
+}
@@ -0,0 +1,52 @@
+#include "utils/image_source.h"
+#include "utils/image_shard.h"
+#include "utils/job_coordinator.h"
+
+namespace PaddleSolution {
+
+    std::unique_ptr<ImageSource> create_image_source(const std::string& input_dir,
+        const std::string& input_list, const std::string& input_format, const std::string& exts) {
+        std::unique_ptr<ImageSource> source;
+        if (input_list.empty()) {
+            source.reset(new DirectoryImageSource(input_dir, exts));
+        } else if (input_format == "encoded") {
+            auto stream = new EncodedStreamImageSource(input_list);
+            source.reset(stream);
+            if (!stream->good()) {
+                std::cout << "Fail to open input stream: " << input_list << std::endl;
+                return nullptr;
+            }
+        } else if (input_format == "path") {
+            auto list = new ListImageSource(input_list);
+            source.reset(list);
+            if (!list->good()) {
+                std::cout << "Fail to open input list: " << input_list << std::endl;
+                return nullptr;
+            }
+        } else if (input_format == "shard") {
+            std::vector<std::string> shards;
+            std::size_t start = 0;
+            while (start <= input_list.size()) {
+                auto end = input_list.find(',', start);
+                if (end == std::string::npos) {
+                    end = input_list.size();
+                }
+                if (end > start) {
+                    shards.push_back(input_list.substr(start, end - start));
+                }
+                start = end + 1;
+            }
+            source.reset(new ShardImageSource(shards));
+        } else if (input_format == "remote") {
+            auto remote = new RemoteImageSource(input_list);
+            source.reset(remote);
+            if (!remote->good()) {
+                std::cout << "Fail to connect to the coordinator: " << input_list << std::endl;
+                return nullptr;
+            }
+        } else {
+            std::cout << "Unknown input format: " << input_format << std::endl;
+        }
+        return source;
+    }
+}
@@ -0,0 +1,276 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "utils/utils.h"
+
+namespace PaddleSolution {
+    // one input image: a file path, encoded image bytes or a decoded image
+    // held in memory. The first non-empty of `mat`, `data` and `bytes` is used,
+    // the file `name` is read when all of them are empty.
+    struct ImageBlob {
+        ImageBlob() : bytes(nullptr), size(0) {
+        }
+
+        // file path, or the logical name used to name the outputs
+        std::string name;
+        // encoded image bytes owned by the blob
+        std::vector<unsigned char> data;
+        // encoded image bytes borrowed from the caller, not copied
+        const unsigned char* bytes;
+        std::size_t size;
+        // optionally keeps the memory behind `bytes` alive while the blob is in use
+        std::shared_ptr<const void> holder;
+        // decoded BGR image borrowed from the caller, not copied
+        cv::Mat mat;
+
+        bool in_memory() const {
+            return !mat.empty() || !data.empty() || size > 0;
+        }
+
+        // wrap encoded bytes (jpeg, png...) owned by the caller
+        static ImageBlob from_encoded(const std::string& name, const unsigned char* bytes, std::size_t size) {
+            ImageBlob blob;
+            blob.name = name;
+            blob.bytes = bytes;
+            blob.size = size;
+            return blob;
+        }
+
+        // wrap a decoded BGR image owned by the caller
+        static ImageBlob from_mat(const std::string& name, const cv::Mat& mat) {
+            ImageBlob blob;
+            blob.name = name;
+            blob.mat = mat;
+            return blob;
+        }
+    };
+
+    // input-source interface shared by the predictors, images are pulled
+    // batch by batch so memory stays bounded regardless of the job size
+    class ImageSource {
+    public:
+        virtual ~ImageSource() {}
+
+        // fetch the next image, return false when the source is exhausted
+        virtual bool next(ImageBlob& blob) = 0;
+
+        // fill `batch` with at most `max_size` images, return the number fetched
+        virtual int next_batch(std::vector<ImageBlob>& batch, int max_size) {
+            // keep the old blobs around so their buffers can be reused
+            if (static_cast<int>(batch.size()) < max_size) {
+                batch.resize(max_size);
+            }
+            int count = 0;
+            while (count < max_size && next(batch[count])) {
+                ++count;
+            }
+            batch.resize(count);
+            return count;
+        }
+
+        // the predictor is done with the `count` oldest images it fetched and
+        // had not reported yet: their outputs are written, except for the ones
+        // at the positions `failed` (ascending, 0 for the oldest) which got none.
+        // Sources that need to know (a job coordinator, a journal) act on it,
+        // the others ignore it; sources wrapping another one pass it on.
+        virtual void done(int count, const std::vector<int>& failed) {
+        }
+
+        // done() for `count` images none of which got an output
+        void failed(int count) {
+            std::vector<int> all(count);
+            for (int i = 0; i < count; ++i) {
+                all[i] = i;
+            }
+            done(count, all);
+        }
+    };
+
+    // images given as a vector of file paths, the vector is not copied
+    class VectorImageSource : public ImageSource {
+    public:
+        explicit VectorImageSource(const std::vector<std::string>& imgs)
+            : _imgs(imgs), _index(0) {
+        }
+
+        bool next(ImageBlob& blob) {
+            if (_index >= _imgs.size()) {
+                return false;
+            }
+            blob = ImageBlob();
+            blob.name = _imgs[_index++];
+            return true;
+        }
+
+    private:
+        const std::vector<std::string>& _imgs;
+        std::size_t _index;
+    };
+
+    // images already held in memory, the blobs are copied one at a time but
+    // the borrowed bytes and images they point to are not
+    class BlobImageSource : public ImageSource {
+    public:
+        explicit BlobImageSource(const std::vector<ImageBlob>& imgs)
+            : _imgs(imgs), _index(0), _done(0) {
+        }
+
+        bool next(ImageBlob& blob) {
+            if (_index >= _imgs.size()) {
+                return false;
+            }
+            blob = _imgs[_index++];
+            return true;
+        }
+
+        // recorded for failed_positions()
+        void done(int count, const std::vector<int>& failed) {
+            for (int i : failed) {
+                _failed.push_back(_done + i);
+            }
+            _done += count;
+        }
+
+        // positions in `imgs` of the images reported failed so far, ascending
+        const std::vector<int>& failed_positions() const {
+            return _failed;
+        }
+
+    private:
+        const std::vector<ImageBlob>& _imgs;
+        std::size_t _index;
+        int _done;
+        std::vector<int> _failed;
+    };
+
+    // all the images with the given extensions in a directory
+    class DirectoryImageSource : public ImageSource {
+    public:
+        DirectoryImageSource(const std::string& dir, const std::string& exts)
+            : _imgs(utils::get_directory_images(dir, exts)), _source(_imgs) {
+        }
+
+        bool next(ImageBlob& blob) {
+            return _source.next(blob);
+        }
+
+    private:
+        std::vector<std::string> _imgs;
+        VectorImageSource _source;
+    };
+
+    // image paths read one per line from a manifest file or stdin ("-")
+    class ListImageSource : public ImageSource {
+    public:
+        explicit ListImageSource(const std::string& list_file) : _in(&std::cin) {
+            if (list_file != "-") {
+                _file.reset(new std::ifstream(list_file));
+                _in = _file.get();
+            }
+        }
+
+        bool good() const {
+            return _in->good();
+        }
+
+        bool next(ImageBlob& blob) {
+            std::string line;
+            while (std::getline(*_in, line)) {
+                if (!line.empty() && line.back() == '\r') {
+                    line.pop_back();
+                }
+                if (line.empty()) {
+                    continue;
+                }
+                blob = ImageBlob();
+                blob.name = line;
+                return true;
+            }
+            return false;
+        }
+
+    private:
+        std::unique_ptr<std::ifstream> _file;
+        std::istream* _in;
+    };
+
+    // length-prefixed encoded images read from a file or stdin ("-"),
+    // every record is laid out as:
+    //     uint32 name_len | name | uint32 data_len | encoded image bytes
+    // with little-endian lengths; an empty name is replaced by "stream_<index>.jpg"
+    class EncodedStreamImageSource : public ImageSource {
+    public:
+        explicit EncodedStreamImageSource(const std::string& stream_file)
+            : _in(&std::cin), _index(0) {
+            if (stream_file != "-") {
+                _file.reset(new std::ifstream(stream_file, std::ios::in | std::ios::binary));
+                _in = _file.get();
+            }
+        }
+
+        bool good() const {
+            return _in->good();
+        }
+
+        bool next(ImageBlob& blob) {
+            blob.bytes = nullptr;
+            blob.size = 0;
+            blob.holder.reset();
+            blob.mat.release();
+            uint32_t name_len = 0;
+            if (!read_length(&name_len)) {
+                return false;
+            }
+            blob.name.resize(name_len);
+            if (name_len > 0 && !_in->read(&blob.name[0], name_len)) {
+                return false;
+            }
+            uint32_t data_len = 0;
+            if (!read_length(&data_len)) {
+                return false;
+            }
+            blob.data.resize(data_len);
+            if (data_len > 0
+                && !_in->read(reinterpret_cast<char*>(blob.data.data()), data_len)) {
+                return false;
+            }
+            if (blob.name.empty()) {
+                blob.name = "stream_" + std::to_string(_index) + ".jpg";
+            }
+            ++_index;
+            return true;
+        }
+
+    private:
+        bool read_length(uint32_t* len) {
+            unsigned char bytes[4];
+            if (!_in->read(reinterpret_cast<char*>(bytes), sizeof(bytes))) {
+                return false;
+            }
+            *len = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16)
+                | (static_cast<uint32_t>(bytes[3]) << 24);
+            return true;
+        }
+
+        std::unique_ptr<std::ifstream> _file;
+        std::istream* _in;
+        std::size_t _index;
+    };
+
+    // pick the input source for the demos: the images of `input_dir` when `input_list`
+    // is empty, otherwise `input_list` read with `input_format`:
+    //     path:    one image path per line, from a manifest file or stdin ("-")
+    //     encoded: length-prefixed encoded images, from a file or stdin ("-")
+    //     shard:   comma separated packed image shards, see utils/image_shard.h
+    //     remote:  work units of a JobCoordinator at this address, see utils/job_coordinator.h
+    std::unique_ptr<ImageSource> create_image_source(const std::string& input_dir,
+        const std::string& input_list, const std::string& input_format, const std::string& exts);
+}
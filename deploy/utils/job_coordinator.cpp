@@ -0,0 +1,545 @@
+#include "utils/job_coordinator.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#ifndef _WIN32
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#endif
+
+#include <glog/logging.h>
+
+namespace PaddleSolution {
+#ifndef _WIN32
+
+    namespace {
+        bool is_unix_address(const std::string& address) {
+            return address.compare(0, 5, "unix:") == 0;
+        }
+
+        // split `host:port`, the host may be empty
+        bool split_host_port(const std::string& address, std::string* host, std::string* port) {
+            auto colon = address.rfind(':');
+            if (colon == std::string::npos || colon + 1 == address.size()) {
+                return false;
+            }
+            *host = address.substr(0, colon);
+            *port = address.substr(colon + 1);
+            return true;
+        }
+
+        bool fill_unix_address(const std::string& address, sockaddr_un* addr) {
+            std::string path = address.substr(5);
+            if (path.empty() || path.size() >= sizeof(addr->sun_path)) {
+                return false;
+            }
+            memset(addr, 0, sizeof(*addr));
+            addr->sun_family = AF_UNIX;
+            memcpy(addr->sun_path, path.c_str(), path.size() + 1);
+            return true;
+        }
+
+        void set_tcp_options(int fd) {
+            int on = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+        }
+
+        bool send_all(int fd, const std::string& data) {
+            const char* ptr = data.data();
+            size_t size = data.size();
+            while (size > 0) {
+                ssize_t sent = send(fd, ptr, size, MSG_NOSIGNAL);
+                if (sent < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (sent <= 0) {
+                    return false;
+                }
+                ptr += sent;
+                size -= sent;
+            }
+            return true;
+        }
+
+        // pop the first complete line of `buffer` into `line`
+        bool pop_line(std::string* buffer, std::string* line) {
+            auto end = buffer->find('\n');
+            if (end == std::string::npos) {
+                return false;
+            }
+            line->assign(*buffer, 0, end);
+            buffer->erase(0, end + 1);
+            return true;
+        }
+
+        int64_t now_ms() {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+    }
+
+    int listen_socket(const std::string& address) {
+        if (is_unix_address(address)) {
+            sockaddr_un addr;
+            if (!fill_unix_address(address, &addr)) {
+                return -1;
+            }
+            int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0) {
+                return -1;
+            }
+            // a socket file left by an earlier run
+            unlink(addr.sun_path);
+            if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, 128) != 0) {
+                close(fd);
+                return -1;
+            }
+            return fd;
+        }
+        std::string host;
+        std::string port;
+        if (!split_host_port(address, &host, &port)) {
+            return -1;
+        }
+        addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+        addrinfo* result = nullptr;
+        if (getaddrinfo(host.empty() || host == "*" ? nullptr : host.c_str(), port.c_str(), &hints, &result) != 0) {
+            return -1;
+        }
+        int fd = -1;
+        for (addrinfo* ai = result; ai != nullptr && fd < 0; ai = ai->ai_next) {
+            fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (fd < 0) {
+                continue;
+            }
+            int on = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+            if (bind(fd, ai->ai_addr, ai->ai_addrlen) != 0 || listen(fd, 128) != 0) {
+                close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(result);
+        return fd;
+    }
+
+    int connect_socket(const std::string& address) {
+        if (is_unix_address(address)) {
+            sockaddr_un addr;
+            if (!fill_unix_address(address, &addr)) {
+                return -1;
+            }
+            int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0) {
+                return -1;
+            }
+            if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+                close(fd);
+                return -1;
+            }
+            return fd;
+        }
+        std::string host;
+        std::string port;
+        if (!split_host_port(address, &host, &port)) {
+            return -1;
+        }
+        addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* result = nullptr;
+        if (getaddrinfo(host.empty() ? "localhost" : host.c_str(), port.c_str(), &hints, &result) != 0) {
+            return -1;
+        }
+        int fd = -1;
+        for (addrinfo* ai = result; ai != nullptr && fd < 0; ai = ai->ai_next) {
+            fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+                close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(result);
+        if (fd >= 0) {
+            set_tcp_options(fd);
+        }
+        return fd;
+    }
+
+    struct JobCoordinator::Worker {
+        Worker() : fd(-1), name("?"), units(0), images(0), failed(0), stolen(0) {
+        }
+
+        int fd;
+        std::string name;
+        std::string buffer;
+        // units sent and not finished yet
+        std::deque<int> running;
+        std::deque<int> reserved;
+        int units;
+        int64_t images;
+        int64_t failed;
+        int stolen;
+    };
+
+    JobCoordinator::JobCoordinator(int unit_size, int reserve_units)
+        : _unit_size(std::max(1, unit_size)), _reserve_units(std::max(1, reserve_units)),
+        _listen_fd(-1), _done_units(0), _failed_images(0), _requeued_units(0), _start_ms(0) {
+    }
+
+    JobCoordinator::~JobCoordinator() {
+        for (auto& worker : _workers) {
+            close(worker->fd);
+        }
+        if (_listen_fd >= 0) {
+            close(_listen_fd);
+        }
+        if (is_unix_address(_address)) {
+            unlink(_address.substr(5).c_str());
+        }
+    }
+
+    bool JobCoordinator::init(const std::vector<std::string>& imgs, const std::string& address) {
+        for (size_t start = 0; start < imgs.size(); start += _unit_size) {
+            size_t end = std::min(imgs.size(), start + _unit_size);
+            _pool.push_back(_units.size());
+            _units.push_back(std::vector<std::string>(imgs.begin() + start, imgs.begin() + end));
+        }
+        _listen_fd = listen_socket(address);
+        if (_listen_fd < 0) {
+            LOG(ERROR) << "Fail to listen on " << address << ": " << strerror(errno);
+            return false;
+        }
+        _address = address;
+        std::cout << "serve " << imgs.size() << " images in " << _units.size() << " units on " << address << std::endl;
+        return true;
+    }
+
+    int JobCoordinator::run() {
+        _start_ms = now_ms();
+        std::vector<pollfd> fds;
+        char chunk[4096];
+        while (_done_units < _units.size() || !_workers.empty()) {
+            fds.resize(1 + _workers.size());
+            fds[0].fd = _listen_fd;
+            fds[0].events = POLLIN;
+            for (int i = 0; i < _workers.size(); ++i) {
+                fds[i + 1].fd = _workers[i]->fd;
+                fds[i + 1].events = POLLIN;
+            }
+            if (poll(fds.data(), fds.size(), 1000) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                LOG(ERROR) << "poll failed: " << strerror(errno);
+                return -1;
+            }
+            // 1. the workers, from the back so closed ones can be removed
+            for (int i = static_cast<int>(_workers.size()) - 1; i >= 0; --i) {
+                if (fds[i + 1].revents == 0) {
+                    continue;
+                }
+                Worker* worker = _workers[i].get();
+                ssize_t n = recv(worker->fd, chunk, sizeof(chunk), 0);
+                bool alive = n > 0;
+                if (alive) {
+                    worker->buffer.append(chunk, n);
+                    std::string line;
+                    while (alive && pop_line(&worker->buffer, &line)) {
+                        alive = handle_line(worker, line);
+                    }
+                }
+                if (!alive) {
+                    release(worker);
+                    _finished.push_back(std::move(_workers[i]));
+                    _workers.erase(_workers.begin() + i);
+                }
+            }
+            // 2. new workers
+            if (fds[0].revents & POLLIN) {
+                int fd = accept(_listen_fd, nullptr, nullptr);
+                if (fd >= 0) {
+                    if (!is_unix_address(_address)) {
+                        set_tcp_options(fd);
+                    }
+                    std::unique_ptr<Worker> worker(new Worker());
+                    worker->fd = fd;
+                    _workers.push_back(std::move(worker));
+                }
+            }
+        }
+        print_summary();
+        return 0;
+    }
+
+    bool JobCoordinator::handle_line(Worker* worker, const std::string& line) {
+        if (line.compare(0, 6, "HELLO ") == 0) {
+            worker->name = line.substr(6);
+            return true;
+        }
+        if (line.compare(0, 9, "FINISHED ") == 0) {
+            int unit = -1;
+            int failed = 0;
+            auto& running = worker->running;
+            auto it = running.end();
+            if (sscanf(line.c_str(), "FINISHED %d %d", &unit, &failed) == 2) {
+                it = std::find(running.begin(), running.end(), unit);
+            }
+            if (it == running.end()) {
+                LOG(ERROR) << "Worker " << worker->name << " finished a unit it does not run: " << line;
+                return false;
+            }
+            running.erase(it);
+            ++worker->units;
+            worker->images += _units[unit].size();
+            worker->failed += failed;
+            _failed_images += failed;
+            ++_done_units;
+            return true;
+        }
+        if (line != "NEXT") {
+            LOG(ERROR) << "Unknown message from worker " << worker->name << ": " << line;
+            return false;
+        }
+        int unit = take_unit(worker);
+        if (unit < 0) {
+            return send_all(worker->fd, _done_units == _units.size() ? "DONE\n" : "WAIT\n");
+        }
+        worker->running.push_back(unit);
+        std::ostringstream message;
+        message << "UNIT " << unit << " " << _units[unit].size() << "\n";
+        for (const auto& path : _units[unit]) {
+            message << path << "\n";
+        }
+        return send_all(worker->fd, message.str());
+    }
+
+    int JobCoordinator::take_unit(Worker* worker) {
+        auto& reserved = worker->reserved;
+        if (reserved.empty()) {
+            for (int k = 0; k < _reserve_units && !_pool.empty(); ++k) {
+                reserved.push_back(_pool.front());
+                _pool.pop_front();
+            }
+        }
+        if (reserved.empty()) {
+            // steal the back half of the most loaded reservation
+            Worker* victim = nullptr;
+            for (auto& other : _workers) {
+                if (other.get() != worker && !other->reserved.empty()
+                    && (victim == nullptr || other->reserved.size() > victim->reserved.size())) {
+                    victim = other.get();
+                }
+            }
+            if (victim != nullptr) {
+                size_t count = (victim->reserved.size() + 1) / 2;
+                reserved.insert(reserved.end(), victim->reserved.end() - count, victim->reserved.end());
+                victim->reserved.erase(victim->reserved.end() - count, victim->reserved.end());
+                worker->stolen += count;
+            }
+        }
+        if (reserved.empty()) {
+            return -1;
+        }
+        int unit = reserved.front();
+        reserved.pop_front();
+        return unit;
+    }
+
+    void JobCoordinator::release(Worker* worker) {
+        // the units in progress first, the reserved ones keep their order
+        _pool.insert(_pool.begin(), worker->reserved.begin(), worker->reserved.end());
+        worker->reserved.clear();
+        auto& running = worker->running;
+        if (!running.empty()) {
+            LOG(WARNING) << "Worker " << worker->name << " left during " << running.size() << " units, requeue them";
+            _pool.insert(_pool.begin(), running.begin(), running.end());
+            _requeued_units += running.size();
+            running.clear();
+        }
+        close(worker->fd);
+        worker->fd = -1;
+    }
+
+    void JobCoordinator::print_summary() const {
+        double seconds = std::max<int64_t>(1, now_ms() - _start_ms) / 1000.0;
+        int64_t images = 0;
+        for (const auto& worker : _finished) {
+            images += worker->images;
+        }
+        printf("job done: %d units, %lld images (%lld failed) in %.1f s, %.1f images/s, %d units requeued\n",
+               _done_units, static_cast<long long>(images), static_cast<long long>(_failed_images), seconds,
+               images / seconds, _requeued_units);
+        for (const auto& worker : _finished) {
+            printf("  worker %s: %d units, %lld images (%lld failed), %d stolen\n", worker->name.c_str(),
+                   worker->units, static_cast<long long>(worker->images), static_cast<long long>(worker->failed),
+                   worker->stolen);
+        }
+    }
+
+    RemoteImageSource::RemoteImageSource(const std::string& address)
+        : _fd(connect_socket(address)), _index(0), _done(false) {
+        if (_fd < 0) {
+            LOG(ERROR) << "Fail to connect to the coordinator " << address << ": " << strerror(errno);
+            return;
+        }
+        char host[256] = "";
+        gethostname(host, sizeof(host) - 1);
+        send_all(_fd, "HELLO " + std::string(host) + ":" + std::to_string(getpid()) + "\n");
+    }
+
+    RemoteImageSource::~RemoteImageSource() {
+        if (_fd >= 0) {
+            close(_fd);
+        }
+    }
+
+    bool RemoteImageSource::next(ImageBlob& blob) {
+        while (_index >= _unit.size()) {
+            if (_done || _fd < 0 || !fetch_unit()) {
+                return false;
+            }
+        }
+        blob = ImageBlob();
+        blob.name = _unit[_index++];
+        return true;
+    }
+
+    void RemoteImageSource::done(int count, const std::vector<int>& failed) {
+        size_t k = 0;
+        for (int i = 0; i < count && !_running.empty(); ++i) {
+            auto& unit = _running.front();
+            if (k < failed.size() && failed[k] == i) {
+                ++unit.failed;
+                ++k;
+            }
+            if (--unit.left > 0) {
+                continue;
+            }
+            if (_fd >= 0 && !send_all(_fd, "FINISHED " + std::to_string(unit.id) + " "
+                                      + std::to_string(unit.failed) + "\n")) {
+                LOG(ERROR) << "Lost the connection to the coordinator";
+            }
+            _running.pop_front();
+        }
+    }
+
+    bool RemoteImageSource::fetch_unit() {
+        std::string line;
+        while (true) {
+            if (!send_all(_fd, "NEXT\n") || !read_line(&line)) {
+                LOG(ERROR) << "Lost the connection to the coordinator";
+                return false;
+            }
+            if (line == "DONE") {
+                _done = true;
+                return false;
+            }
+            if (line != "WAIT") {
+                break;
+            }
+            if (!_running.empty()) {
+                // the batch being filled holds some of our units, end it so they finish
+                return false;
+            }
+            // every unit is taken but some are still running, one may come back
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        }
+        int unit = 0;
+        int count = 0;
+        if (sscanf(line.c_str(), "UNIT %d %d", &unit, &count) != 2) {
+            LOG(ERROR) << "Unknown message from the coordinator: " << line;
+            return false;
+        }
+        _unit.resize(count);
+        for (int i = 0; i < count; ++i) {
+            if (!read_line(&_unit[i])) {
+                LOG(ERROR) << "Lost the connection to the coordinator";
+                return false;
+            }
+        }
+        _index = 0;
+        RunningUnit running = { unit, count, 0 };
+        _running.push_back(running);
+        return true;
+    }
+
+    bool RemoteImageSource::read_line(std::string* line) {
+        char chunk[4096];
+        while (!pop_line(&_buffer, line)) {
+            ssize_t n = recv(_fd, chunk, sizeof(chunk), 0);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            _buffer.append(chunk, n);
+        }
+        return true;
+    }
+#else
+    // sockets are only implemented for POSIX systems
+    int listen_socket(const std::string& address) {
+        LOG(ERROR) << "The job coordinator is not supported on Windows";
+        return -1;
+    }
+
+    int connect_socket(const std::string& address) {
+        LOG(ERROR) << "The job coordinator is not supported on Windows";
+        return -1;
+    }
+
+    struct JobCoordinator::Worker {
+    };
+
+    JobCoordinator::JobCoordinator(int unit_size, int reserve_units)
+        : _unit_size(unit_size), _reserve_units(reserve_units), _listen_fd(-1),
+        _done_units(0), _failed_images(0), _requeued_units(0), _start_ms(0) {
+    }
+
+    JobCoordinator::~JobCoordinator() {
+    }
+
+    bool JobCoordinator::init(const std::vector<std::string>& imgs, const std::string& address) {
+        return listen_socket(address) >= 0;
+    }
+
+    int JobCoordinator::run() {
+        return -1;
+    }
+
+    RemoteImageSource::RemoteImageSource(const std::string& address)
+        : _fd(connect_socket(address)), _index(0), _done(false) {
+    }
+
+    RemoteImageSource::~RemoteImageSource() {
+    }
+
+    bool RemoteImageSource::next(ImageBlob& blob) {
+        return false;
+    }
+
+    void RemoteImageSource::done(int count, const std::vector<int>& failed) {
+    }
+#endif
+}
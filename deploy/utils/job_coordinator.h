@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "utils/image_source.h"
+
+namespace PaddleSolution {
+    /* A job split across worker processes, on one box or many nodes. The
+     * coordinator cuts the input paths into work units and serves them over a
+     * stream socket, `unix:/path/to.sock` or `host:port` (TCP, `:port` listens
+     * on every interface). Workers read the units with a RemoteImageSource, so
+     * any of the predictors can be a worker. The images are read by the workers,
+     * the paths must be valid on their side (a shared file system).
+     *
+     * Protocol, one text line per message:
+     *
+     *     worker:      HELLO <name>             once, after connecting
+     *     worker:      NEXT                     send another unit
+     *     worker:      FINISHED <id> <failed>   the outputs of unit <id> are written,
+     *                                           <failed> of its images got none
+     *     coordinator: UNIT <id> <n>            followed by n lines of paths
+     *     coordinator: WAIT                     none free now, ask again later
+     *     coordinator: DONE                     every unit is done
+     *
+     * A worker asks for the NEXT unit once it has pulled the last image of the
+     * current one, but reports it FINISHED only when the predictor is done with
+     * the batch holding that image (ImageSource::done), so a unit counts as done
+     * only after its outputs are written. Told to WAIT while some of its own
+     * units are not finished, a worker ends the batch it is filling short so
+     * they can finish, instead of waiting.
+     *
+     * Each worker reserves `reserve_units` consecutive units at a time, an idle
+     * worker steals half of the reserved units of the most loaded one once none
+     * are left to reserve. The units in progress and the reserved ones of a
+     * worker that disconnects go back to the pool.
+     */
+    class JobCoordinator {
+    public:
+        JobCoordinator(int unit_size, int reserve_units);
+        ~JobCoordinator();
+
+        // cut `imgs` into units and listen on `address`
+        bool init(const std::vector<std::string>& imgs, const std::string& address);
+
+        // serve the workers until every unit is done and they disconnected,
+        // then print the progress summary
+        int run();
+
+    private:
+        struct Worker;
+
+        bool handle_line(Worker* worker, const std::string& line);
+        // the unit `worker` should run next, -1 if none is free
+        int take_unit(Worker* worker);
+        void release(Worker* worker);
+        void print_summary() const;
+
+        int _unit_size;
+        int _reserve_units;
+        int _listen_fd;
+        std::string _address;
+        std::vector<std::vector<std::string>> _units;
+        std::deque<int> _pool;
+        std::vector<std::unique_ptr<Worker>> _workers;
+        // all the workers ever connected, kept for the summary
+        std::vector<std::unique_ptr<Worker>> _finished;
+        int _done_units;
+        int64_t _failed_images;
+        int _requeued_units;
+        int64_t _start_ms;
+    };
+
+    // the images of the units handed out by a JobCoordinator at `address`; not
+    // suited to DEPLOY.READ_AHEAD nor DEPLOY.SHARDING, which pull images ahead
+    // of the batches being predicted
+    class RemoteImageSource : public ImageSource {
+    public:
+        explicit RemoteImageSource(const std::string& address);
+        ~RemoteImageSource();
+
+        bool good() const {
+            return _fd >= 0;
+        }
+
+        bool next(ImageBlob& blob);
+        // reports the units whose last image is done FINISHED
+        void done(int count, const std::vector<int>& failed);
+
+    private:
+        RemoteImageSource(const RemoteImageSource&);
+        RemoteImageSource& operator=(const RemoteImageSource&);
+
+        struct RunningUnit {
+            int id;
+            // images not done yet, pulled or not
+            int left;
+            int failed;
+        };
+
+        // false when the job is done, the connection is lost, or the caller
+        // should finish its units before another one is free
+        bool fetch_unit();
+        bool read_line(std::string* line);
+
+        int _fd;
+        std::string _buffer;
+        std::vector<std::string> _unit;
+        std::size_t _index;
+        // units handed out and not finished, oldest first
+        std::deque<RunningUnit> _running;
+        bool _done;
+    };
+
+    // listening / connected stream socket of `address` (see JobCoordinator),
+    // -1 on failure
+    int listen_socket(const std::string& address);
+    int connect_socket(const std::string& address);
+}
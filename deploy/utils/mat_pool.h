@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+namespace PaddleSolution {
+    namespace utils {
+        /* Scratch cv::Mat buffers of the calling thread, keyed by size and type,
+         * for the decode / convert / resize intermediates of the preprocessors.
+         * A buffer is handed out again once every Mat referring to it has been
+         * released, so a worker stops allocating once it has seen each image
+         * shape. Meant for the long lived threads of ThreadPool.
+         */
+        class MatPool {
+        public:
+            // buffers kept per thread
+            static const int kMaxMats = 16;
+
+            // a Mat of `rows` x `cols` and `type`, the contents are undefined
+            static cv::Mat acquire(int rows, int cols, int type) {
+                auto& mats = thread_mats();
+                int free_slot = -1;
+                for (int i = 0; i < mats.size(); ++i) {
+                    if (in_use(mats[i])) {
+                        continue;
+                    }
+                    if (mats[i].rows == rows && mats[i].cols == cols && mats[i].type() == type) {
+                        ++hits();
+                        return mats[i];
+                    }
+                    free_slot = i;
+                }
+                ++misses();
+                cv::Mat mat(rows, cols, type);
+                if (mats.size() < kMaxMats) {
+                    mats.push_back(mat);
+                } else if (free_slot >= 0) {
+                    mats[free_slot] = mat;
+                }
+                return mat;
+            }
+
+            // decode `buf` into the buffer of the last image decoded by this thread,
+            // no allocation when the size and type are the same
+            static cv::Mat decode(const cv::Mat& buf, int flags) {
+                static thread_local cv::Mat last;
+                if (in_use(last)) {
+                    last = cv::Mat();
+                }
+                const uchar* before = last.data;
+                cv::imdecode(buf, flags, &last);
+                if (last.data != nullptr && last.data == before) {
+                    ++hits();
+                } else {
+                    ++misses();
+                }
+                return last;
+            }
+
+            // buffers reused / allocated by all the threads so far
+            static std::atomic<uint64_t>& hits() {
+                static std::atomic<uint64_t> count(0);
+                return count;
+            }
+
+            static std::atomic<uint64_t>& misses() {
+                static std::atomic<uint64_t> count(0);
+                return count;
+            }
+
+        private:
+            static std::vector<cv::Mat>& thread_mats() {
+                static thread_local std::vector<cv::Mat> mats;
+                return mats;
+            }
+
+            // referenced by someone besides the pool
+            static bool in_use(const cv::Mat& mat) {
+                return mat.u != nullptr && mat.u->refcount > 1;
+            }
+        };
+    }
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#include "utils/alloc_counter.h"
+#include "utils/mat_pool.h"
+
+namespace PaddleSolution {
+    namespace utils {
+        // resident set size of the process in bytes, 0 where /proc is not available
+        inline uint64_t current_rss_bytes() {
+#ifdef _WIN32
+            return 0;
+#else
+            FILE* fp = fopen("/proc/self/statm", "r");
+            if (fp == nullptr) {
+                return 0;
+            }
+            unsigned long long size = 0;
+            unsigned long long resident = 0;
+            int n = fscanf(fp, "%llu %llu", &size, &resident);
+            fclose(fp);
+            if (n != 2) {
+                return 0;
+            }
+            return resident * sysconf(_SC_PAGESIZE);
+#endif
+        }
+
+        // page faults of the process so far: minor ones map a page already in memory,
+        // major ones wait for the disk; 0 on Windows
+        struct PageFaults {
+            PageFaults() : minor_faults(0), major_faults(0) {
+            }
+            uint64_t minor_faults;
+            uint64_t major_faults;
+        };
+
+        inline PageFaults page_faults() {
+            PageFaults faults;
+#ifndef _WIN32
+            struct rusage usage;
+            if (getrusage(RUSAGE_SELF, &usage) == 0) {
+                faults.minor_faults = usage.ru_minflt;
+                faults.major_faults = usage.ru_majflt;
+            }
+#endif
+            return faults;
+        }
+
+        /* Memory behaviour of one batch: heap allocations and their rate, RSS,
+         * the MatPool hits / misses and the page faults of all the threads.
+         * Printed only in WITH_ALLOC_COUNTER builds, print() does nothing otherwise.
+         */
+        class BatchMetrics {
+        public:
+            BatchMetrics() :
+                _start(std::chrono::steady_clock::now()),
+                _pool_hits(MatPool::hits()),
+                _pool_misses(MatPool::misses()),
+                _faults(page_faults()) {
+            }
+
+            void print() const {
+                if (!allocation_counter_enabled()) {
+                    return;
+                }
+                double seconds = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - _start).count() / 1e6;
+                uint64_t count = _allocations.count();
+                std::cout << "allocations = " << count;
+                if (seconds > 0) {
+                    std::cout << " (" << static_cast<uint64_t>(count / seconds) << "/s)";
+                }
+                std::cout << ", rss = " << current_rss_bytes() / (1024 * 1024) << " MB"
+                    << ", mat pool hits = " << MatPool::hits() - _pool_hits
+                    << ", misses = " << MatPool::misses() - _pool_misses;
+                PageFaults faults = page_faults();
+                std::cout << ", page faults minor = " << faults.minor_faults - _faults.minor_faults
+                    << ", major = " << faults.major_faults - _faults.major_faults << std::endl;
+            }
+
+        private:
+            std::chrono::steady_clock::time_point _start;
+            AllocationScope _allocations;
+            uint64_t _pool_hits;
+            uint64_t _pool_misses;
+            PageFaults _faults;
+        };
+    }
+}
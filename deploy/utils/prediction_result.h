@@ -0,0 +1,77 @@
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "utils/detection_result.pb.h"
+
+namespace PaddleSolution {
+    // segmentation result of one image
+    struct SegResult {
+        SegResult() : ori_width(0), ori_height(0) {
+        }
+
+        std::string name;
+        // label of every pixel, CV_8UC1 of size EVAL_CROP_SIZE
+        cv::Mat mask;
+        // score of the predicted label scaled to [0, 255], CV_8UC1 of size EVAL_CROP_SIZE
+        cv::Mat scoremap;
+        // size of the input image, used to recover the mask to the original size
+        int ori_width;
+        int ori_height;
+    };
+
+    // classification result of one image
+    struct ClassifyResult {
+        ClassifyResult() : label(0), score(0) {
+        }
+
+        std::string name;
+        // score of every class
+        std::vector<float> scores;
+        // class with the highest score
+        int label;
+        float score;
+        // the kClassifyTopK (or fewer) best classes, best first
+        std::vector<int> top_k;
+    };
+
+    const int kClassifyTopK = 5;
+
+    // fill `top_k` from `scores`
+    inline void set_top_k(ClassifyResult* result) {
+        const std::vector<float>& scores = result->scores;
+        int k = std::min(kClassifyTopK, static_cast<int>(scores.size()));
+        std::vector<int> order(scores.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::partial_sort(order.begin(), order.begin() + k, order.end(),
+                          [&scores](int a, int b) { return scores[a] > scores[b]; });
+        result->top_k.assign(order.begin(), order.begin() + k);
+    }
+
+    // detection results use the DetectionResult message of detection_result.proto,
+    // the same one serialized to the `.pb` files
+
+    // result of the detection -> classification cascade for one image
+    struct CascadeResult {
+        // boxes found by the detection model
+        DetectionResult detection;
+        // class of the crop of every box, in the order of `detection`'s boxes;
+        // label is -1 for the boxes that were not classified (score below the
+        // threshold or empty crop)
+        std::vector<ClassifyResult> box_classes;
+    };
+
+    // results of the models of a MultiModelHost for one image, by model name
+    struct HostedResult {
+        std::string name;
+        std::map<std::string, SegResult> seg;
+        std::map<std::string, ClassifyResult> classify;
+        std::map<std::string, DetectionResult> detection;
+    };
+}
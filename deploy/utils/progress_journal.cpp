@@ -0,0 +1,235 @@
+#include "utils/progress_journal.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <glog/logging.h>
+
+namespace PaddleSolution {
+
+    namespace {
+        const char kJournalHeader[] = "# progress journal v1\n";
+
+        // flush `file` and make it durable
+        bool sync_file(std::FILE* file) {
+            if (fflush(file) != 0) {
+                return false;
+            }
+#ifdef _WIN32
+            return _commit(_fileno(file)) == 0;
+#else
+            return fsync(fileno(file)) == 0;
+#endif
+        }
+    }
+
+    ProgressJournal::ProgressJournal() : _file(nullptr) {
+    }
+
+    ProgressJournal::~ProgressJournal() {
+        if (_file != nullptr) {
+            fclose(_file);
+        }
+    }
+
+    bool ProgressJournal::open(const std::string& path, bool resume) {
+        _path = path;
+        if (resume) {
+            if (!load() || !compact()) {
+                return false;
+            }
+            std::cout << "resume: " << _finished.size() << " images finished in " << _path << std::endl;
+            return open_for_append();
+        }
+        // start over
+        _file = fopen(_path.c_str(), "wb");
+        if (_file == nullptr) {
+            LOG(ERROR) << "Fail to create the journal: " << _path;
+            return false;
+        }
+        fputs(kJournalHeader, _file);
+        return sync_file(_file);
+    }
+
+    bool ProgressJournal::load() {
+        std::ifstream in(_path, std::ios::in | std::ios::binary);
+        if (!in) {
+            // nothing finished yet
+            return true;
+        }
+        std::stringstream contents;
+        contents << in.rdbuf();
+        const std::string text = contents.str();
+        size_t start = 0;
+        while (start < text.size()) {
+            size_t end = text.find('\n', start);
+            if (end == std::string::npos) {
+                // torn by a crash while appending
+                break;
+            }
+            if (text[start] != '#') {
+                size_t tab = text.find('\t', start);
+                if (tab == std::string::npos || tab > end) {
+                    LOG(ERROR) << "Bad line in the journal " << _path << ": " << text.substr(start, end - start);
+                    return false;
+                }
+                int64_t index = strtoll(text.c_str() + start, nullptr, 10);
+                std::string name = text.substr(tab + 1, end - tab - 1);
+                if (_finished.insert(name).second) {
+                    _entries.push_back(std::make_pair(index, name));
+                }
+            }
+            start = end + 1;
+        }
+        return true;
+    }
+
+    bool ProgressJournal::open_for_append() {
+        _file = fopen(_path.c_str(), "ab");
+        if (_file == nullptr) {
+            LOG(ERROR) << "Fail to open the journal: " << _path;
+            return false;
+        }
+        return true;
+    }
+
+    bool ProgressJournal::append(const std::vector<std::pair<int64_t, std::string>>& entries) {
+        if (_file == nullptr) {
+            return false;
+        }
+        std::string lines;
+        for (const auto& entry : entries) {
+            if (!_finished.insert(entry.second).second) {
+                continue;
+            }
+            _entries.push_back(entry);
+            lines += std::to_string(entry.first);
+            lines += '\t';
+            lines += entry.second;
+            lines += '\n';
+        }
+        if (lines.empty()) {
+            return true;
+        }
+        if (fwrite(lines.data(), 1, lines.size(), _file) != lines.size() || !sync_file(_file)) {
+            LOG(ERROR) << "Fail to write the journal: " << _path;
+            return false;
+        }
+        return true;
+    }
+
+    bool ProgressJournal::compact() {
+        bool reopen = _file != nullptr;
+        if (reopen) {
+            fclose(_file);
+            _file = nullptr;
+        }
+        // write a new file next to it and swap, a crash leaves one of the two
+        std::string tmp = _path + ".compact";
+        std::FILE* out = fopen(tmp.c_str(), "wb");
+        if (out == nullptr) {
+            LOG(ERROR) << "Fail to compact the journal: " << _path;
+            return false;
+        }
+        std::string lines(kJournalHeader);
+        for (const auto& entry : _entries) {
+            lines += std::to_string(entry.first);
+            lines += '\t';
+            lines += entry.second;
+            lines += '\n';
+        }
+        bool written = fwrite(lines.data(), 1, lines.size(), out) == lines.size() && sync_file(out);
+        fclose(out);
+        if (!written) {
+            LOG(ERROR) << "Fail to compact the journal: " << _path;
+            remove(tmp.c_str());
+            return false;
+        }
+#ifdef _WIN32
+        // rename does not replace an existing file on Windows
+        remove(_path.c_str());
+#endif
+        if (rename(tmp.c_str(), _path.c_str()) != 0) {
+            LOG(ERROR) << "Fail to replace the journal: " << _path;
+            return false;
+        }
+        return !reopen || open_for_append();
+    }
+
+    JournalImageSource::JournalImageSource(std::unique_ptr<ImageSource> source, std::unique_ptr<ProgressJournal> journal)
+        : _source(std::move(source)), _journal(std::move(journal)), _index(0), _skipped(0) {
+    }
+
+    bool JournalImageSource::next(ImageBlob& blob) {
+        while (_source->next(blob)) {
+            int64_t index = _index++;
+            if (_journal->finished(blob.name)) {
+                ++_skipped;
+                if (_pulled.empty()) {
+                    _source->done(1, std::vector<int>());
+                } else {
+                    // after the images handed out before it are done
+                    _pulled.push_back(Pulled{index, std::string(), true});
+                }
+                continue;
+            }
+            _pulled.push_back(Pulled{index, blob.name, false});
+            return true;
+        }
+        return false;
+    }
+
+    int JournalImageSource::next_batch(std::vector<ImageBlob>& batch, int max_size) {
+        int count = ImageSource::next_batch(batch, max_size);
+        if (count == 0) {
+            std::cout << "journal: " << _skipped << " finished images skipped, "
+                << _journal->finished_count() << " images finished" << std::endl;
+        }
+        return count;
+    }
+
+    void JournalImageSource::done(int count, const std::vector<int>& failed) {
+        // positions in `_source` of the `count` images handed out, plus the
+        // skipped ones among and right after them
+        _finished.clear();
+        _source_failed.clear();
+        int position = 0;
+        int handed_out = 0;
+        size_t k = 0;
+        while (!_pulled.empty() && (handed_out < count || _pulled.front().skipped)) {
+            Pulled& pulled = _pulled.front();
+            if (!pulled.skipped) {
+                if (k < failed.size() && failed[k] == handed_out) {
+                    _source_failed.push_back(position);
+                    ++k;
+                } else {
+                    _finished.push_back(std::make_pair(pulled.index, std::move(pulled.name)));
+                }
+                ++handed_out;
+            }
+            _pulled.pop_front();
+            ++position;
+        }
+        if (!_finished.empty() && !_journal->append(_finished)) {
+            LOG(ERROR) << "Fail to record the progress of " << _finished.size() << " images";
+        }
+        _source->done(position, _source_failed);
+    }
+
+    std::unique_ptr<ImageSource> create_journal_source(std::unique_ptr<ImageSource> source,
+        const std::string& journal_path, bool resume) {
+        std::unique_ptr<ProgressJournal> journal(new ProgressJournal());
+        if (!journal->open(journal_path, resume)) {
+            return nullptr;
+        }
+        return std::unique_ptr<ImageSource>(new JournalImageSource(std::move(source), std::move(journal)));
+    }
+}
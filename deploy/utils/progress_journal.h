@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "utils/image_source.h"
+
+namespace PaddleSolution {
+    /* Append-only record of the finished inputs of a job, one line per image:
+     *
+     *     <index in the input>\t<image name>
+     *
+     * The lines of a batch are appended with one write and synced to disk
+     * before the next batch starts, so after a crash the journal holds every
+     * finished batch and at most a torn last line, which is dropped.
+     */
+    class ProgressJournal {
+    public:
+        ProgressJournal();
+        ~ProgressJournal();
+
+        // open `path`; with `resume` the images it lists are loaded as finished
+        // and the journal is compacted, otherwise it is started over
+        bool open(const std::string& path, bool resume);
+
+        bool finished(const std::string& name) const {
+            return _finished.count(name) > 0;
+        }
+
+        size_t finished_count() const {
+            return _finished.size();
+        }
+
+        // append the images of a finished batch and sync them to disk
+        bool append(const std::vector<std::pair<int64_t, std::string>>& entries);
+
+        // rewrite the journal with one line per finished image, dropping the
+        // duplicates and the torn line a crash may leave
+        bool compact();
+
+    private:
+        ProgressJournal(const ProgressJournal&);
+        ProgressJournal& operator=(const ProgressJournal&);
+
+        bool load();
+        bool open_for_append();
+
+        std::string _path;
+        std::FILE* _file;
+        std::unordered_set<std::string> _finished;
+        // the finished images in journal order, written back by compact()
+        std::vector<std::pair<int64_t, std::string>> _entries;
+    };
+
+    /* The images of `source` not finished yet according to `journal`. An
+     * image counts as finished once the predictor reports it done, its outputs
+     * written, and is then appended to the journal; the images that failed to
+     * decode or whose batch failed to run are not, a resumed job retries them.
+     */
+    class JournalImageSource : public ImageSource {
+    public:
+        JournalImageSource(std::unique_ptr<ImageSource> source, std::unique_ptr<ProgressJournal> journal);
+
+        bool next(ImageBlob& blob);
+        int next_batch(std::vector<ImageBlob>& batch, int max_size);
+        // journals the images done but the failed ones, and passes them on
+        // to `source` with the skipped images among and right after them
+        void done(int count, const std::vector<int>& failed);
+
+    private:
+        // an image pulled from `_source` and not passed to its done() yet
+        struct Pulled {
+            int64_t index;
+            std::string name;
+            // finished in the journal already, not handed out
+            bool skipped;
+        };
+
+        std::unique_ptr<ImageSource> _source;
+        std::unique_ptr<ProgressJournal> _journal;
+        // position of the next image in `_source`
+        int64_t _index;
+        int64_t _skipped;
+        std::deque<Pulled> _pulled;
+        // scratch buffers of done()
+        std::vector<std::pair<int64_t, std::string>> _finished;
+        std::vector<int> _source_failed;
+    };
+
+    // wrap `source` into a JournalImageSource recording into `journal_path`,
+    // null if the journal cannot be opened
+    std::unique_ptr<ImageSource> create_journal_source(std::unique_ptr<ImageSource> source,
+        const std::string& journal_path, bool resume);
+}
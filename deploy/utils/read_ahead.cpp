@@ -0,0 +1,216 @@
+#include "utils/read_ahead.h"
+
+#include <algorithm>
+#include <fstream>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <glog/logging.h>
+
+#include "utils/seg_conf_parser.h"
+
+namespace PaddleSolution {
+
+    namespace {
+        // empty `blob` but keep the capacity of its byte buffer; the sources that
+        // only set some of the fields rely on the others being empty
+        void clear_blob(ImageBlob& blob) {
+            blob.name.clear();
+            blob.data.clear();
+            blob.bytes = nullptr;
+            blob.size = 0;
+            blob.holder.reset();
+            blob.mat.release();
+        }
+
+#ifndef _WIN32
+        // start fetching the pages of `path` into the page cache without waiting
+        void hint_file(const std::string& path) {
+#ifdef POSIX_FADV_WILLNEED
+            int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                return;
+            }
+            posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+            close(fd);
+#endif
+        }
+
+        bool read_file(const std::string& path, std::vector<unsigned char>* data) {
+            int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                return false;
+            }
+            struct stat st;
+            bool ok = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+            if (ok) {
+                data->resize(st.st_size);
+                std::size_t offset = 0;
+                while (offset < data->size()) {
+                    ssize_t n = ::read(fd, data->data() + offset, data->size() - offset);
+                    if (n < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (n <= 0) {
+                        break;
+                    }
+                    offset += n;
+                }
+                ok = offset == data->size();
+            }
+            close(fd);
+            return ok;
+        }
+#else
+        void hint_file(const std::string& path) {
+        }
+
+        bool read_file(const std::string& path, std::vector<unsigned char>* data) {
+            std::ifstream in(path, std::ios::in | std::ios::binary | std::ios::ate);
+            if (!in) {
+                return false;
+            }
+            data->resize(static_cast<std::size_t>(in.tellg()));
+            in.seekg(0);
+            return data->empty() || in.read(reinterpret_cast<char*>(data->data()), data->size());
+        }
+#endif
+    }
+
+    ReadAheadImageSource::ReadAheadImageSource(std::unique_ptr<ImageSource> source, int depth, int threads)
+        : _source(std::move(source)), _depth(std::max(1, depth)), _exhausted(false),
+          _images(0), _waits(0), _stop(false) {
+        for (int i = 0; i < std::max(1, threads); ++i) {
+            _threads.emplace_back([this] { read_files(); });
+        }
+    }
+
+    ReadAheadImageSource::~ReadAheadImageSource() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _read_cv.notify_all();
+        for (auto& t : _threads) {
+            t.join();
+        }
+    }
+
+    bool ReadAheadImageSource::next(ImageBlob& blob) {
+        fill();
+        if (_window.empty()) {
+            return false;
+        }
+        Slot* slot = _window.front().get();
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (!slot->done) {
+                ++_waits;
+                _done_cv.wait(lock, [slot] { return slot->done; });
+            }
+        }
+        // a failed read leaves `data` empty: the blob is handed out as a path
+        std::swap(blob, slot->blob);
+        // the slot gets the old blob of the caller, drop what it borrows
+        slot->blob.holder.reset();
+        slot->blob.mat.release();
+        _free.push_back(std::move(_window.front()));
+        _window.pop_front();
+        ++_images;
+        // queue the reads of the images that moved into the window
+        fill();
+        return true;
+    }
+
+    void ReadAheadImageSource::fill() {
+        while (!_exhausted && static_cast<int>(_window.size()) < _depth) {
+            clear_blob(_pulled);
+            if (!_source->next(_pulled)) {
+                _exhausted = true;
+                break;
+            }
+            std::unique_ptr<Slot> slot;
+            if (_free.empty()) {
+                slot.reset(new Slot());
+            } else {
+                slot = std::move(_free.back());
+                _free.pop_back();
+            }
+            slot->hinted = false;
+            if (_pulled.in_memory()) {
+                std::swap(slot->blob, _pulled);
+                slot->done = true;
+                _window.push_back(std::move(slot));
+                continue;
+            }
+            clear_blob(slot->blob);
+            slot->blob.name.swap(_pulled.name);
+            slot->done = false;
+            Slot* read = slot.get();
+            _window.push_back(std::move(slot));
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _reads.push_back(read);
+            }
+            _read_cv.notify_one();
+        }
+    }
+
+    void ReadAheadImageSource::read_files() {
+        std::vector<std::string> hints;
+        while (true) {
+            Slot* slot = nullptr;
+            hints.clear();
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _read_cv.wait(lock, [this] { return _stop || !_reads.empty(); });
+                if (_stop) {
+                    return;
+                }
+                slot = _reads.front();
+                _reads.pop_front();
+                // the caller does not touch a queued slot until it is done
+                for (Slot* queued : _reads) {
+                    if (static_cast<int>(hints.size()) >= kMaxHints) {
+                        break;
+                    }
+                    if (!queued->hinted) {
+                        queued->hinted = true;
+                        hints.push_back(queued->blob.name);
+                    }
+                }
+            }
+            for (const auto& path : hints) {
+                hint_file(path);
+            }
+            if (!read_file(slot->blob.name, &slot->blob.data)) {
+                slot->blob.data.clear();
+            }
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                slot->done = true;
+            }
+            _done_cv.notify_all();
+        }
+    }
+
+    std::unique_ptr<ImageSource> create_read_ahead_source(std::unique_ptr<ImageSource> source,
+        const std::string& conf) {
+        PaddleSegModelConfigPaser config;
+        if (!config.load_config(conf)) {
+            LOG(ERROR) << "Fail to load config file: [" << conf << "]";
+            return nullptr;
+        }
+        if (config._read_ahead_batches <= 0) {
+            return source;
+        }
+        int depth = config._read_ahead_batches * std::max(1, config._batch_size);
+        return std::unique_ptr<ImageSource>(
+            new ReadAheadImageSource(std::move(source), depth, config._read_ahead_threads));
+    }
+}
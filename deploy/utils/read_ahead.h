@@ -0,0 +1,95 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "utils/image_source.h"
+
+namespace PaddleSolution {
+    /* Reads the image files of the next images of `source` into memory while
+     * the current batches are decoded and predicted, so the disk latency
+     * overlaps with the compute and decoding runs from memory (imdecode).
+     *
+     * The caller thread pulls up to `depth` images ahead from `source`; the
+     * path-only ones are queued to `threads` reader threads. Before a read,
+     * a reader hints the kernel (posix_fadvise WILLNEED) about the files queued
+     * behind it, so their pages are fetched in parallel with the reads. The
+     * blobs and their byte buffers are recycled from image to image. A file
+     * that cannot be read is handed out as a path, the predictor reports it.
+     * Blobs already in memory (encoded streams, shards) pass through as is.
+     */
+    class ReadAheadImageSource : public ImageSource {
+    public:
+        // files hinted by a reader before each read
+        static const int kMaxHints = 16;
+
+        ReadAheadImageSource(std::unique_ptr<ImageSource> source, int depth, int threads);
+        ~ReadAheadImageSource();
+
+        bool next(ImageBlob& blob);
+
+        // the images are handed out in the order of `source`
+        void done(int count, const std::vector<int>& failed) {
+            _source->done(count, failed);
+        }
+
+        // images handed out, and those whose read was not finished yet when asked for
+        int64_t images() const {
+            return _images;
+        }
+
+        int64_t waits() const {
+            return _waits;
+        }
+
+    private:
+        ReadAheadImageSource(const ReadAheadImageSource&);
+        ReadAheadImageSource& operator=(const ReadAheadImageSource&);
+
+        struct Slot {
+            Slot() : done(false), hinted(false) {
+            }
+
+            ImageBlob blob;
+            // guarded by `_mutex`
+            bool done;
+            bool hinted;
+        };
+
+        // pull images from `_source` until `_depth` are ahead
+        void fill();
+        void read_files();
+
+        std::unique_ptr<ImageSource> _source;
+        int _depth;
+        bool _exhausted;
+        // images ahead in input order, touched by the caller thread only
+        std::deque<std::unique_ptr<Slot>> _window;
+        // recycled slots, keeping the capacity of their byte buffers
+        std::vector<std::unique_ptr<Slot>> _free;
+        ImageBlob _pulled;
+        int64_t _images;
+        int64_t _waits;
+
+        std::mutex _mutex;
+        // signaled when a read is queued or on stop
+        std::condition_variable _read_cv;
+        // signaled when a read is done
+        std::condition_variable _done_cv;
+        std::deque<Slot*> _reads;
+        bool _stop;
+        std::vector<std::thread> _threads;
+    };
+
+    // wrap `source` into a ReadAheadImageSource as DEPLOY.READ_AHEAD of the config
+    // file `conf` says, `source` itself when the read ahead is disabled; null if
+    // `conf` cannot be loaded. Wrap it before a JournalImageSource, never after.
+    std::unique_ptr<ImageSource> create_read_ahead_source(std::unique_ptr<ImageSource> source,
+        const std::string& conf);
+}
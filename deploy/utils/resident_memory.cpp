@@ -0,0 +1,225 @@
+#include "utils/resident_memory.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <glog/logging.h>
+
+#include "utils/seg_conf_parser.h"
+
+namespace PaddleSolution {
+    namespace utils {
+
+        namespace {
+            // the default huge page size on x86_64 and aarch64
+            const std::size_t kHugePageSize = 2 << 20;
+
+            std::size_t round_up(std::size_t n, std::size_t align) {
+                return (n + align - 1) / align * align;
+            }
+
+            // log `message` the first time only, a missing pool or a low
+            // RLIMIT_MEMLOCK would otherwise be reported on every buffer
+            void warn_once(std::atomic<bool>* warned, const char* message) {
+                if (!warned->exchange(true)) {
+                    LOG(WARNING) << message;
+                }
+            }
+
+            // buffers smaller than a huge page keep small pages
+            bool use_huge_pages(std::size_t bytes, const MemoryResidency& residency) {
+                return residency.huge_pages != MemoryResidency::NO_HUGE_PAGES && bytes >= kHugePageSize;
+            }
+
+#ifndef _WIN32
+            std::atomic<bool> g_no_hugetlb(false);
+            std::atomic<bool> g_no_mlock(false);
+
+            std::size_t mapped_size(std::size_t bytes, const MemoryResidency& residency) {
+                return round_up(bytes, use_huge_pages(bytes, residency)
+                    ? kHugePageSize : static_cast<std::size_t>(sysconf(_SC_PAGESIZE)));
+            }
+
+            // anonymous memory starting on a huge page boundary, so all of it can be
+            // backed by transparent huge pages
+            void* map_aligned(std::size_t size) {
+                std::size_t padded = size + kHugePageSize;
+                void* p = mmap(nullptr, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (p == MAP_FAILED) {
+                    return p;
+                }
+                uintptr_t start = reinterpret_cast<uintptr_t>(p);
+                uintptr_t aligned = round_up(start, kHugePageSize);
+                if (aligned > start) {
+                    munmap(p, aligned - start);
+                }
+                std::size_t tail = start + padded - (aligned + size);
+                if (tail > 0) {
+                    munmap(reinterpret_cast<void*>(aligned + size), tail);
+                }
+                return reinterpret_cast<void*>(aligned);
+            }
+
+            // the writable anonymous mappings (and the brk heap), skipping the thread
+            // stacks, which sit right above a guard page
+            std::vector<std::pair<std::size_t, std::size_t>> anonymous_mappings() {
+                std::vector<std::pair<std::size_t, std::size_t>> ranges;
+                FILE* fp = fopen("/proc/self/maps", "r");
+                if (fp == nullptr) {
+                    return ranges;
+                }
+                char line[512];
+                std::size_t guard_end = 0;
+                while (fgets(line, sizeof(line), fp) != nullptr) {
+                    unsigned long long start = 0;
+                    unsigned long long end = 0;
+                    char perms[8] = { 0 };
+                    unsigned long long inode = 0;
+                    int path = 0;
+                    if (sscanf(line, "%llx-%llx %7s %*s %*s %llu %n", &start, &end, perms, &inode, &path) < 4) {
+                        continue;
+                    }
+                    const char* name = line + path;
+                    bool anonymous = inode == 0 && (*name == '\n' || *name == '\0' || strncmp(name, "[heap]", 6) == 0);
+                    if (anonymous && strncmp(perms, "---", 3) == 0) {
+                        guard_end = end;
+                        continue;
+                    }
+                    if (anonymous && perms[0] == 'r' && perms[1] == 'w' && start != guard_end) {
+                        ranges.push_back(std::make_pair(static_cast<std::size_t>(start), static_cast<std::size_t>(end)));
+                    }
+                }
+                fclose(fp);
+                return ranges;
+            }
+#endif
+        }
+
+        bool memory_residency(const PaddleSegModelConfigPaser& config, MemoryResidency* residency) {
+            const auto& huge_pages = config._memory_huge_pages;
+            if (huge_pages == "NONE") {
+                residency->huge_pages = MemoryResidency::NO_HUGE_PAGES;
+            } else if (huge_pages == "TRANSPARENT") {
+                residency->huge_pages = MemoryResidency::TRANSPARENT_HUGE_PAGES;
+            } else if (huge_pages == "EXPLICIT") {
+                residency->huge_pages = MemoryResidency::EXPLICIT_HUGE_PAGES;
+            } else {
+                LOG(ERROR) << "Unknown DEPLOY.MEMORY.HUGE_PAGES: " << huge_pages;
+                return false;
+            }
+            if (config._memory_lock < 0 || config._memory_lock > 2) {
+                LOG(ERROR) << "Unknown DEPLOY.MEMORY.LOCK: " << config._memory_lock;
+                return false;
+            }
+            residency->lock = config._memory_lock > 0;
+            return true;
+        }
+
+#ifndef _WIN32
+        void* resident_allocate(std::size_t bytes, const MemoryResidency& residency) {
+            bool huge = use_huge_pages(bytes, residency);
+            if (!huge && !residency.lock) {
+                return ::operator new(bytes);
+            }
+            std::size_t size = mapped_size(bytes, residency);
+            void* p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+            if (huge && residency.huge_pages == MemoryResidency::EXPLICIT_HUGE_PAGES) {
+                p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+                if (p == MAP_FAILED) {
+                    warn_once(&g_no_hugetlb, "No explicit huge page available (vm.nr_hugepages), "
+                        "using transparent huge pages");
+                }
+            }
+#endif
+            if (p == MAP_FAILED && huge) {
+                p = map_aligned(size);
+#ifdef MADV_HUGEPAGE
+                if (p != MAP_FAILED) {
+                    madvise(p, size, MADV_HUGEPAGE);
+                }
+#endif
+            } else if (p == MAP_FAILED) {
+                p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            }
+            if (p == MAP_FAILED) {
+                throw std::bad_alloc();
+            }
+            if (residency.lock && mlock(p, size) != 0) {
+                warn_once(&g_no_mlock, "Fail to mlock the batch buffers, raise RLIMIT_MEMLOCK (ulimit -l)");
+            }
+            return p;
+        }
+
+        void resident_deallocate(void* p, std::size_t bytes, const MemoryResidency& residency) {
+            if (!use_huge_pages(bytes, residency) && !residency.lock) {
+                ::operator delete(p);
+                return;
+            }
+            // unmapping unlocks too
+            munmap(p, mapped_size(bytes, residency));
+        }
+
+        MappingSnapshot::MappingSnapshot() : _ranges(anonymous_mappings()) {
+        }
+
+        bool MappingSnapshot::lock_new() const {
+            std::size_t locked = 0;
+            bool failed = false;
+            for (const auto& range : anonymous_mappings()) {
+                // the parts of `range` not mapped at the snapshot
+                std::size_t start = range.first;
+                for (const auto& old : _ranges) {
+                    if (start >= range.second) {
+                        break;
+                    }
+                    if (old.second <= start || old.first >= range.second) {
+                        continue;
+                    }
+                    if (old.first > start) {
+                        failed |= mlock(reinterpret_cast<void*>(start), old.first - start) != 0;
+                        locked += old.first - start;
+                    }
+                    start = std::max(start, old.second);
+                }
+                if (start < range.second) {
+                    failed |= mlock(reinterpret_cast<void*>(start), range.second - start) != 0;
+                    locked += range.second - start;
+                }
+            }
+            if (failed) {
+                LOG(WARNING) << "Fail to mlock the model, raise RLIMIT_MEMLOCK (ulimit -l)";
+                return false;
+            }
+            std::cout << "mlock: " << locked / (1024 * 1024) << " MB mapped by the model" << std::endl;
+            return true;
+        }
+#else
+        void* resident_allocate(std::size_t bytes, const MemoryResidency& residency) {
+            return ::operator new(bytes);
+        }
+
+        void resident_deallocate(void* p, std::size_t bytes, const MemoryResidency& residency) {
+            ::operator delete(p);
+        }
+
+        MappingSnapshot::MappingSnapshot() {
+        }
+
+        bool MappingSnapshot::lock_new() const {
+            LOG(WARNING) << "DEPLOY.MEMORY.LOCK 2 is not supported on Windows";
+            return false;
+        }
+#endif
+    }
+}
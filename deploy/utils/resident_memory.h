@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace PaddleSolution {
+    class PaddleSegModelConfigPaser;
+
+    namespace utils {
+        // where the batch buffers are placed, from DEPLOY.MEMORY
+        struct MemoryResidency {
+            enum HugePages {
+                NO_HUGE_PAGES,
+                // anonymous memory aligned to huge pages and madvise(MADV_HUGEPAGE)
+                TRANSPARENT_HUGE_PAGES,
+                // MAP_HUGETLB from the vm.nr_hugepages pool, transparent ones when it is empty
+                EXPLICIT_HUGE_PAGES
+            };
+
+            MemoryResidency() : huge_pages(NO_HUGE_PAGES), lock(false) {
+            }
+
+            bool operator==(const MemoryResidency& other) const {
+                return huge_pages == other.huge_pages && lock == other.lock;
+            }
+
+            HugePages huge_pages;
+            // mlock the buffers so memory pressure cannot evict them
+            bool lock;
+        };
+
+        // DEPLOY.MEMORY of `config`, false on an unknown HUGE_PAGES or LOCK
+        bool memory_residency(const PaddleSegModelConfigPaser& config, MemoryResidency* residency);
+
+        // `bytes` of memory placed as `residency` says; plain operator new when it
+        // asks for nothing, throws std::bad_alloc like it
+        void* resident_allocate(std::size_t bytes, const MemoryResidency& residency);
+        void resident_deallocate(void* p, std::size_t bytes, const MemoryResidency& residency);
+
+        // std::vector allocator placing its storage with resident_allocate()
+        template <typename T>
+        class ResidentAllocator {
+        public:
+            typedef T value_type;
+            // assigning a vector moves its placement along with the storage
+            typedef std::true_type propagate_on_container_copy_assignment;
+            typedef std::true_type propagate_on_container_move_assignment;
+            typedef std::true_type propagate_on_container_swap;
+
+            template <typename U>
+            struct rebind {
+                typedef ResidentAllocator<U> other;
+            };
+
+            ResidentAllocator() {
+            }
+
+            explicit ResidentAllocator(const MemoryResidency& residency) : _residency(residency) {
+            }
+
+            template <typename U>
+            ResidentAllocator(const ResidentAllocator<U>& other) : _residency(other.residency()) {
+            }
+
+            T* allocate(std::size_t n) {
+                return static_cast<T*>(resident_allocate(n * sizeof(T), _residency));
+            }
+
+            void deallocate(T* p, std::size_t n) {
+                resident_deallocate(p, n * sizeof(T), _residency);
+            }
+
+            const MemoryResidency& residency() const {
+                return _residency;
+            }
+
+        private:
+            MemoryResidency _residency;
+        };
+
+        template <typename T, typename U>
+        bool operator==(const ResidentAllocator<T>& a, const ResidentAllocator<U>& b) {
+            return a.residency() == b.residency();
+        }
+
+        template <typename T, typename U>
+        bool operator!=(const ResidentAllocator<T>& a, const ResidentAllocator<U>& b) {
+            return !(a == b);
+        }
+
+        template <typename T>
+        using ResidentVector = std::vector<T, ResidentAllocator<T>>;
+
+        // move `buffer` to memory placed as `residency` says and, when `prefault_size`
+        // is not 0, resize it to that many zeros so its pages are faulted in now
+        // instead of in the first batches
+        template <typename T>
+        void place_buffer(ResidentVector<T>* buffer, const MemoryResidency& residency, std::size_t prefault_size) {
+            ResidentVector<T> placed((ResidentAllocator<T>(residency)));
+            placed.resize(prefault_size);
+            *buffer = std::move(placed);
+        }
+
+        /* The writable anonymous mappings of the process when it was taken;
+         * lock_new() then mlocks the memory mapped since, like the parameters
+         * of a model created in between.
+         */
+        class MappingSnapshot {
+        public:
+            MappingSnapshot();
+
+            // lock the memory mapped since the snapshot and log its size, false
+            // if some could not be locked (RLIMIT_MEMLOCK)
+            bool lock_new() const;
+
+        private:
+            std::vector<std::pair<std::size_t, std::size_t>> _ranges;
+        };
+    }
+}
@@ -21,7 +21,33 @@ namespace PaddleSolution {
 	    _scaling_map{{"UNPADDING", 0},
 			 {"RANGE_SCALING",1}}, 
             _feeds_size(1),
-	    _coarsest_stride(1)
+	    _coarsest_stride(1),
+            _quantize(0),
+            _quantize_warmup_batch_size(0),
+            _input_dtype("FLOAT32"),
+            _input_layout("NCHW"),
+            _sharding_mode("NONE"),
+            _sharding_cores_per_shard(0),
+            _sharding_dispatch("ROUND_ROBIN"),
+            _result_cache(0),
+            _result_cache_capacity(10000),
+            _tensor_cache(0),
+            _tensor_cache_max_mb(0),
+            _profile(0),
+            _profile_start_batch(10),
+            _profile_batches(20),
+            _profile_output("op_profile.json"),
+            _fused_resize(0),
+            _read_ahead_batches(0),
+            _read_ahead_threads(4),
+            _memory_huge_pages("NONE"),
+            _memory_prefault(0),
+            _memory_lock(0),
+            _memory_budget_mb(0),
+            _adaptive_batch(0),
+            _adaptive_batch_slo_ms(100),
+            _adaptive_batch_min_size(1),
+            _adaptive_batch_window(20)
 	     {
         }
         ~PaddleSegModelConfigPaser() {
@@ -45,6 +71,37 @@ namespace PaddleSolution {
 	    _resize_max_size = 0;
 	    _feeds_size = 1;
  	    _coarsest_stride = 1;
+            _quantize = 0;
+            _quantize_warmup_data.clear();
+            _quantize_warmup_batch_size = 0;
+            _quantize_op_types.clear();
+            _input_dtype = "FLOAT32";
+            _input_layout = "NCHW";
+            _sharding_mode = "NONE";
+            _sharding_cores_per_shard = 0;
+            _sharding_dispatch = "ROUND_ROBIN";
+            _result_cache = 0;
+            _result_cache_capacity = 10000;
+            _result_cache_dir.clear();
+            _tensor_cache = 0;
+            _tensor_cache_dir.clear();
+            _tensor_cache_max_mb = 0;
+            _profile = 0;
+            _profile_start_batch = 10;
+            _profile_batches = 20;
+            _profile_output = "op_profile.json";
+            _fused_resize = 0;
+            _read_ahead_batches = 0;
+            _read_ahead_threads = 4;
+            _memory_huge_pages = "NONE";
+            _memory_prefault = 0;
+            _memory_lock = 0;
+            _memory_budget_mb = 0;
+            _adaptive_batch = 0;
+            _adaptive_batch_slo_ms = 100;
+            _adaptive_batch_min_size = 1;
+            _adaptive_batch_window = 20;
+            _adaptive_batch_output.clear();
         }
 
         std::string process_parenthesis(const std::string& str) {
@@ -141,6 +198,135 @@ namespace PaddleSolution {
 	    if(config["DEPLOY"]["COARSEST_STRIDE"].IsDefined()) {
 		_coarsest_stride = config["DEPLOY"]["COARSEST_STRIDE"].as<int>();
 	    }
+            // 20. quantize
+            if (config["DEPLOY"]["QUANTIZE"].IsDefined()) {
+                auto quantize = config["DEPLOY"]["QUANTIZE"];
+                if (quantize["ENABLE"].IsDefined()) {
+                    _quantize = quantize["ENABLE"].as<int>();
+                }
+                if (quantize["WARMUP_DATA"].IsDefined()) {
+                    _quantize_warmup_data = quantize["WARMUP_DATA"].as<std::string>();
+                }
+                if (quantize["WARMUP_BATCH_SIZE"].IsDefined()) {
+                    _quantize_warmup_batch_size = quantize["WARMUP_BATCH_SIZE"].as<int>();
+                }
+                for (const auto& item : quantize["OP_TYPES"]) {
+                    _quantize_op_types.push_back(item.as<std::string>());
+                }
+            }
+            // 21. input_dtype
+            if (config["DEPLOY"]["INPUT_DTYPE"].IsDefined()) {
+                _input_dtype = config["DEPLOY"]["INPUT_DTYPE"].as<std::string>();
+            }
+            // 22. input_layout
+            if (config["DEPLOY"]["INPUT_LAYOUT"].IsDefined()) {
+                _input_layout = config["DEPLOY"]["INPUT_LAYOUT"].as<std::string>();
+            }
+            // 23. sharding
+            if (config["DEPLOY"]["SHARDING"].IsDefined()) {
+                auto sharding = config["DEPLOY"]["SHARDING"];
+                if (sharding["MODE"].IsDefined()) {
+                    _sharding_mode = sharding["MODE"].as<std::string>();
+                }
+                if (sharding["CORES_PER_SHARD"].IsDefined()) {
+                    _sharding_cores_per_shard = sharding["CORES_PER_SHARD"].as<int>();
+                }
+                if (sharding["DISPATCH"].IsDefined()) {
+                    _sharding_dispatch = sharding["DISPATCH"].as<std::string>();
+                }
+            }
+            // 24. result cache
+            if (config["DEPLOY"]["RESULT_CACHE"].IsDefined()) {
+                auto result_cache = config["DEPLOY"]["RESULT_CACHE"];
+                if (result_cache["ENABLE"].IsDefined()) {
+                    _result_cache = result_cache["ENABLE"].as<int>();
+                }
+                if (result_cache["CAPACITY"].IsDefined()) {
+                    _result_cache_capacity = result_cache["CAPACITY"].as<int>();
+                }
+                if (result_cache["DISK_DIR"].IsDefined()) {
+                    _result_cache_dir = result_cache["DISK_DIR"].as<std::string>();
+                }
+            }
+            // 25. tensor cache
+            if (config["DEPLOY"]["TENSOR_CACHE"].IsDefined()) {
+                auto tensor_cache = config["DEPLOY"]["TENSOR_CACHE"];
+                if (tensor_cache["ENABLE"].IsDefined()) {
+                    _tensor_cache = tensor_cache["ENABLE"].as<int>();
+                }
+                if (tensor_cache["DIR"].IsDefined()) {
+                    _tensor_cache_dir = tensor_cache["DIR"].as<std::string>();
+                }
+                if (tensor_cache["MAX_MB"].IsDefined()) {
+                    _tensor_cache_max_mb = tensor_cache["MAX_MB"].as<int>();
+                }
+            }
+            // 26. operator profile
+            if (config["DEPLOY"]["PROFILE"].IsDefined()) {
+                auto profile = config["DEPLOY"]["PROFILE"];
+                if (profile["ENABLE"].IsDefined()) {
+                    _profile = profile["ENABLE"].as<int>();
+                }
+                if (profile["START_BATCH"].IsDefined()) {
+                    _profile_start_batch = profile["START_BATCH"].as<int>();
+                }
+                if (profile["BATCHES"].IsDefined()) {
+                    _profile_batches = profile["BATCHES"].as<int>();
+                }
+                if (profile["OUTPUT"].IsDefined()) {
+                    _profile_output = profile["OUTPUT"].as<std::string>();
+                }
+            }
+            // 27. fused resize
+            if (config["DEPLOY"]["FUSED_RESIZE"].IsDefined()) {
+                _fused_resize = config["DEPLOY"]["FUSED_RESIZE"].as<int>();
+            }
+            // 28. read ahead
+            if (config["DEPLOY"]["READ_AHEAD"].IsDefined()) {
+                auto read_ahead = config["DEPLOY"]["READ_AHEAD"];
+                if (read_ahead["BATCHES"].IsDefined()) {
+                    _read_ahead_batches = read_ahead["BATCHES"].as<int>();
+                }
+                if (read_ahead["THREADS"].IsDefined()) {
+                    _read_ahead_threads = read_ahead["THREADS"].as<int>();
+                }
+            }
+            // 29. memory residency
+            if (config["DEPLOY"]["MEMORY"].IsDefined()) {
+                auto memory = config["DEPLOY"]["MEMORY"];
+                if (memory["HUGE_PAGES"].IsDefined()) {
+                    _memory_huge_pages = memory["HUGE_PAGES"].as<std::string>();
+                }
+                if (memory["PREFAULT"].IsDefined()) {
+                    _memory_prefault = memory["PREFAULT"].as<int>();
+                }
+                if (memory["LOCK"].IsDefined()) {
+                    _memory_lock = memory["LOCK"].as<int>();
+                }
+            }
+            // 30. memory budget of a batch
+            if (config["DEPLOY"]["MEMORY_BUDGET_MB"].IsDefined()) {
+                _memory_budget_mb = config["DEPLOY"]["MEMORY_BUDGET_MB"].as<int>();
+            }
+            // 31. adaptive batch size
+            if (config["DEPLOY"]["ADAPTIVE_BATCH"].IsDefined()) {
+                auto adaptive_batch = config["DEPLOY"]["ADAPTIVE_BATCH"];
+                if (adaptive_batch["ENABLE"].IsDefined()) {
+                    _adaptive_batch = adaptive_batch["ENABLE"].as<int>();
+                }
+                if (adaptive_batch["LATENCY_SLO_MS"].IsDefined()) {
+                    _adaptive_batch_slo_ms = adaptive_batch["LATENCY_SLO_MS"].as<double>();
+                }
+                if (adaptive_batch["MIN_BATCH_SIZE"].IsDefined()) {
+                    _adaptive_batch_min_size = adaptive_batch["MIN_BATCH_SIZE"].as<int>();
+                }
+                if (adaptive_batch["WINDOW"].IsDefined()) {
+                    _adaptive_batch_window = adaptive_batch["WINDOW"].as<int>();
+                }
+                if (adaptive_batch["OUTPUT"].IsDefined()) {
+                    _adaptive_batch_output = adaptive_batch["OUTPUT"].as<std::string>();
+                }
+            }
             return true;
         }
 
@@ -179,6 +365,19 @@ namespace PaddleSolution {
             std::cout << "DEPLOY.USE_GPU: " << _use_gpu << std::endl;
             std::cout << "DEPLOY.PREDICTOR_MODE: " << _predictor_mode << std::endl;
             std::cout << "DEPLOY.BATCH_SIZE: " << _batch_size << std::endl;
+            std::cout << "DEPLOY.QUANTIZE.ENABLE: " << _quantize << std::endl;
+            std::cout << "DEPLOY.QUANTIZE.WARMUP_DATA: " << _quantize_warmup_data << std::endl;
+            std::cout << "DEPLOY.INPUT_DTYPE: " << _input_dtype << std::endl;
+            std::cout << "DEPLOY.INPUT_LAYOUT: " << _input_layout << std::endl;
+            std::cout << "DEPLOY.SHARDING.MODE: " << _sharding_mode << std::endl;
+            std::cout << "DEPLOY.RESULT_CACHE.ENABLE: " << _result_cache << std::endl;
+            std::cout << "DEPLOY.TENSOR_CACHE.ENABLE: " << _tensor_cache << std::endl;
+            std::cout << "DEPLOY.PROFILE.ENABLE: " << _profile << std::endl;
+            std::cout << "DEPLOY.FUSED_RESIZE: " << _fused_resize << std::endl;
+            std::cout << "DEPLOY.READ_AHEAD.BATCHES: " << _read_ahead_batches << std::endl;
+            std::cout << "DEPLOY.MEMORY.HUGE_PAGES: " << _memory_huge_pages << std::endl;
+            std::cout << "DEPLOY.MEMORY_BUDGET_MB: " << _memory_budget_mb << std::endl;
+            std::cout << "DEPLOY.ADAPTIVE_BATCH.ENABLE: " << _adaptive_batch << std::endl;
         }
 	//DEPLOY.COARSEST_STRIDE
 	int _coarsest_stride;
@@ -218,6 +417,72 @@ namespace PaddleSolution {
         std::string _predictor_mode;
         // DEPLOY.BATCH_SIZE
         int _batch_size;
+        // DEPLOY.QUANTIZE.ENABLE
+        int _quantize;
+        // DEPLOY.QUANTIZE.WARMUP_DATA
+        std::string _quantize_warmup_data;
+        // DEPLOY.QUANTIZE.WARMUP_BATCH_SIZE
+        int _quantize_warmup_batch_size;
+        // DEPLOY.QUANTIZE.OP_TYPES
+        std::vector<std::string> _quantize_op_types;
+        // DEPLOY.INPUT_DTYPE  FLOAT32 or UINT8, UINT8 feeds the resized pixels and
+        // leaves the normalization to the model
+        std::string _input_dtype;
+        // DEPLOY.INPUT_LAYOUT  NCHW or NHWC, NHWC only applies to UINT8 input
+        std::string _input_layout;
+        // DEPLOY.SHARDING.MODE  NONE, NUMA (a shard per node) or CORES
+        std::string _sharding_mode;
+        // DEPLOY.SHARDING.CORES_PER_SHARD  cpus of a shard in CORES mode
+        int _sharding_cores_per_shard;
+        // DEPLOY.SHARDING.DISPATCH  ROUND_ROBIN or LEAST_LOAD
+        std::string _sharding_dispatch;
+        // DEPLOY.RESULT_CACHE.ENABLE
+        int _result_cache;
+        // DEPLOY.RESULT_CACHE.CAPACITY  results kept in memory
+        int _result_cache_capacity;
+        // DEPLOY.RESULT_CACHE.DISK_DIR  also keep the results in this directory
+        std::string _result_cache_dir;
+        // DEPLOY.TENSOR_CACHE.ENABLE
+        int _tensor_cache;
+        // DEPLOY.TENSOR_CACHE.DIR  directory of the tensor files
+        std::string _tensor_cache_dir;
+        // DEPLOY.TENSOR_CACHE.MAX_MB  stop adding tensors past this size, 0: no limit
+        int _tensor_cache_max_mb;
+        // DEPLOY.PROFILE.ENABLE
+        int _profile;
+        // DEPLOY.PROFILE.START_BATCH  first profiled batch, skips the warm up
+        int _profile_start_batch;
+        // DEPLOY.PROFILE.BATCHES  number of profiled batches
+        int _profile_batches;
+        // DEPLOY.PROFILE.OUTPUT  JSON file of the operator times, empty: print only
+        std::string _profile_output;
+        // DEPLOY.FUSED_RESIZE  resize, normalize and transpose 8-bit BGR images in
+        // one pass instead of cv::resize and the normalize loop
+        int _fused_resize;
+        // DEPLOY.READ_AHEAD.BATCHES  batches of image files read into memory ahead
+        // of the predicted one, 0 disables the read ahead
+        int _read_ahead_batches;
+        // DEPLOY.READ_AHEAD.THREADS  threads reading the files
+        int _read_ahead_threads;
+        // DEPLOY.MEMORY.HUGE_PAGES  NONE, TRANSPARENT or EXPLICIT huge pages for the batch buffers
+        std::string _memory_huge_pages;
+        // DEPLOY.MEMORY.PREFAULT  touch the batch buffers at init
+        int _memory_prefault;
+        // DEPLOY.MEMORY.LOCK  0: no mlock, 1: the batch buffers, 2: the batch buffers and the model
+        int _memory_lock;
+        // DEPLOY.MEMORY_BUDGET_MB  memory allowed to the buffers of a batch, the batch
+        // size is capped to stay under it; 0 disables the cap
+        int _memory_budget_mb;
+        // DEPLOY.ADAPTIVE_BATCH.ENABLE  adjust the batch size to the latency SLO
+        int _adaptive_batch;
+        // DEPLOY.ADAPTIVE_BATCH.LATENCY_SLO_MS  p99 of the preprocess + inference time of a batch
+        double _adaptive_batch_slo_ms;
+        // DEPLOY.ADAPTIVE_BATCH.MIN_BATCH_SIZE
+        int _adaptive_batch_min_size;
+        // DEPLOY.ADAPTIVE_BATCH.WINDOW  batches measured before growing the batch size
+        int _adaptive_batch_window;
+        // DEPLOY.ADAPTIVE_BATCH.OUTPUT  JSON lines file of the decisions, empty: print only
+        std::string _adaptive_batch_output;
     };
 
 }
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "utils/trace.h"
+
+namespace PaddleSolution {
+    namespace utils {
+        /* Fixed set of worker threads that stay alive for the whole process, so
+         * per-thread state (like the MatPool scratch buffers) survives from one
+         * batch to the next. One parallel_for runs at a time, the calling thread
+         * works on it too.
+         */
+        class ThreadPool {
+        public:
+            explicit ThreadPool(int num_threads)
+                : _task(nullptr), _fn(nullptr), _n(0), _next(0), _pending(0), _active(0), _generation(0), _trace_batch(-1), _stop(false) {
+                for (int i = 0; i < num_threads; ++i) {
+                    _workers.emplace_back([this] { work(); });
+                }
+            }
+
+            ~ThreadPool() {
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    _stop = true;
+                }
+                _cv.notify_all();
+                for (auto& t : _workers) {
+                    t.join();
+                }
+            }
+
+            // call fn(0) ... fn(n - 1) on the workers and wait until all returned;
+            // `fn` is called through a plain pointer, no std::function, whose copy
+            // of a lambda capturing a few references would allocate on every call
+            template <typename Fn>
+            void parallel_for(int n, const Fn& fn) {
+                run(n, &call<Fn>, &fn);
+            }
+
+            // pool shared by the preprocessors, one worker per core
+            static ThreadPool& shared() {
+                static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+                return pool;
+            }
+
+            // pool the preprocessors use on the calling thread: the one set with
+            // set_current() (each predictor shard has its own), shared() otherwise
+            static ThreadPool& current() {
+                ThreadPool* pool = thread_pool();
+                return pool != nullptr ? *pool : shared();
+            }
+
+            static void set_current(ThreadPool* pool) {
+                thread_pool() = pool;
+            }
+
+        private:
+            typedef void (*Task)(const void* fn, int i);
+
+            ThreadPool(const ThreadPool&);
+            ThreadPool& operator=(const ThreadPool&);
+
+            template <typename Fn>
+            static void call(const void* fn, int i) {
+                (*static_cast<const Fn*>(fn))(i);
+            }
+
+            void run(int n, Task task, const void* fn) {
+                if (n <= 0) {
+                    return;
+                }
+                std::lock_guard<std::mutex> call_lock(_call_mutex);
+                uint64_t generation = 0;
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    generation = ++_generation;
+                    // first, a worker still claiming for the last call fails from now on
+                    _next = claim_start(generation);
+                    _task = task;
+                    _fn = fn;
+                    _n = n;
+                    _pending = n;
+                    _trace_batch = Tracer::batch();
+                }
+                _cv.notify_all();
+                run_tasks(generation, n);
+                std::unique_lock<std::mutex> lock(_mutex);
+                // also wait for the workers to leave run_tasks
+                _done_cv.wait(lock, [this] { return _pending == 0 && _active == 0; });
+                _fn = nullptr;
+            }
+
+            static ThreadPool*& thread_pool() {
+                static thread_local ThreadPool* pool = nullptr;
+                return pool;
+            }
+
+            // _next holds the low 32 bits of the generation of the call above the
+            // index to take next, so a worker that woke for an earlier call
+            // cannot take an index of the current one
+            static uint64_t claim_start(uint64_t generation) {
+                return generation << 32;
+            }
+
+            // take the next index of call `generation` of `n` indices, false once
+            // they are all taken or another call started
+            bool claim(uint64_t generation, int n, int* i) {
+                uint64_t start = claim_start(generation);
+                uint64_t next = _next.load();
+                while (next - start < static_cast<uint64_t>(n)) {
+                    if (_next.compare_exchange_weak(next, next + 1)) {
+                        *i = static_cast<int>(next - start);
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            void run_tasks(uint64_t generation, int n) {
+                int i = 0;
+                while (claim(generation, n, &i)) {
+                    (*_task)(_fn, i);
+                    int pending = --_pending;
+                    assert(pending >= 0);
+                    if (pending == 0) {
+                        std::lock_guard<std::mutex> lock(_mutex);
+                        _done_cv.notify_all();
+                    }
+                }
+            }
+
+            void work() {
+                uint64_t seen = 0;
+                int n = 0;
+                while (true) {
+                    {
+                        std::unique_lock<std::mutex> lock(_mutex);
+                        _cv.wait(lock, [this, seen] { return _stop || _generation != seen; });
+                        if (_stop) {
+                            return;
+                        }
+                        seen = _generation;
+                        n = _n;
+                        ++_active;
+                        Tracer::set_batch(_trace_batch);
+                    }
+                    run_tasks(seen, n);
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    --_active;
+                    _done_cv.notify_all();
+                }
+            }
+
+            std::vector<std::thread> _workers;
+            // serializes parallel_for calls from different predictors
+            std::mutex _call_mutex;
+            std::mutex _mutex;
+            std::condition_variable _cv;
+            std::condition_variable _done_cv;
+            std::atomic<Task> _task;
+            std::atomic<const void*> _fn;
+            // indices of the current call, guarded by _mutex
+            int _n;
+            std::atomic<uint64_t> _next;
+            std::atomic<int> _pending;
+            // workers inside run_tasks, guarded by _mutex
+            int _active;
+            uint64_t _generation;
+            // batch of the caller, for the spans the workers record
+            int64_t _trace_batch;
+            bool _stop;
+        };
+    }
+}
@@ -0,0 +1,154 @@
+#include "utils/trace.h"
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include <glog/logging.h>
+
+namespace PaddleSolution {
+    namespace utils {
+        namespace {
+            struct TraceEvent {
+                const char* name;
+                int64_t begin_us;
+                int64_t end_us;
+                int64_t batch;
+                int image;
+            };
+
+            // written by its thread only, read by stop()
+            struct ThreadBuffer {
+                ThreadBuffer(int session_, int tid_, int capacity)
+                    : session(session_), tid(tid_), events(capacity), next(0) {
+                }
+
+                int session;
+                int tid;
+                std::vector<TraceEvent> events;
+                // spans recorded so far, events[next % size] is the next slot
+                std::atomic<uint64_t> next;
+            };
+
+            std::mutex g_mutex;
+            std::vector<std::shared_ptr<ThreadBuffer>> g_buffers;
+            std::string g_file;
+            int g_capacity = 0;
+            std::atomic<int> g_session(0);
+            std::chrono::steady_clock::time_point g_start;
+
+            thread_local std::shared_ptr<ThreadBuffer> t_buffer;
+            thread_local int64_t t_batch = -1;
+            thread_local int t_image = -1;
+
+            ThreadBuffer* thread_buffer() {
+                int session = g_session.load(std::memory_order_acquire);
+                if (t_buffer == nullptr || t_buffer->session != session) {
+                    std::lock_guard<std::mutex> lock(g_mutex);
+                    t_buffer = std::make_shared<ThreadBuffer>(session, static_cast<int>(g_buffers.size()) + 1, g_capacity);
+                    g_buffers.push_back(t_buffer);
+                }
+                return t_buffer.get();
+            }
+        }
+
+        std::atomic<bool> Tracer::_enabled(false);
+
+        void Tracer::start(const std::string& json_file, int events_per_thread) {
+#ifndef PADDLESEG_TRACE
+            LOG(WARNING) << "Built without WITH_TRACE, " << json_file << " will have no spans";
+#endif
+            std::lock_guard<std::mutex> lock(g_mutex);
+            g_buffers.clear();
+            g_file = json_file;
+            g_capacity = events_per_thread > 0 ? events_per_thread : 1;
+            g_start = std::chrono::steady_clock::now();
+            g_session.fetch_add(1, std::memory_order_release);
+            _enabled = true;
+        }
+
+        bool Tracer::stop() {
+            if (!_enabled.exchange(false)) {
+                return false;
+            }
+            std::lock_guard<std::mutex> lock(g_mutex);
+            FILE* fp = fopen(g_file.c_str(), "w");
+            if (fp == nullptr) {
+                LOG(ERROR) << "Fail to write the trace: " << g_file;
+                return false;
+            }
+#ifdef _WIN32
+            int pid = 0;
+#else
+            int pid = getpid();
+#endif
+            uint64_t spans = 0;
+            const char* separator = "";
+            fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+            for (const auto& buffer : g_buffers) {
+                fprintf(fp, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, "
+                        "\"args\": {\"name\": \"thread %d\"}}", separator, pid, buffer->tid, buffer->tid);
+                separator = ",\n";
+                uint64_t next = buffer->next.load(std::memory_order_acquire);
+                uint64_t size = buffer->events.size();
+                for (uint64_t k = next > size ? next - size : 0; k < next; ++k) {
+                    const TraceEvent& event = buffer->events[k % size];
+                    fprintf(fp, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"ts\": %lld, \"dur\": %lld, \"pid\": %d, "
+                            "\"tid\": %d, \"args\": {\"batch\": %lld, \"image\": %d}}",
+                            event.name, static_cast<long long>(event.begin_us),
+                            static_cast<long long>(event.end_us - event.begin_us), pid, buffer->tid,
+                            static_cast<long long>(event.batch), event.image);
+                    ++spans;
+                }
+            }
+            fprintf(fp, "\n]}\n");
+            fclose(fp);
+            std::cout << "trace: " << spans << " spans of " << g_buffers.size() << " threads written to " << g_file << std::endl;
+            g_buffers.clear();
+            return true;
+        }
+
+        int64_t Tracer::now_us() {
+            return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - g_start).count();
+        }
+
+        void Tracer::record(const char* name, int64_t begin_us, int64_t end_us) {
+            if (!enabled()) {
+                return;
+            }
+            ThreadBuffer* buffer = thread_buffer();
+            uint64_t next = buffer->next.load(std::memory_order_relaxed);
+            TraceEvent& event = buffer->events[next % buffer->events.size()];
+            event.name = name;
+            event.begin_us = begin_us;
+            event.end_us = end_us;
+            event.batch = t_batch;
+            event.image = t_image;
+            buffer->next.store(next + 1, std::memory_order_release);
+        }
+
+        int64_t Tracer::batch() {
+            return t_batch;
+        }
+
+        void Tracer::set_batch(int64_t batch) {
+            t_batch = batch;
+        }
+
+        int Tracer::image() {
+            return t_image;
+        }
+
+        void Tracer::set_image(int image) {
+            t_image = image;
+        }
+    }
+}
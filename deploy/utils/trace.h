@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace PaddleSolution {
+    namespace utils {
+        /* Timeline of the pipeline stages (decode, resize, Run...) exported as
+         * Chrome trace JSON, viewable in chrome://tracing or Perfetto. The spans
+         * are compiled in only with -DWITH_TRACE=ON and recorded once start() is
+         * called; each thread writes into its own ring buffer, so recording
+         * takes no lock and the oldest spans of a thread are overwritten when
+         * its buffer is full.
+         */
+        class Tracer {
+        public:
+            // start recording, `events_per_thread` spans are kept per thread
+            static void start(const std::string& json_file, int events_per_thread = 1 << 16);
+            // stop recording and write the spans of all the threads to the file
+            static bool stop();
+
+            static bool enabled() {
+                return _enabled.load(std::memory_order_relaxed);
+            }
+
+            // microseconds since start()
+            static int64_t now_us();
+
+            // a span of the calling thread, `name` must be a string literal
+            static void record(const char* name, int64_t begin_us, int64_t end_us);
+
+            // batch the calling thread works on, attached to its spans; the
+            // ThreadPool passes it on to the workers of a parallel_for
+            static int64_t batch();
+            static void set_batch(int64_t batch);
+            // image of the batch the calling thread works on, -1 for all of them
+            static int image();
+            static void set_image(int image);
+
+        private:
+            static std::atomic<bool> _enabled;
+        };
+
+        // a span from construction to destruction
+        class TraceSpan {
+        public:
+            explicit TraceSpan(const char* name)
+                : _name(name), _begin(Tracer::enabled() ? Tracer::now_us() : -1) {
+            }
+
+            ~TraceSpan() {
+                if (_begin >= 0) {
+                    Tracer::record(_name, _begin, Tracer::now_us());
+                }
+            }
+
+        private:
+            const char* _name;
+            int64_t _begin;
+        };
+
+        // the spans of the scope belong to image `image` of the batch
+        class TraceImage {
+        public:
+            explicit TraceImage(int image) : _saved(Tracer::image()) {
+                Tracer::set_image(image);
+            }
+
+            ~TraceImage() {
+                Tracer::set_image(_saved);
+            }
+
+        private:
+            int _saved;
+        };
+    }
+}
+
+#define PADDLESEG_TRACE_CONCAT_(a, b) a##b
+#define PADDLESEG_TRACE_CONCAT(a, b) PADDLESEG_TRACE_CONCAT_(a, b)
+
+// PADDLESEG_TRACE_SPAN("resize") traces the rest of the scope,
+// PADDLESEG_TRACE_IMAGE(i) tags the spans of the rest of the scope with image
+// i and PADDLESEG_TRACE_BATCH(u) the following spans of the thread with batch
+// u. They compile to nothing in builds without WITH_TRACE.
+#ifdef PADDLESEG_TRACE
+#define PADDLESEG_TRACE_SPAN(name) \
+    PaddleSolution::utils::TraceSpan PADDLESEG_TRACE_CONCAT(_trace_span_, __LINE__)(name)
+#define PADDLESEG_TRACE_IMAGE(image) \
+    PaddleSolution::utils::TraceImage PADDLESEG_TRACE_CONCAT(_trace_image_, __LINE__)(image)
+#define PADDLESEG_TRACE_BATCH(batch) PaddleSolution::utils::Tracer::set_batch(batch)
+#else
+#define PADDLESEG_TRACE_SPAN(name)
+#define PADDLESEG_TRACE_IMAGE(image)
+#define PADDLESEG_TRACE_BATCH(batch)
+#endif